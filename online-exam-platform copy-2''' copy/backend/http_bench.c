@@ -0,0 +1,226 @@
+// HTTP load generator: closed-loop keep-alive clients against one port, for comparing
+// the MHD path with the io_uring engine (--io-uring PORT) on the same machine.
+//
+// Build from the backend directory:
+//   gcc -O2 -o http_bench http_bench.c -lpthread
+// Run (server started with ./server --io-uring 8081):
+//   ./http_bench 8080 static    # MHD
+//   ./http_bench 8081 static    # io_uring engine
+//   ./http_bench 8081 api 32 10 # 32 clients for 10 seconds
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define BENCH_MAX_LATENCIES 2000000 // Per client
+#define BENCH_RESPONSE_SIZE (4 * 1024 * 1024)
+
+static const char *static_mix[] = {
+    "/index.html", "/exam.html", "/css/styles.css", "/js/script.js", "/js/questions.js", "/logo.png", "/bg.png"
+};
+static const char *api_mix[] = {
+    "/api/questions", "/api/questions/1", "/api/questions/2", "/api/questions/3", "/api/questions/4"
+};
+
+typedef struct {
+    int port;
+    const char **paths;
+    int path_count;
+    double deadline_ns;
+    double *latencies;
+    unsigned char *path_ids; // Index into paths, per latency
+    long count;
+    long errors;
+    long bytes;
+} BenchClient;
+
+static double bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int bench_connect(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Send one request and read the whole response; returns body bytes or -1.
+// *reusable is cleared when the server will close the connection.
+static long bench_request(int fd, const char *path, char *buffer, int *reusable) {
+    char request[512];
+    int len = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: localhost\r\n\r\n", path);
+    if (send(fd, request, len, MSG_NOSIGNAL) != len) return -1;
+
+    size_t have = 0;
+    char *body = NULL;
+    while (!body) {
+        ssize_t n = recv(fd, buffer + have, BENCH_RESPONSE_SIZE - 1 - have, 0);
+        if (n <= 0) return -1;
+        have += (size_t)n;
+        buffer[have] = '\0';
+        body = strstr(buffer, "\r\n\r\n");
+        if (!body && have == BENCH_RESPONSE_SIZE - 1) return -1;
+    }
+    body += 4;
+
+    const char *length_header = strcasestr(buffer, "Content-Length:");
+    if (!length_header || length_header > body) return -1;
+    long content_length = atol(length_header + 15);
+    if (strncmp(buffer, "HTTP/1.1 200", 12) != 0) return -1;
+
+    *reusable = strcasestr(buffer, "Connection: close") == NULL;
+    size_t header_len = (size_t)(body - buffer);
+    long received = (long)(have - header_len);
+    while (received < content_length) {
+        ssize_t n = recv(fd, buffer, BENCH_RESPONSE_SIZE, 0);
+        if (n <= 0) return -1;
+        received += n;
+    }
+    return content_length;
+}
+
+static void* bench_client(void *arg) {
+    BenchClient *client = arg;
+    char *buffer = malloc(BENCH_RESPONSE_SIZE);
+    if (!buffer) return NULL;
+
+    int fd = -1;
+    unsigned int seed = (unsigned int)(uintptr_t)client;
+    while (bench_now_ns() < client->deadline_ns && client->count < BENCH_MAX_LATENCIES) {
+        if (fd < 0) fd = bench_connect(client->port);
+        if (fd < 0) {
+            client->errors++;
+            continue;
+        }
+
+        int path_id = rand_r(&seed) % client->path_count;
+        const char *path = client->paths[path_id];
+        int reusable = 0;
+        double start = bench_now_ns();
+        long bytes = bench_request(fd, path, buffer, &reusable);
+        double elapsed = bench_now_ns() - start;
+
+        if (bytes < 0) {
+            client->errors++;
+        } else {
+            client->path_ids[client->count] = (unsigned char)path_id;
+            client->latencies[client->count++] = elapsed;
+            client->bytes += bytes;
+        }
+        if (bytes < 0 || !reusable) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd >= 0) close(fd);
+    free(buffer);
+    return NULL;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        printf("Usage: %s PORT static|api [CLIENTS] [SECONDS]\n", argv[0]);
+        return 1;
+    }
+    int port = atoi(argv[1]);
+    int api = strcmp(argv[2], "api") == 0;
+    int clients = argc > 3 ? atoi(argv[3]) : 16;
+    int seconds = argc > 4 ? atoi(argv[4]) : 5;
+    if (clients < 1) clients = 1;
+
+    BenchClient *state = calloc((size_t)clients, sizeof(BenchClient));
+    pthread_t *threads = calloc((size_t)clients, sizeof(pthread_t));
+    if (!state || !threads) return 1;
+
+    double start = bench_now_ns();
+    for (int i = 0; i < clients; i++) {
+        state[i].port = port;
+        state[i].paths = api ? api_mix : static_mix;
+        state[i].path_count = api ? (int)(sizeof(api_mix) / sizeof(api_mix[0]))
+                                   : (int)(sizeof(static_mix) / sizeof(static_mix[0]));
+        state[i].deadline_ns = start + seconds * 1e9;
+        state[i].latencies = malloc(BENCH_MAX_LATENCIES * sizeof(double));
+        state[i].path_ids = malloc(BENCH_MAX_LATENCIES);
+        if (!state[i].latencies || !state[i].path_ids) return 1;
+        pthread_create(&threads[i], NULL, bench_client, &state[i]);
+    }
+
+    long total = 0, errors = 0, bytes = 0;
+    for (int i = 0; i < clients; i++) {
+        pthread_join(threads[i], NULL);
+        total += state[i].count;
+        errors += state[i].errors;
+        bytes += state[i].bytes;
+    }
+    double elapsed = (bench_now_ns() - start) / 1e9;
+
+    double *all = malloc((size_t)(total > 0 ? total : 1) * sizeof(double));
+    double *by_path = malloc((size_t)(total > 0 ? total : 1) * sizeof(double));
+    if (!all || !by_path) return 1;
+    long n = 0;
+    for (int i = 0; i < clients; i++) {
+        memcpy(all + n, state[i].latencies, state[i].count * sizeof(double));
+        n += state[i].count;
+    }
+    qsort(all, n, sizeof(double), compare_double);
+
+    printf("port %d, %s mix, %d clients, %.1f s\n", port, api ? "api" : "static", clients, elapsed);
+    printf("%ld requests, %ld errors, %.0f req/s, %.1f MB/s\n", total, errors, total / elapsed,
+           bytes / elapsed / 1e6);
+    if (n > 0) {
+        printf("latency p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+               all[n / 2] / 1e3, all[(long)(n * 0.99)] / 1e3, all[(long)(n * 0.999)] / 1e3, all[n - 1] / 1e3);
+    }
+
+    // Per path, so a tail can be traced to the responses that cause it
+    for (int p = 0; p < state[0].path_count; p++) {
+        long m = 0;
+        for (int i = 0; i < clients; i++) {
+            for (long j = 0; j < state[i].count; j++) {
+                if (state[i].path_ids[j] == p) by_path[m++] = state[i].latencies[j];
+            }
+        }
+        if (m == 0) continue;
+        qsort(by_path, m, sizeof(double), compare_double);
+        printf("  %-18s %8ld requests, p50 %9.1f us, p99 %9.1f us\n", state[0].paths[p], m,
+               by_path[m / 2] / 1e3, by_path[(long)(m * 0.99)] / 1e3);
+    }
+
+    for (int i = 0; i < clients; i++) {
+        free(state[i].latencies);
+        free(state[i].path_ids);
+    }
+    free(by_path);
+    free(all);
+    free(state);
+    free(threads);
+    return errors > 0 && total == 0;
+}
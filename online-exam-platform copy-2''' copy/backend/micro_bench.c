@@ -0,0 +1,465 @@
+// Microbenchmarks for the server's core data structures and parsers, run on
+// generated data at several scales. Prints one JSON document so runs can be diffed.
+//
+// Build from the backend directory:
+//   gcc -O2 -o micro_bench micro_bench.c -lmicrohttpd -lgnutls -lcrypto -lz -lpthread -lm
+// Run:
+//   ./micro_bench > before.json            # scales 100, 10000 and 1000000
+//   ./micro_bench 100 10000 > quick.json   # chosen scales only
+//
+// Cache misses and instructions come from perf_event_open and are null where the
+// kernel or VM does not expose hardware counters. The 1M scale needs about 4 GB.
+#define EXAM_SERVER_NO_MAIN
+#pragma GCC diagnostic ignored "-Wunused-function"
+#include "server.c"
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+
+#define BENCH_MIN_NS 2e8 // Run each benchmark at least this long, if it has the ops
+#define BENCH_BATCH 256 // Ops between clock checks
+#define BENCH_LOOKUPS 10000000 // Most ops for benchmarks that don't grow anything
+#define BENCH_MAX_RESULTS 128
+
+typedef struct {
+    const char *name;
+    int scale;
+    long ops;
+    double ns_per_op;
+    double allocs_per_op;
+    double cache_misses_per_op; // < 0 if unavailable
+    double instructions_per_op;
+} BenchResult;
+
+// Generated data for one scale
+typedef struct {
+    int scale;
+    Question *bank; // Ids 1..scale
+    int *order; // Shuffled indexes into bank
+    char (*usernames)[MAX_USERNAME_LENGTH];
+    char (*passwords)[MAX_PASSWORD_LENGTH];
+    char *post_bodies; // "username=...&password=..." each, NUL-separated
+    size_t *post_offsets;
+    char *lines; // questions.txt lines, NUL-separated
+    size_t *line_offsets;
+} BenchData;
+
+static BenchResult bench_results[BENCH_MAX_RESULTS];
+static int bench_result_count = 0;
+static int bench_counter_fd = -1; // Group leader: cache misses
+static int bench_instructions_fd = -1;
+static char bench_counter_error[128] = "";
+static volatile uintptr_t bench_sink;
+
+static double bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static unsigned long long bench_allocs(void) {
+    unsigned long long total = 0;
+    for (int t = 0; t < MEM_TAG_COUNT; t++) total += atomic_load(&mem_stats[t].total_allocs);
+    return total;
+}
+
+static int bench_perf_open(uint64_t config, int group_fd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group_fd < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+static void bench_counters_open(void) {
+    bench_counter_fd = bench_perf_open(PERF_COUNT_HW_CACHE_MISSES, -1);
+    if (bench_counter_fd < 0) {
+        snprintf(bench_counter_error, sizeof(bench_counter_error), "perf_event_open: %s", strerror(errno));
+        return;
+    }
+    bench_instructions_fd = bench_perf_open(PERF_COUNT_HW_INSTRUCTIONS, bench_counter_fd);
+}
+
+// values[0] cache misses, values[1] instructions (0 if that counter didn't open)
+static void bench_counters_read(uint64_t values[2]) {
+    uint64_t buffer[3] = {0};
+    values[0] = values[1] = 0;
+    if (bench_counter_fd < 0) return;
+    if (read(bench_counter_fd, buffer, sizeof(buffer)) < (ssize_t)sizeof(uint64_t)) return;
+    values[0] = buffer[1];
+    if (buffer[0] > 1) values[1] = buffer[2];
+}
+
+typedef struct {
+    double start_ns;
+    unsigned long long allocs;
+    uint64_t counters[2];
+} BenchMark;
+
+static void bench_begin(BenchMark *mark) {
+    if (bench_counter_fd >= 0) {
+        ioctl(bench_counter_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(bench_counter_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    mark->allocs = bench_allocs();
+    bench_counters_read(mark->counters);
+    mark->start_ns = bench_now_ns();
+}
+
+static void bench_end(BenchMark *mark, const char *name, int scale, long ops) {
+    double elapsed = bench_now_ns() - mark->start_ns;
+    uint64_t counters[2];
+    bench_counters_read(counters);
+    unsigned long long allocs = bench_allocs() - mark->allocs;
+    if (bench_counter_fd >= 0) ioctl(bench_counter_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    if (ops < 1 || bench_result_count == BENCH_MAX_RESULTS) return;
+
+    BenchResult *result = &bench_results[bench_result_count++];
+    result->name = name;
+    result->scale = scale;
+    result->ops = ops;
+    result->ns_per_op = elapsed / ops;
+    result->allocs_per_op = (double)allocs / ops;
+    result->cache_misses_per_op = bench_counter_fd >= 0 ? (double)(counters[0] - mark->counters[0]) / ops : -1;
+    result->instructions_per_op = bench_instructions_fd >= 0 ? (double)(counters[1] - mark->counters[1]) / ops : -1;
+    fprintf(stderr, "%-24s %8d %12.1f ns/op %6.2f allocs/op\n", name, scale, result->ns_per_op, result->allocs_per_op);
+}
+
+// Keep going until the op budget or the minimum time runs out. The clock is read
+// every BENCH_BATCH ops, and at each power of two so slow ops don't overshoot.
+static int bench_more(long done, long max_ops, double start_ns) {
+    if (done >= max_ops) return 0;
+    if (done % BENCH_BATCH != 0 && (done & (done - 1)) != 0) return 1;
+    return bench_now_ns() - start_ns < BENCH_MIN_NS;
+}
+
+// Cycle through the shuffled order without a division per op
+static int bench_next(const BenchData *data, int *cursor) {
+    int index = data->order[*cursor];
+    if (++*cursor == data->scale) *cursor = 0;
+    return index;
+}
+
+static const char *bench_words[] = {
+    "stack", "queue", "tree", "graph", "array", "linked", "list", "heap", "hash", "table",
+    "node", "pointer", "recursion", "sort", "search", "binary", "balanced", "traversal",
+    "complexity", "memory", "insert", "delete", "circular", "priority", "depth", "breadth"
+};
+
+static void bench_sentence(char *out, size_t size, unsigned int *seed, int words) {
+    size_t offset = 0;
+    int word_count = sizeof(bench_words) / sizeof(bench_words[0]);
+    for (int i = 0; i < words && offset + 16 < size; i++) {
+        offset += snprintf(out + offset, size - offset, "%s%s", i ? " " : "", bench_words[rand_r(seed) % word_count]);
+    }
+}
+
+static void bench_data_free(BenchData *data) {
+    free(data->bank);
+    free(data->order);
+    free(data->usernames);
+    free(data->passwords);
+    free(data->post_bodies);
+    free(data->post_offsets);
+    free(data->lines);
+    free(data->line_offsets);
+    memset(data, 0, sizeof(*data));
+}
+
+static int bench_data_build(BenchData *data, int scale) {
+    memset(data, 0, sizeof(*data));
+    data->scale = scale;
+    data->bank = calloc((size_t)scale, sizeof(Question));
+    data->order = malloc((size_t)scale * sizeof(int));
+    data->usernames = malloc((size_t)scale * MAX_USERNAME_LENGTH);
+    data->passwords = malloc((size_t)scale * MAX_PASSWORD_LENGTH);
+    data->post_bodies = malloc((size_t)scale * 64);
+    data->post_offsets = malloc((size_t)scale * sizeof(size_t));
+    data->lines = malloc((size_t)scale * 512);
+    data->line_offsets = malloc((size_t)scale * sizeof(size_t));
+    if (!data->bank || !data->order || !data->usernames || !data->passwords || !data->post_bodies ||
+        !data->post_offsets || !data->lines || !data->line_offsets) {
+        bench_data_free(data);
+        return 0;
+    }
+
+    unsigned int seed = (unsigned int)scale;
+    size_t post_used = 0, line_used = 0;
+    for (int i = 0; i < scale; i++) {
+        Question *q = &data->bank[i];
+        q->id = i + 1;
+        bench_sentence(q->question, 160, &seed, 12);
+        for (int o = 0; o < 4; o++) bench_sentence(q->options[o], 48, &seed, 3);
+        q->correct_answer = rand_r(&seed) % 4;
+        bench_sentence(q->explanation, 160, &seed, 10);
+        q->difficulty = (q->id % 10) + 1;
+        data->order[i] = i;
+
+        snprintf(data->usernames[i], MAX_USERNAME_LENGTH, "student%07d", i);
+        snprintf(data->passwords[i], MAX_PASSWORD_LENGTH, "pw%08x", rand_r(&seed));
+        data->post_offsets[i] = post_used;
+        post_used += snprintf(data->post_bodies + post_used, 64, "username=%s&password=%s",
+                              data->usernames[i], data->passwords[i]) + 1;
+
+        data->line_offsets[i] = line_used;
+        line_used += snprintf(data->lines + line_used, 512, "%d|%s|%s|%s|%s|%s|%d|%s", q->id, q->question,
+                              q->options[0], q->options[1], q->options[2], q->options[3],
+                              q->correct_answer + 1, q->explanation) + 1;
+    }
+
+    // Fisher-Yates, so BST inserts don't degenerate into a list and lookups jump around
+    for (int i = scale - 1; i > 0; i--) {
+        int j = rand_r(&seed) % (i + 1);
+        int swap = data->order[i];
+        data->order[i] = data->order[j];
+        data->order[j] = swap;
+    }
+    return 1;
+}
+
+static void bench_hash_string(BenchData *data) {
+    BenchMark mark;
+    long done = 0;
+    int cursor = 0;
+    unsigned int sum = 0;
+    bench_begin(&mark);
+    while (bench_more(done, BENCH_LOOKUPS, mark.start_ns)) {
+        sum += hash_string(data->usernames[bench_next(data, &cursor)]);
+        done++;
+    }
+    bench_end(&mark, "hash_string", data->scale, done);
+    bench_sink = sum;
+}
+
+static void bench_auth(BenchData *data) {
+    // insert_auth_entry prepends to a chain, so building is one allocation per user
+    BenchMark mark;
+    bench_begin(&mark);
+    for (int i = 0; i < data->scale; i++) insert_auth_entry(data->usernames[i], data->passwords[i]);
+    bench_end(&mark, "insert_auth_entry", data->scale, data->scale);
+
+    long done = 0;
+    int cursor = 0;
+    int found = 0;
+    bench_begin(&mark);
+    while (bench_more(done, BENCH_LOOKUPS, mark.start_ns)) {
+        int i = bench_next(data, &cursor);
+        found += check_auth_hash_table(data->usernames[i], data->passwords[i]);
+        done++;
+    }
+    bench_end(&mark, "check_auth_hash_table", data->scale, done);
+    if (found != done) fprintf(stderr, "check_auth_hash_table: %d of %ld found\n", found, done);
+
+    for (int b = 0; b < HASH_TABLE_SIZE; b++) {
+        while (auth_hash_table[b]) {
+            AuthEntry *next = auth_hash_table[b]->next;
+            data_free(auth_hash_table[b]);
+            auth_hash_table[b] = next;
+        }
+    }
+}
+
+static void bench_bst(BenchData *data) {
+    BSTNode *root = NULL;
+    BenchMark mark;
+    bench_begin(&mark);
+    for (int i = 0; i < data->scale; i++) root = insert_bst(root, &data->bank[data->order[i]]);
+    bench_end(&mark, "insert_bst", data->scale, data->scale);
+
+    long done = 0;
+    int cursor = 0;
+    int found = 0;
+    bench_begin(&mark);
+    while (bench_more(done, BENCH_LOOKUPS, mark.start_ns)) {
+        found += search_bst(root, data->bank[bench_next(data, &cursor)].id) != NULL;
+        done++;
+    }
+    bench_end(&mark, "search_bst", data->scale, done);
+    if (found != done) fprintf(stderr, "search_bst: %d of %ld found\n", found, done);
+    free_bst(root);
+}
+
+// Build a difficulty-ordered queue of the whole bank directly, in the order repeated
+// inserts would leave it, so the insert benchmarks start from a queue of scale nodes
+static PQNode* bench_build_queue(BenchData *data) {
+    PQNode *head = NULL, **tail = &head;
+    for (int difficulty = 10; difficulty >= 1; difficulty--) {
+        for (int i = 0; i < data->scale; i++) {
+            if (data->bank[i].difficulty != difficulty) continue;
+            PQNode *node = mem_alloc(MEM_PRIORITY_QUEUE, sizeof(PQNode));
+            if (!node) return head;
+            node->question = &data->bank[i];
+            node->next = NULL;
+            *tail = node;
+            tail = &node->next;
+        }
+    }
+    return head;
+}
+
+static void bench_free_queue(PQNode *head) {
+    while (head) {
+        PQNode *next = head->next;
+        mem_free(head);
+        head = next;
+    }
+}
+
+// Both queues are sorted linked lists, so an insert walks past every node of equal
+// or higher difficulty and the cost grows with the scale
+static void bench_priority_queue(BenchData *data) {
+    BenchMark mark;
+    long done = 0;
+    int cursor = 0;
+    priority_queue_head = bench_build_queue(data);
+    bench_begin(&mark);
+    while (bench_more(done, data->scale, mark.start_ns)) {
+        insert_priority_queue(&data->bank[bench_next(data, &cursor)]);
+        done++;
+    }
+    bench_end(&mark, "insert_priority_queue", data->scale, done);
+    bench_free_queue(priority_queue_head);
+    priority_queue_head = NULL;
+
+    PQNode *temp_queue_head = bench_build_queue(data);
+    done = 0;
+    cursor = 0;
+    bench_begin(&mark);
+    while (bench_more(done, data->scale, mark.start_ns)) {
+        copy_to_temp_queue(&data->bank[bench_next(data, &cursor)], &temp_queue_head);
+        done++;
+    }
+    bench_end(&mark, "copy_to_temp_queue", data->scale, done);
+    bench_free_queue(temp_queue_head);
+}
+
+static void bench_parse_post_data(BenchData *data) {
+    char username[MAX_USERNAME_LENGTH], password[MAX_PASSWORD_LENGTH];
+    BenchMark mark;
+    long done = 0;
+    int cursor = 0;
+    int parsed = 0;
+    bench_begin(&mark);
+    while (bench_more(done, BENCH_LOOKUPS, mark.start_ns)) {
+        parsed += parse_post_data(data->post_bodies + data->post_offsets[bench_next(data, &cursor)], username, password);
+        done++;
+    }
+    bench_end(&mark, "parse_post_data", data->scale, done);
+    if (parsed != done) fprintf(stderr, "parse_post_data: %d of %ld parsed\n", parsed, done);
+}
+
+// As in load_questions: copy the line out of the file buffer, then split it in place
+static void bench_parse_question_line(BenchData *data) {
+    char line[2048];
+    Question *question = malloc(sizeof(Question));
+    if (!question) return;
+    BenchMark mark;
+    long done = 0;
+    int cursor = 0;
+    int parsed = 0;
+    bench_begin(&mark);
+    while (bench_more(done, BENCH_LOOKUPS, mark.start_ns)) {
+        const char *source = data->lines + data->line_offsets[bench_next(data, &cursor)];
+        size_t len = strlen(source);
+        memcpy(line, source, len + 1);
+        memset(question, 0, sizeof(Question));
+        parsed += parse_question_line(line, question);
+        done++;
+    }
+    bench_end(&mark, "parse_question_line", data->scale, done);
+    if (parsed != done) fprintf(stderr, "parse_question_line: %d of %ld parsed\n", parsed, done);
+    free(question);
+}
+
+static void bench_question_json(BenchData *data) {
+    char *json = malloc(QUESTION_JSON_SIZE);
+    if (!json) return;
+    BenchMark mark;
+    long done = 0;
+    int cursor = 0;
+    size_t bytes = 0;
+    bench_begin(&mark);
+    while (bench_more(done, BENCH_LOOKUPS, mark.start_ns)) {
+        bytes += question_json(&data->bank[bench_next(data, &cursor)], json, QUESTION_JSON_SIZE);
+        done++;
+    }
+    bench_end(&mark, "question_json", data->scale, done);
+    bench_sink = bytes;
+    free(json);
+}
+
+static void bench_print_json(void) {
+    time_t now = time(NULL);
+    struct tm tm_utc;
+    char timestamp[32];
+    gmtime_r(&now, &tm_utc);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", &tm_utc);
+
+    printf("{\"timestamp\":\"%s\",\"compiler\":\"%s\",\"counters\":", timestamp, __VERSION__);
+    if (bench_counter_fd >= 0) {
+        printf("true");
+    } else {
+        printf("false,\"counters_error\":\"%s\"", bench_counter_error);
+    }
+    printf(",\"results\":[");
+    for (int i = 0; i < bench_result_count; i++) {
+        const BenchResult *r = &bench_results[i];
+        printf("%s\n{\"name\":\"%s\",\"scale\":%d,\"ops\":%ld,\"ns_per_op\":%.2f,\"allocs_per_op\":%.3f,",
+               i ? "," : "", r->name, r->scale, r->ops, r->ns_per_op, r->allocs_per_op);
+        if (r->cache_misses_per_op >= 0) {
+            printf("\"cache_misses_per_op\":%.3f,", r->cache_misses_per_op);
+        } else {
+            printf("\"cache_misses_per_op\":null,");
+        }
+        if (r->instructions_per_op >= 0) {
+            printf("\"instructions_per_op\":%.1f}", r->instructions_per_op);
+        } else {
+            printf("\"instructions_per_op\":null}");
+        }
+    }
+    printf("\n]}\n");
+}
+
+int main(int argc, char **argv) {
+    int default_scales[] = {100, 10000, 1000000};
+    int scales[16];
+    int scale_count = 0;
+    for (int i = 1; i < argc && scale_count < 16; i++) {
+        int scale = atoi(argv[i]);
+        if (scale < 1) {
+            fprintf(stderr, "Usage: %s [SCALE...]\n", argv[0]);
+            return 1;
+        }
+        scales[scale_count++] = scale;
+    }
+    if (scale_count == 0) {
+        memcpy(scales, default_scales, sizeof(default_scales));
+        scale_count = sizeof(default_scales) / sizeof(default_scales[0]);
+    }
+
+    bench_counters_open();
+    if (bench_counter_fd < 0) fprintf(stderr, "No hardware counters (%s)\n", bench_counter_error);
+
+    for (int s = 0; s < scale_count; s++) {
+        BenchData data;
+        if (!bench_data_build(&data, scales[s])) {
+            fprintf(stderr, "Not enough memory for scale %d; skipped\n", scales[s]);
+            continue;
+        }
+        bench_hash_string(&data);
+        bench_auth(&data);
+        bench_bst(&data);
+        bench_priority_queue(&data);
+        bench_parse_post_data(&data);
+        bench_parse_question_line(&data);
+        bench_question_json(&data);
+        bench_data_free(&data);
+    }
+
+    bench_print_json();
+    return 0;
+}
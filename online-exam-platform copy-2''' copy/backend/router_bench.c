@@ -0,0 +1,102 @@
+// Router benchmark: dispatch cost against the number of registered routes.
+//
+// Build from the backend directory:
+//   gcc -O2 -o router_bench router_bench.c -lmicrohttpd -lgnutls -lcrypto -lz -lpthread -lm
+// Run:
+//   ./router_bench
+#define EXAM_SERVER_NO_MAIN
+#pragma GCC diagnostic ignored "-Wunused-function"
+#include "server.c"
+
+#define BENCH_ITERATIONS 2000000
+#define BENCH_URLS 8
+
+static const char *bench_resources[] = {
+    "users", "exams", "questions", "sessions", "results", "reports", "groups", "rooms",
+    "proctors", "events", "media", "settings"
+};
+
+static enum MHD_Result bench_handler(RequestContext *ctx) {
+    (void)ctx;
+    return MHD_YES;
+}
+
+static int bench_middleware(RequestContext *ctx, enum MHD_Result *result) {
+    (void)ctx;
+    (void)result;
+    return 1;
+}
+
+static double bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Register route_count routes spread over versions, resources and shapes:
+//   /api/v{n}/{resource}, /api/v{n}/{resource}/{id:int}, /api/v{n}/{resource}/{id:int}/{field}, ...
+static int bench_build_router(Router *router, int route_count) {
+    static const char *shapes[] = {
+        "/api/v%d/%s", "/api/v%d/%s/{id:int}", "/api/v%d/%s/{id:int}/{field}", "/api/v%d/%s/search"
+    };
+    int resources = sizeof(bench_resources) / sizeof(bench_resources[0]);
+    int shape_count = sizeof(shapes) / sizeof(shapes[0]);
+    char pattern[256];
+    
+    for (int i = 0; i < route_count; i++) {
+        int shape = i % shape_count;
+        int resource = (i / shape_count) % resources;
+        int version = i / (shape_count * resources) + 1;
+        snprintf(pattern, sizeof(pattern), shapes[shape], version, bench_resources[resource]);
+        
+        Route *route = router_add(router, ROUTE_GET | ROUTE_POST, pattern, bench_handler);
+        if (!route) return 0;
+        route_use(route, bench_middleware);
+    }
+    return router_compile(router);
+}
+
+// Dispatch a mix of hits (first, middle, last route, parameters) and misses
+static void bench_router(int route_count) {
+    Router router = {0};
+    if (!bench_build_router(&router, route_count)) {
+        printf("Failed to build router with %d routes\n", route_count);
+        router_free(&router);
+        return;
+    }
+    
+    int last_version = (route_count - 1) / (4 * 12) + 1;
+    char urls[BENCH_URLS][128];
+    snprintf(urls[0], sizeof(urls[0]), "/api/v1/users");
+    snprintf(urls[1], sizeof(urls[1]), "/api/v1/exams/42");
+    snprintf(urls[2], sizeof(urls[2]), "/api/v%d/questions/7/text", last_version);
+    snprintf(urls[3], sizeof(urls[3]), "/api/v%d/sessions/search", last_version);
+    snprintf(urls[4], sizeof(urls[4]), "/api/v%d/results/123456", (last_version + 1) / 2);
+    snprintf(urls[5], sizeof(urls[5]), "/api/v1/users/not-a-number");
+    snprintf(urls[6], sizeof(urls[6]), "/css/styles.css");
+    snprintf(urls[7], sizeof(urls[7]), "/api/v%d/unknown/1", last_version + 1);
+    
+    RequestContext ctx;
+    unsigned int allowed;
+    int matched = 0;
+    
+    double start = bench_now_ns();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        memset(&ctx, 0, offsetof(RequestContext, params));
+        if (router_match(&router, 0, urls[i % BENCH_URLS], &ctx, &allowed)) matched++;
+    }
+    double elapsed = bench_now_ns() - start;
+    
+    printf("%6d routes: %7.1f ns/dispatch (%d of %d matched)\n",
+           router.route_count, elapsed / BENCH_ITERATIONS, matched, BENCH_ITERATIONS);
+    router_free(&router);
+}
+
+int main(void) {
+    printf("=== Router dispatch benchmark (%d lookups per size) ===\n", BENCH_ITERATIONS);
+    int sizes[] = {10, 100, 500, 2000};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        bench_router(sizes[i]);
+    }
+    return 0;
+}
@@ -9,6 +9,33 @@
 #include <unistd.h>
 #include <openssl/sha.h>
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <limits.h>
+#include <sched.h>
+#include <openssl/rand.h>
+#include <gnutls/gnutls.h>
+#include <gnutls/socket.h>
+#include <zlib.h>
+#include <execinfo.h>
+#include <dlfcn.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <dirent.h>
+#include <linux/io_uring.h>
 
 #define PORT 8080
 #define MAX_USERNAME_LENGTH 64
@@ -20,6 +47,7 @@
 #define MAX_EXPLANATION_LENGTH 1024
 #define MAX_POST_SIZE 1024
 #define FRONTEND_PATH "../frontend"  // Path to frontend directory relative to backend
+#define MEDIA_HASH_HEX 64 // SHA-256 of an image, as referenced from questions.txt
 #define HASH_TABLE_SIZE 101 // Prime number for hash table size
 
 // Data Structures 
@@ -29,10 +57,13 @@ typedef struct Question {
     char options[4][MAX_OPTION_LENGTH];
     int correct_answer;
     char explanation[MAX_EXPLANATION_LENGTH];
+    char image[MEDIA_HASH_HEX + 1]; // Content hash of the question's diagram, "" if none
     int difficulty; // 1-10 scale for priority queue
     struct Question *next; // For linked list
 } Question;
 
+#define QUESTION_JSON_SIZE (sizeof(Question) + 160) // Fits question_json's output
+
 // Binary Search Tree Node for Questions
 typedef struct BSTNode {
     Question *question;
@@ -58,24 +89,816 @@ typedef struct {
     size_t post_size;
 } ConnectionInfo;
 
+// Router: HTTP methods as bits so one route can accept several of them
+#define ROUTE_GET     0x01
+#define ROUTE_POST    0x02
+#define ROUTE_PUT     0x04
+#define ROUTE_DELETE  0x08
+#define ROUTE_METHOD_COUNT 4
+#define ROUTER_MAX_PARAMS 8
+#define ROUTER_MAX_SEGMENTS 16
+#define ROUTER_MAX_MIDDLEWARE 4
+#define MAX_PARAM_LENGTH 128
+
+typedef enum {
+    PARAM_STRING, // {name}     matches any single path segment
+    PARAM_INT     // {name:int} matches only an all-digit segment
+} RouteParamType;
+
+typedef struct {
+    const char *name;
+    char value[MAX_PARAM_LENGTH];
+    long int_value; // Only meaningful for PARAM_INT
+} RouteParam;
+
+struct Route;
+struct RequestContext;
+
+typedef enum MHD_Result (*RouteHandler)(struct RequestContext *ctx);
+
+// Per-request state owned by the router, kept in MHD's con_cls
+typedef struct RequestContext {
+    struct MHD_Connection *connection;
+    const char *url;
+    const char *method;
+    const char *upload_data;
+    size_t *upload_data_size;
+    void *handler_state; // Per-request state of the handler itself (e.g. ConnectionInfo)
+    const struct Route *route;
+    RouteHandler handler; // Route handler, fallback or error handler chosen on the first call
+    unsigned int allowed_methods; // Methods the path accepts when answering 405
+    int finished; // A middleware already queued the response
+    int traced; // Sampled for tracing on the first call
+    int param_count;
+    RouteParam params[ROUTER_MAX_PARAMS];
+} RequestContext;
+
+
+// Response body produced without MHD, so the io_uring engine can serve the route too.
+// data points at owned (freed by the caller) or at static storage.
+typedef struct {
+    const char *data;
+    size_t length;
+    char *owned;
+    unsigned int status;
+    const char *content_type;
+} RenderedBody;
+
+typedef int (*RouteRender)(const struct RequestContext *ctx, RenderedBody *out);
+
+// Middleware returns 1 to continue down the chain. To stop the request it
+// queues its own response, stores the MHD result in *result and returns 0.
+typedef int (*RouteMiddleware)(RequestContext *ctx, enum MHD_Result *result);
+
+typedef struct Route {
+    char *pattern;
+    unsigned int methods;
+    RouteHandler handler;
+    void (*cleanup)(void **handler_state); // Frees handler_state if the request ends early
+    RouteRender render; // Optional MHD-free renderer of the same response (GET only)
+    RouteMiddleware middleware[ROUTER_MAX_MIDDLEWARE];
+    int middleware_count;
+    const char *param_names[ROUTER_MAX_PARAMS];
+    RouteParamType param_types[ROUTER_MAX_PARAMS];
+    int param_count;
+    struct Route *next; // List of all registered routes (for cleanup)
+} Route;
+
+// Trie node, one level per path segment
+typedef struct RouteNode {
+    char *segment; // Static segment text, NULL for root and parameter nodes
+    size_t segment_len;
+    unsigned int hash;
+    struct RouteNode *children; // Static children, linked through sibling while building
+    struct RouteNode *sibling;
+    struct RouteNode **child_table; // Open-addressing table built by router_compile
+    unsigned int child_mask;
+    struct RouteNode *int_param;
+    struct RouteNode *str_param;
+    Route *routes[ROUTE_METHOD_COUNT]; // Route per method ending at this node
+} RouteNode;
+
+typedef struct Router {
+    RouteNode *root;
+    Route *routes;
+    int route_count;
+    int compiled;
+    RouteHandler fallback[ROUTE_METHOD_COUNT]; // Used when no route matches the path
+} Router;
+
+// Multi-process mode: data shared by all workers
+#define SHARED_ARENA_MIN_SIZE (16UL * 1024 * 1024) // Headroom on top of the per-line estimate
+#define SHARED_ARENA_LINE_SIZE (sizeof(Question) + sizeof(BSTNode) + sizeof(PQNode) + 64) // Worst case per data line
+#define SESSION_TABLE_SIZE 65536 // Power of two
+#define SESSION_TOKEN_LENGTH 32 // Hex characters
+#define SESSION_TTL_MS (4LL * 3600 * 1000)
+#define SESSION_MAX_PROBES 256
+#define MAX_WORKERS 64
+
+// Daemon mode: graceful restart by handing the listening socket to a new binary
+#define LISTEN_FD_ENV "EXAM_LISTEN_FD" // Listening socket inherited from the old process
+#define READY_FD_ENV "EXAM_READY_FD" // Pipe the new process writes to once it is serving
+#define SHARED_STATE_ENV "EXAM_SHARED_STATE" // name:fd:size:tag,... of the mappings handed over
+#define UPGRADE_READY_TIMEOUT_MS 30000
+#define DRAIN_TIMEOUT_SECONDS 30
+
+// Bump allocator over a MAP_SHARED mapping. It is filled before fork() and then
+// made read-only, so every worker sees the same pages at the same addresses.
+typedef struct {
+    unsigned char *base;
+    size_t size;
+    size_t used;
+    int exhausted; // Set by the first failed data_alloc; startup aborts
+} SharedArena;
+
+// Mutable shared mappings (sessions, CAT, statistics, ranks, trace settings) are
+// memfds so that a SIGUSR2 upgrade can pass them to the new binary. A mapping is
+// only adopted if its size and tag (e.g. a fingerprint of the question bank) match.
+typedef enum {
+    SHARED_SESSIONS,
+    SHARED_CAT,
+    SHARED_ITEM_STATS,
+    SHARED_RANK,
+    SHARED_TRACE,
+    SHARED_TLS_TICKET,
+    SHARED_SUBMITTED,
+    SHARED_STATE_COUNT
+} SharedStateId;
+
+typedef struct {
+    int mapped;
+    int adopted; // Mapped from the previous process's state
+    int fd;
+    size_t size;
+    uint64_t tag;
+    int has_inherited; // Listed in SHARED_STATE_ENV and not yet claimed
+    int inherited_fd;
+    size_t inherited_size;
+    uint64_t inherited_tag;
+} SharedState;
+
+enum { SESSION_EMPTY = 0, SESSION_WRITING = 1, SESSION_ACTIVE = 2 };
+
+// Slot of the shared session table. The low two bits of state hold SESSION_*,
+// the rest is a generation bumped on every rewrite so readers can detect reuse.
+typedef struct {
+    _Atomic uint32_t state;
+    _Atomic int64_t expires_ms;
+    char token[SESSION_TOKEN_LENGTH + 1];
+    char username[MAX_USERNAME_LENGTH];
+} SessionSlot;
+
+// Native HTTPS through MHD's GnuTLS support
+#define HTTPS_PORT 8443
+#define TLS_PRIORITIES "NORMAL:-VERS-TLS1.0:-VERS-TLS1.1:%SERVER_PRECEDENCE"
+#define TLS_TICKET_ROTATE_MS (3600LL * 1000) // Older tickets get a full handshake
+#define TLS_TICKET_KEY_MAX 64 // Size of a GnuTLS master ticket key
+
+// In shared state, so every worker and the process after an upgrade use the same
+// key and a ticket resumes on any of them
+typedef struct {
+    pthread_mutex_t lock; // Process-shared
+    int64_t rotated_ms;
+    unsigned int size; // 0 until the first key is made
+    unsigned char key[TLS_TICKET_KEY_MAX];
+} TlsTicketKey;
+
+typedef struct {
+    int enabled;
+    char *cert_pem;
+    char *key_pem;
+    TlsTicketKey *ticket; // Shared mapping
+    atomic_ullong connections;
+    atomic_ullong resumed; // Abbreviated handshakes from a session ticket
+    atomic_ullong ktls; // Connections the kernel took over record encryption for
+} TlsConfig;
+
+// Computerized adaptive testing over the difficulty levels (Rasch model)
+#define CAT_LEVELS 10 // Question difficulty is 1-10
+#define CAT_GRID_POINTS 61 // Ability grid for the posterior and the precomputed tables
+#define CAT_THETA_MIN -4.0
+#define CAT_THETA_MAX 4.0
+#define CAT_MAX_BITSET_LEVELS 6 // 64^6 questions is far more than we will ever load
+
+typedef struct {
+    Question **questions; // Grouped by level; a question's index here is its bit
+    int count;
+    int level_start[CAT_LEVELS + 1];
+    double grid[CAT_GRID_POINTS];
+    double p_correct[CAT_GRID_POINTS][CAT_LEVELS];
+    int level_order[CAT_GRID_POINTS][CAT_LEVELS]; // Levels by information at each grid point, best first
+    int bitset_levels;
+    size_t bitset_offset[CAT_MAX_BITSET_LEVELS]; // In words, from the start of the bitset
+    size_t bitset_bits[CAT_MAX_BITSET_LEVELS];
+    size_t bitset_words;
+    size_t slot_size;
+    unsigned char *slots; // One CatState + bitset per session slot, in shared memory
+} CatBank;
+
+// Adaptive state of one session; the hierarchical "unseen" bitset follows it
+typedef struct {
+    atomic_flag lock;
+    uint32_t session_state; // Session slot state this belongs to
+    int answered;
+    int correct;
+    int pending; // Question served but not answered yet, -1 if none
+    int remaining[CAT_LEVELS]; // Unseen questions per level
+    double theta; // Ability estimate (posterior mean)
+    double se;
+    double posterior[CAT_GRID_POINTS];
+} CatState;
+
+// Graded submissions and per-question statistics
+#define MAX_SUBMISSION_SIZE (64 * 1024)
+#define MAX_ADMINS 32
+#define ITEM_STAT_SHARDS 8 // Threads (across all workers) are spread over these
+#define ITEM_STATS_HEADER_SIZE 64
+
+typedef struct {
+    int index; // Item number in question_index
+    int option; // 1-4, 0 = unanswered
+    int correct;
+    double seconds;
+} GradedAnswer;
+
+// Each candidate submits once. A submission is appended to SUBMISSION_LOG_PATH
+// before it counts, and the log is replayed at startup.
+#define SUBMISSION_LOG_PATH "submissions.log" // Relative to the working directory, like proctor_data
+#define SUBMITTED_TABLE_MIN 1024 // Power of two
+
+// Usernames that have submitted, shared by all workers
+typedef struct {
+    pthread_mutex_t lock; // Process-shared; held across the lookup, the log append and the insert
+    uint32_t capacity; // Power of two, at least twice the users who can submit
+    uint32_t count;
+    char usernames[][MAX_USERNAME_LENGTH]; // "" for an empty slot
+} SubmittedTable;
+
+typedef struct {
+    Question *question;
+    int order; // Position in the question list
+} IndexedQuestion;
+
+typedef struct {
+    uint64_t responses;
+    uint64_t correct;
+    uint64_t option_counts[5]; // [0] unanswered, [1..4] options
+    double time_sum;
+    double rest_sum; // Rest score: proportion correct on the other items of the submission
+    double rest_sq_sum;
+    double rest_sum_correct;
+} ItemAccumulator;
+
+// Header (shard counter), then per shard: a process-shared mutex padded to
+// ITEM_STATS_HEADER_SIZE followed by one accumulator per item
+typedef struct {
+    unsigned char *base;
+    size_t size;
+    size_t shard_size;
+    int count;
+} ItemStats;
+
+// Full-text search over question text, options and explanations
+#define SEARCH_MAX_TERM 48 // Longer words are truncated
+#define SEARCH_SKIP_INTERVAL 64 // Postings per skip entry
+#define SEARCH_FIELD_GAP 8 // Position gap between fields so phrases don't span them
+#define SEARCH_MAX_DOC_TOKENS 4096 // More than a question's fields can hold
+#define SEARCH_MAX_QUERY_TERMS 16
+#define SEARCH_DEFAULT_LIMIT 50
+
+typedef struct {
+    uint32_t doc; // Last document before the block
+    uint32_t offset; // Byte offset of the block's first posting
+} SearchSkip;
+
+// Postings are in document order, each encoded as varints: document delta, position
+// count, then position deltas
+typedef struct {
+    char *text; // NULL for an empty slot
+    uint32_t doc_count;
+    uint32_t last_doc; // While building
+    uint8_t *postings;
+    size_t length;
+    size_t capacity;
+    SearchSkip *skips;
+    uint32_t skip_count;
+    uint32_t skip_capacity;
+} SearchTerm;
+
+typedef struct {
+    SearchTerm *terms; // Open addressing on the term hash
+    uint32_t mask;
+    uint32_t term_count;
+    uint32_t doc_count; // Documents are question_index positions
+    size_t posting_bytes;
+} SearchIndex;
+
+typedef struct {
+    uint32_t term; // Slot in SearchIndex.terms
+    uint32_t position;
+} SearchToken;
+
+// Cursor over one term's postings
+typedef struct {
+    const SearchTerm *term;
+    size_t offset; // Next posting
+    uint32_t doc;
+    int started;
+    const uint8_t *positions; // Current document's position deltas
+    uint32_t position_count;
+    int clause; // Query clause (word or phrase) this term belongs to
+    int phrase_offset; // Position within its phrase
+} SearchCursor;
+
+// Question images packed into one file, addressed by SHA-256
+#define MEDIA_DIR "media" // Source images, relative to backend
+#define MEDIA_PACK_PATH "media.pack"
+#define MEDIA_PACK_MAGIC "EXMEDIA1"
+#define MEDIA_PACK_ALIGN 64
+#define MEDIA_MAX_FILE_SIZE (16 * 1024 * 1024)
+
+typedef struct {
+    char magic[8];
+    uint32_t count;
+    uint32_t reserved;
+    uint64_t data_offset;
+} MediaPackHeader;
+
+// Index entries follow the header, sorted by hash
+typedef struct {
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    uint64_t offset; // From the start of the pack
+    uint64_t size;
+    char content_type[32];
+} MediaPackEntry;
+
+typedef struct {
+    const unsigned char *base; // Read-only mapping of the whole pack
+    size_t size;
+    const MediaPackEntry *entries;
+    uint32_t count;
+} MediaPack;
+
+typedef struct {
+    char path[PATH_MAX];
+    char name[256];
+    MediaPackEntry entry;
+} MediaSource;
+
+// Near-duplicate questions: MinHash signatures bucketed with LSH
+#define DEDUP_HASHES 64 // Signature length
+#define DEDUP_BANDS 16 // DEDUP_BANDS * DEDUP_ROWS == DEDUP_HASHES
+#define DEDUP_ROWS 4 // Pairs above ~0.5 similarity usually share a band
+#define DEDUP_SHINGLE_WORDS 3
+#define DEDUP_MAX_SHINGLES 2048
+#define DEDUP_MAX_BUCKET 256
+#define DEDUP_MAX_THREADS 64
+#define DEDUP_DEFAULT_THRESHOLD 0.8f
+#define DEDUP_LOAD_REPORT 20 // Pairs printed at startup
+
+typedef struct {
+    uint32_t a; // Positions in the question list, a < b
+    uint32_t b;
+    float similarity; // Estimated Jaccard similarity of the shingle sets
+} DedupPair;
+
+typedef struct {
+    uint64_t key; // Hash of one band of a signature
+    uint32_t doc;
+} DedupBandEntry;
+
+typedef struct {
+    Question **docs;
+    int count;
+    float threshold;
+    uint32_t seeds[DEDUP_HASHES];
+    uint32_t *signatures; // count * DEDUP_HASHES
+    unsigned char *empty; // Per document: no words, so its signature is meaningless
+    atomic_int next_band;
+} DedupRun;
+
+typedef struct {
+    DedupRun *run;
+    int first; // Documents to sign
+    int last;
+    DedupPair *pairs; // Found by this thread
+    int pair_count;
+    int pair_capacity;
+    int failed;
+} DedupJob;
+
+// Rank board: best result per candidate, percent buckets in a Fenwick tree
+#define RANK_BUCKETS 1001 // 0.0% .. 100.0%
+#define RANK_TABLE_SIZE 65536
+#define RANK_TOP_SIZE 100
+#define LEADERBOARD_ENTRY_SIZE (MAX_USERNAME_LENGTH * 6 + 128) // Username fully \u-escaped
+
+typedef struct {
+    char username[MAX_USERNAME_LENGTH];
+    int used;
+    int score;
+    int total;
+    int bucket;
+    int64_t submitted_ms;
+} RankResult;
+
+typedef struct {
+    pthread_mutex_t lock; // Process-shared
+    atomic_uint version; // Bumped whenever the top list changes
+    int candidates;
+    int fenwick[RANK_BUCKETS + 1]; // 1-based
+    int top_count;
+    int top[RANK_TOP_SIZE]; // Result slots, best first
+    RankResult results[RANK_TABLE_SIZE]; // Open addressing by username
+} RankBoard;
+
+// Results export behind /api/admin/export
+#define EXPORT_CHUNK_SIZE (64 * 1024)
+#define EXPORT_QUEUE_CHUNKS 4 // Encoded chunks waiting for the client, at most
+#define EXPORT_BLOCK_ROWS 4096 // Rows per columnar block
+#define EXPORT_MAX_RUNNING 2 // Per process
+
+typedef struct {
+    char username[MAX_USERNAME_LENGTH];
+    int score;
+    int total;
+    int bucket;
+    int64_t submitted_ms;
+} ExportRow;
+
+typedef struct {
+    size_t length;
+    unsigned char data[EXPORT_CHUNK_SIZE];
+} ExportChunk;
+
+typedef struct {
+    struct MHD_Connection *connection;
+    int columnar;
+    int gzip;
+    ExportRow *rows; // Snapshot of the submission log
+    int row_count;
+
+    // Encoder side only
+    int fill; // Chunk being filled, the one after the queued ones
+    unsigned char raw[EXPORT_CHUNK_SIZE]; // Encoded bytes not yet compressed or queued
+    size_t raw_length;
+    z_stream zstream;
+    int zstream_ready;
+
+    // Guarded by lock
+    pthread_mutex_t lock;
+    pthread_cond_t space; // Signalled when the reader empties a chunk or the response goes away
+    ExportChunk *chunks[EXPORT_QUEUE_CHUNKS]; // Ring: count queued chunks from head
+    int head;
+    int count;
+    size_t head_offset; // Bytes of the head chunk already handed to MHD
+    int done;
+    int failed;
+    int suspended; // The reader suspended the connection waiting for a chunk
+    int released; // MHD freed the response
+    int exited; // The encoder thread finished
+} ExportJob;
+
+// Sampling profiler behind /debug/profile
+#define PROFILE_HZ 997 // Off a round number so sampling doesn't lock step with periodic work
+#define PROFILE_MAX_SECONDS 30
+#define PROFILE_MAX_SAMPLES 32768
+#define PROFILE_MAX_DEPTH 48
+#define PROFILE_SKIP_FRAMES 2 // The signal handler and the signal trampoline
+#define PROFILE_RUNNING 0
+#define PROFILE_DONE 1
+#define PROFILE_ABANDONED 2
+
+typedef struct {
+    int depth;
+    void *frames[PROFILE_MAX_DEPTH]; // Innermost first, as backtrace() returns them
+} ProfileSample;
+
+typedef struct {
+    atomic_int busy; // One profile at a time
+    atomic_int active; // Handlers record only while set
+    atomic_int in_handler;
+    atomic_uint next;
+    atomic_uint dropped;
+    ProfileSample *samples; // Allocated only while profiling
+} Profiler;
+
+typedef struct {
+    unsigned int sample; // Index of the first sample with this stack
+    unsigned int count;
+    char *folded;
+} ProfileStack;
+
+typedef struct {
+    struct MHD_Connection *connection;
+    int seconds;
+    atomic_int state; // PROFILE_*
+    unsigned int samples;
+    unsigned int dropped;
+    char *output;
+    size_t output_length;
+} ProfileRequest;
+
+// Request tracing: spans go to per-thread rings and are dumped as Chrome trace JSON
+#define TRACE_RING_SIZE 8192 // Events per thread, power of two
+#define TRACE_MAX_THREADS 64
+
+typedef struct {
+    const char *name; // String literal or route pattern, never freed while tracing
+    int64_t ts_ns;
+    char phase; // 'B' or 'E'
+} TraceEvent;
+
+typedef struct {
+    int tid;
+    _Atomic uint64_t head; // Events ever written; only the owning thread writes
+    TraceEvent events[TRACE_RING_SIZE];
+} TraceRing;
+
+typedef struct {
+    atomic_int enabled;
+    atomic_uint sample_every; // Trace one request in this many
+    atomic_uint counter;
+} TraceConfig;
+
+// A span costs one branch on a thread-local flag unless the current request is traced
+#define TRACE_BEGIN(name) do { if (__builtin_expect(trace_request_active, 0)) trace_event((name), 'B'); } while (0)
+#define TRACE_END(name) do { if (__builtin_expect(trace_request_active, 0)) trace_event((name), 'E'); } while (0)
+
+// Allocation accounting: every heap block is tagged with the subsystem that owns it
+#define MEM_MAGIC 0x6d656d74u
+#define MEM_LEAK_SITES_SHOWN 10
+
+typedef enum {
+    MEM_QUESTIONS,
+    MEM_BST,
+    MEM_PRIORITY_QUEUE,
+    MEM_AUTH,
+    MEM_CONNECTION, // POST bodies being collected
+    MEM_REQUEST, // Router context and per-request scratch
+    MEM_RESPONSE, // Response bodies until MHD has sent them
+    MEM_ROUTER,
+    MEM_PROCTOR,
+    MEM_CAT,
+    MEM_SEARCH,
+    MEM_MEDIA, // Pack building only; the pack itself is mapped
+    MEM_DEBUG, // Profiler and tracing
+    MEM_OTHER,
+    MEM_TAG_COUNT
+} MemTag;
+
+// Placed in front of every block; 16 bytes keeps malloc's alignment
+typedef struct {
+    size_t size;
+    uint32_t tag;
+    uint32_t magic;
+} MemHeader;
+
+// One cache line per tag so subsystems don't contend on each other's counters
+typedef struct {
+    atomic_llong live_bytes;
+    atomic_llong live_allocs;
+    atomic_llong peak_bytes;
+    atomic_ullong total_allocs;
+    atomic_ullong total_bytes;
+    char pad[24];
+} MemTagStats;
+
+typedef struct {
+    void *ptr;
+    size_t size;
+    void *site; // Return address of the allocating call
+    int tag;
+} MemDebugEntry;
+
+typedef struct {
+    int enabled; // --mem-debug; fixed before the first allocation
+    pthread_mutex_t lock;
+    MemDebugEntry *entries;
+    size_t capacity;
+    size_t count;
+} MemDebug;
+
+// io_uring engine: static files and prerenderable GET routes on a second port
+#define URING_ENTRIES 1024
+#define URING_RECV_SIZE 8192 // Largest request head we accept
+#define URING_BUFFER_COUNT 64 // Registered file buffers
+#define URING_BUFFER_SIZE (64 * 1024)
+#define URING_MAX_ASSETS 256
+#define URING_MAX_URL 1024
+#define URING_TAG_ACCEPT 1ULL // user_data values that are not connections
+#define URING_TAG_STOP 2ULL
+#define URING_TAG_FILE_READ 1ULL // Low bit on a connection pointer: the linked file read
+#define URING_TAG_MASK 15ULL // Connections come from mem_calloc, 16-byte aligned
+
+typedef struct {
+    int fd;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    _Atomic unsigned int *sq_head;
+    _Atomic unsigned int *sq_tail;
+    unsigned int *sq_array;
+    unsigned int sq_mask;
+    unsigned int sq_entries;
+    unsigned int local_tail; // SQEs filled in but not yet published to the kernel
+    _Atomic unsigned int *cq_head;
+    _Atomic unsigned int *cq_tail;
+    unsigned int cq_mask;
+    struct io_uring_cqe *cqes;
+} UringQueue;
+
+typedef struct {
+    char url[URING_MAX_URL];
+    int fd; // Index in this table is the registered file index
+    size_t size;
+    const char *content_type;
+} UringAsset;
+
+typedef enum {
+    URING_CONN_RECV,
+    URING_CONN_SEND, // sendmsg of header + in-memory body
+    URING_CONN_FILE, // Linked file read + send through a registered buffer
+    URING_CONN_BUFFER_WAIT // File response waiting for a free registered buffer
+} UringConnState;
+
+typedef struct UringConn {
+    int fd;
+    UringConnState state;
+    int keep_alive;
+    int head_only;
+    char recv[URING_RECV_SIZE];
+    size_t recv_len;
+    size_t request_len; // Bytes of recv used by the current request
+    char header[URING_MAX_URL + 512];
+    int header_len;
+    struct iovec iov[2];
+    int iov_first;
+    int iov_count;
+    struct msghdr msg;
+    char *owned_body;
+    int asset;
+    int buffer; // Registered buffer index, -1 if none
+    uint64_t file_offset;
+    size_t file_remaining;
+    size_t chunk_len;
+    struct UringConn *prev;
+    struct UringConn *next;
+    struct UringConn *wait_next; // Next in the buffer wait list
+} UringConn;
+
+typedef struct {
+    UringQueue ring;
+    pthread_t thread;
+    int running;
+    int listen_fd;
+    int stop_fd; // eventfd; its read completing ends the loop
+    uint64_t stop_value;
+    UringAsset assets[URING_MAX_ASSETS];
+    int asset_count;
+    int files_registered;
+    int buffers_registered;
+    unsigned char *buffers;
+    int free_buffers[URING_BUFFER_COUNT];
+    int free_buffer_count;
+    UringConn *buffer_wait_head; // File responses waiting for a buffer, oldest first
+    UringConn *buffer_wait_tail;
+    int accept_armed; // An accept is queued or in flight
+    UringConn *connections; // Open connections, freed at stop
+    int connection_count;
+    atomic_ullong requests;
+    atomic_ullong enters; // io_uring_enter calls
+} UringServer;
+
+// Proctoring events reported by the exam page
+#define PROCTOR_QUEUE_SIZE 65536 // Power of two
+#define PROCTOR_BLOCK_ROWS 4096 // Rows per columnar block on disk
+#define PROCTOR_FLUSH_MS 1000 // Flush a partial block after this long
+#define PROCTOR_SUMMARY_TABLE_SIZE 4099 // Prime number for candidate summaries
+#define PROCTOR_MAX_SUMMARIES 65536 // Further candidates are still written, just not summarized
+#define PROCTOR_SUMMARY_JSON_SIZE (MAX_USERNAME_LENGTH * 6 + 320) // Name fully \u-escaped
+#define PROCTOR_MAX_AGE_MS (10 * 60 * 1000) // Oldest client timestamp accepted as is
+#define PROCTOR_DATA_DIR "proctor_data"
+#define MAX_EVENT_BATCH_SIZE (64 * 1024)
+
+typedef enum {
+    PROCTOR_TAB_SWITCH,
+    PROCTOR_FOCUS_LOSS,
+    PROCTOR_COPY,
+    PROCTOR_PASTE,
+    PROCTOR_EVENT_TYPES
+} ProctorEventType;
+
+typedef struct {
+    int64_t timestamp_ms;
+    uint8_t type;
+    char candidate[MAX_USERNAME_LENGTH];
+} ProctorEvent;
+
+// Slot of the bounded MPSC ring; sequence tells producer and consumer whose turn it is
+typedef struct {
+    _Atomic size_t sequence;
+    ProctorEvent event;
+} ProctorSlot;
+
+typedef struct {
+    ProctorSlot *slots;
+    size_t mask;
+    _Atomic size_t enqueue_pos; // Shared by all producers
+    char pad[64]; // Keep the consumer position off the producers' cache line
+    size_t dequeue_pos; // Only touched by the writer thread
+} ProctorQueue;
+
+// Per-candidate counters kept up to date by the writer thread
+typedef struct ProctorSummary {
+    char candidate[MAX_USERNAME_LENGTH];
+    uint64_t counts[PROCTOR_EVENT_TYPES];
+    int64_t first_ms;
+    int64_t last_ms;
+    struct ProctorSummary *next;
+} ProctorSummary;
+
+// Rows buffered for the next columnar block
+typedef struct {
+    int rows;
+    long partition; // Hour since the epoch of every row in the block
+    int64_t timestamps[PROCTOR_BLOCK_ROWS];
+    uint8_t types[PROCTOR_BLOCK_ROWS];
+    char candidates[PROCTOR_BLOCK_ROWS][MAX_USERNAME_LENGTH];
+} ProctorBlock;
+
+typedef struct {
+    ProctorQueue queue;
+    pthread_t writer;
+    atomic_int running;
+    atomic_ullong accepted;
+    atomic_ullong dropped;
+    atomic_ullong written;
+    atomic_ullong blocks;
+    pthread_rwlock_t summary_lock;
+    ProctorSummary *summaries[PROCTOR_SUMMARY_TABLE_SIZE];
+    int summary_count;
+    ProctorBlock block;
+} ProctorStore;
+
 // Global variables
 Question *question_head = NULL; // Original linked list
 BSTNode *question_bst_root = NULL; // BST for faster question lookup
 AuthEntry *auth_hash_table[HASH_TABLE_SIZE] = {NULL}; // Hash table for auth
 PQNode *priority_queue_head = NULL; // Priority queue for questions by difficulty
+Router api_router = {0}; // Routes compiled once at startup
+ProctorStore proctor_store; // Event queue, writer thread and summaries
+SharedArena shared_arena = {0}; // Question bank and auth table in multi-process mode
+SharedState shared_state[SHARED_STATE_COUNT]; // See shared_state_adopt
+SessionSlot *session_table = NULL; // Shared by all worker processes
+int worker_index = -1; // -1 in single-process mode
+char self_exe_path[PATH_MAX] = ""; // Binary to exec on SIGUSR2
+TlsConfig tls_config; // Certificate, key and session ticket key when HTTPS is on
+CatBank cat_bank; // Question bank indexed for adaptive selection
+Question **question_index = NULL; // Sorted by id; position is the item number
+int question_count = 0;
+char admin_users[MAX_ADMINS][MAX_USERNAME_LENGTH]; // From admins.txt
+int admin_count = 0;
+ItemStats item_stats; // Sharded per-question accumulators in shared memory
+RankBoard *rank_board = NULL; // Shared across workers
+SubmittedTable *submitted_table = NULL; // Shared across workers
+int submission_log_fd = -1; // O_APPEND, shared by all workers
+atomic_int export_running = 0; // Exports streaming from this process
+Profiler profiler; // Per process
+TraceConfig *trace_config = NULL; // Shared across workers
+TraceRing *_Atomic trace_rings[TRACE_MAX_THREADS]; // This process's threads that traced
+atomic_int trace_ring_count = 0;
+static _Thread_local TraceRing *trace_ring = NULL;
+static _Thread_local int trace_request_active = 0; // Set while handling a sampled request
+MemTagStats mem_stats[MEM_TAG_COUNT]; // Per process
+MemDebug mem_debug = { .lock = PTHREAD_MUTEX_INITIALIZER };
+atomic_ullong mem_requests = 0; // Requests seen, for allocations per request
+int64_t mem_start_ms = 0;
+SearchIndex search_index; // Built once at load, read-only afterwards
+MediaPack media_pack; // Mapped before fork, shared by all workers
+UringServer uring_server; // Optional io_uring engine of this process
+unsigned int uring_port = 0; // --io-uring; 0 when the engine is off
+const char *public_host = "localhost"; // --public-host: where the engine redirects to port 8080
 
 // Forward declarations
 static int authenticate(const char *username, const char *password);
 static void cleanup_connection_info(void **con_cls);
 static int parse_post_data(const char* data, char* username, char* password);
 static void load_questions(void);
+static int parse_question_line(char *line, Question *question);
+static int question_json(const Question *q, char *out, size_t size);
 static void load_auth_data(void);
 static BSTNode* insert_bst(BSTNode *root, Question *question);
 static Question* search_bst(BSTNode *root, int id);
 static unsigned int hash_string(const char *str);
-static void insert_auth_entry(const char *username, const char *password);
+static int insert_auth_entry(const char *username, const char *password);
 static int check_auth_hash_table(const char *username, const char *password);
 static void insert_priority_queue(Question *question);
+static void trace_event(const char *name, char phase);
+static void profile_frame_name(void *pc, int is_return_address, char *out, size_t size);
 static Question* get_next_priority_question(void);
 static void free_all_data_structures(void);
 static void free_bst(BSTNode *node);
@@ -85,128 +908,654 @@ static enum MHD_Result handle_login(struct MHD_Connection *connection,
                                    size_t *upload_data_size,
                                    void **con_cls);
 static struct MHD_Response* create_response(const char *content, const char *content_type);
+static enum MHD_Result send_json(struct MHD_Connection *connection, unsigned int status, const char *json);
 
-// Hash function for username
-static unsigned int hash_string(const char *str) {
-    unsigned int hash = 5381; // Initial value (arbitrary prime)
-    int c;
+// ===== Allocation accounting =====
+
+static const char *mem_tag_names[MEM_TAG_COUNT] = {
+    "questions", "bst", "priority_queue", "auth", "connection", "request",
+    "response", "router", "proctor", "cat", "search", "media", "debug", "other"
+};
+
+static void mem_account(MemTag tag, long long bytes, int allocs) {
+    MemTagStats *stats = &mem_stats[tag];
+    long long live = atomic_fetch_add_explicit(&stats->live_bytes, bytes, memory_order_relaxed) + bytes;
+    atomic_fetch_add_explicit(&stats->live_allocs, allocs, memory_order_relaxed);
     
-    while ((c = *str++)) {
-        hash = ((hash << 5) + hash) + c; // hash * 33 + c
+    if (bytes > 0) {
+        atomic_fetch_add_explicit(&stats->total_allocs, allocs, memory_order_relaxed);
+        atomic_fetch_add_explicit(&stats->total_bytes, bytes, memory_order_relaxed);
+        long long peak = atomic_load_explicit(&stats->peak_bytes, memory_order_relaxed);
+        while (live > peak &&
+               !atomic_compare_exchange_weak_explicit(&stats->peak_bytes, &peak, live,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+        }
     }
-    
-    return hash % HASH_TABLE_SIZE;
 }
 
-// Insert into auth hash table
-static void insert_auth_entry(const char *username, const char *password) {
-    if (!username || !password) return;
+// Debug mode: remember every live block and where it was allocated (open addressing,
+// backward-shift deletion so there are no tombstones)
+static void mem_debug_insert(void *ptr, size_t size, MemTag tag, void *site) {
+    pthread_mutex_lock(&mem_debug.lock);
     
-    unsigned int index = hash_string(username);
+    if ((mem_debug.count + 1) * 2 > mem_debug.capacity) {
+        size_t capacity = mem_debug.capacity ? mem_debug.capacity * 2 : 4096;
+        MemDebugEntry *entries = calloc(capacity, sizeof(MemDebugEntry));
+        if (!entries) {
+            pthread_mutex_unlock(&mem_debug.lock);
+            return;
+        }
+        for (size_t i = 0; i < mem_debug.capacity; i++) {
+            if (!mem_debug.entries[i].ptr) continue;
+            size_t slot = ((uintptr_t)mem_debug.entries[i].ptr >> 4) & (capacity - 1);
+            while (entries[slot].ptr) slot = (slot + 1) & (capacity - 1);
+            entries[slot] = mem_debug.entries[i];
+        }
+        free(mem_debug.entries);
+        mem_debug.entries = entries;
+        mem_debug.capacity = capacity;
+    }
     
-    // Create new entry
-    AuthEntry *new_entry = (AuthEntry*)malloc(sizeof(AuthEntry));
-    if (!new_entry) return;
+    size_t mask = mem_debug.capacity - 1;
+    size_t slot = ((uintptr_t)ptr >> 4) & mask;
+    while (mem_debug.entries[slot].ptr) slot = (slot + 1) & mask;
+    mem_debug.entries[slot] = (MemDebugEntry){ ptr, size, site, tag };
+    mem_debug.count++;
     
-    strncpy(new_entry->username, username, MAX_USERNAME_LENGTH - 1);
-    new_entry->username[MAX_USERNAME_LENGTH - 1] = '\0';
+    pthread_mutex_unlock(&mem_debug.lock);
+}
+
+static void mem_debug_remove(void *ptr) {
+    pthread_mutex_lock(&mem_debug.lock);
     
-    strncpy(new_entry->password, password, MAX_PASSWORD_LENGTH - 1);
-    new_entry->password[MAX_PASSWORD_LENGTH - 1] = '\0';
+    size_t mask = mem_debug.capacity - 1;
+    size_t slot = ((uintptr_t)ptr >> 4) & mask;
+    while (mem_debug.capacity && mem_debug.entries[slot].ptr && mem_debug.entries[slot].ptr != ptr) {
+        slot = (slot + 1) & mask;
+    }
+    if (mem_debug.capacity && mem_debug.entries[slot].ptr == ptr) {
+        // Pull later entries of the probe run back into the hole
+        size_t hole = slot;
+        size_t next = (slot + 1) & mask;
+        while (mem_debug.entries[next].ptr) {
+            size_t home = ((uintptr_t)mem_debug.entries[next].ptr >> 4) & mask;
+            if (((next - home) & mask) >= ((next - hole) & mask)) {
+                mem_debug.entries[hole] = mem_debug.entries[next];
+                hole = next;
+            }
+            next = (next + 1) & mask;
+        }
+        mem_debug.entries[hole].ptr = NULL;
+        mem_debug.count--;
+    }
     
-    // Insert at beginning of chain (simplest approach)
-    new_entry->next = auth_hash_table[index];
-    auth_hash_table[index] = new_entry;
+    pthread_mutex_unlock(&mem_debug.lock);
+}
+
+// Tagged malloc. Each block carries a 16-byte header with its size and tag, so
+// mem_free needs no tag and alignment is the same as malloc's. Not inlined so the
+// debug allocation site is the real caller.
+static __attribute__((noinline)) void* mem_alloc(MemTag tag, size_t size) {
+    MemHeader *header = malloc(sizeof(MemHeader) + size);
+    if (!header) return NULL;
     
-    printf("Added user %s to hash table at index %u\n", username, index);
+    header->size = size;
+    header->tag = (uint32_t)tag;
+    header->magic = MEM_MAGIC;
+    mem_account(tag, (long long)size, 1);
+    if (mem_debug.enabled) mem_debug_insert(header + 1, size, tag, __builtin_return_address(0));
+    return header + 1;
 }
 
-// Check auth using hash table
-static int check_auth_hash_table(const char *username, const char *password) {
-    if (!username || !password) return 0;
+static __attribute__((noinline)) void* mem_calloc(MemTag tag, size_t count, size_t size) {
+    if (size && count > SIZE_MAX / size) return NULL;
     
-    unsigned int index = hash_string(username);
-    AuthEntry *current = auth_hash_table[index];
+    MemHeader *header = calloc(1, sizeof(MemHeader) + count * size);
+    if (!header) return NULL;
     
-    while (current) {
-        if (strcmp(current->username, username) == 0 && 
-            strcmp(current->password, password) == 0) {
-            return 1; // Found match
-        }
-        current = current->next;
+    header->size = count * size;
+    header->tag = (uint32_t)tag;
+    header->magic = MEM_MAGIC;
+    mem_account(tag, (long long)header->size, 1);
+    if (mem_debug.enabled) mem_debug_insert(header + 1, header->size, tag, __builtin_return_address(0));
+    return header + 1;
+}
+
+static MemHeader* mem_header(void *ptr) {
+    MemHeader *header = (MemHeader*)ptr - 1;
+    if (header->magic != MEM_MAGIC) {
+        printf("FATAL: freeing %p, which was not allocated by mem_alloc\n", ptr);
+        abort();
     }
+    return header;
+}
+
+static void mem_free(void *ptr) {
+    if (!ptr) return;
     
-    return 0; // No match found
+    MemHeader *header = mem_header(ptr);
+    if (mem_debug.enabled) mem_debug_remove(ptr);
+    mem_account((MemTag)header->tag, -(long long)header->size, -1);
+    header->magic = 0;
+    free(header);
 }
 
-// BST insertion
-static BSTNode* insert_bst(BSTNode *root, Question *question) {
-    if (root == NULL) {
-        BSTNode *new_node = (BSTNode*)malloc(sizeof(BSTNode));
-        if (!new_node) return NULL;
-        
-        new_node->question = question;
-        new_node->left = NULL;
-        new_node->right = NULL;
-        return new_node;
-    }
+// Like realloc; the block keeps its original tag
+static __attribute__((noinline)) void* mem_realloc(MemTag tag, void *ptr, size_t size) {
+    if (!ptr) return mem_alloc(tag, size);
     
-    // Use question ID as key for BST
-    if (question->id < root->question->id) {
-        root->left = insert_bst(root->left, question);
-    } else if (question->id > root->question->id) {
-        root->right = insert_bst(root->right, question);
-    }
+    MemHeader *old_header = mem_header(ptr);
+    size_t old_size = old_header->size;
+    tag = (MemTag)old_header->tag;
     
-    return root;
+    MemHeader *header = realloc(old_header, sizeof(MemHeader) + size);
+    if (!header) return NULL;
+    
+    header->size = size;
+    mem_account(tag, (long long)size - (long long)old_size, 0);
+    if (mem_debug.enabled) {
+        mem_debug_remove(ptr);
+        mem_debug_insert(header + 1, size, tag, __builtin_return_address(0));
+    }
+    return header + 1;
 }
 
-// BST search
-static Question* search_bst(BSTNode *root, int id) {
-    if (root == NULL) return NULL;
-    
-    if (id == root->question->id) {
-        return root->question;
-    } else if (id < root->question->id) {
-        return search_bst(root->left, id);
-    } else {
-        return search_bst(root->right, id);
+static char* mem_copy_string(MemTag tag, const char *str, size_t len) {
+    char *copy = mem_alloc(tag, len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+static char* mem_strndup(MemTag tag, const char *str, size_t max_len) {
+    return mem_copy_string(tag, str, strnlen(str, max_len));
+}
+
+static char* mem_strdup(MemTag tag, const char *str) {
+    return mem_copy_string(tag, str, strlen(str));
+}
+
+// For MHD responses built on a tagged buffer
+static void mem_free_callback(void *ptr) {
+    mem_free(ptr);
+}
+
+// Report blocks of the given tags that are still live; with --mem-debug, also
+// where the first few were allocated
+static void mem_report_leaks(const MemTag *tags, int tag_count) {
+    for (int t = 0; t < tag_count; t++) {
+        MemTag tag = tags[t];
+        long long allocs = atomic_load(&mem_stats[tag].live_allocs);
+        if (allocs == 0) continue;
+        
+        printf("Leak: %lld %s allocations (%lld bytes) still live\n", allocs, mem_tag_names[tag],
+               (long long)atomic_load(&mem_stats[tag].live_bytes));
+        if (!mem_debug.enabled) continue;
+        
+        pthread_mutex_lock(&mem_debug.lock);
+        int shown = 0;
+        for (size_t i = 0; i < mem_debug.capacity && shown < MEM_LEAK_SITES_SHOWN; i++) {
+            const MemDebugEntry *entry = &mem_debug.entries[i];
+            if (!entry->ptr || entry->tag != tag) continue;
+            
+            char site[256];
+            profile_frame_name(entry->site, 1, site, sizeof(site));
+            printf("  %zu bytes at %p allocated from %s\n", entry->size, entry->ptr, site);
+            shown++;
+        }
+        pthread_mutex_unlock(&mem_debug.lock);
     }
 }
 
-// Insert into priority queue (based on difficulty)
-static void insert_priority_queue(Question *question) {
-    PQNode *new_node = (PQNode*)malloc(sizeof(PQNode));
-    if (!new_node) return;
+// Lines left in fp (an unterminated last line counts), then closes it. 0 for NULL.
+static size_t count_file_lines(FILE *fp) {
+    if (!fp) return 0;
     
-    new_node->question = question;
-    
-    // Empty queue or new question has higher priority (difficulty)
-    if (priority_queue_head == NULL || question->difficulty > priority_queue_head->question->difficulty) {
-        new_node->next = priority_queue_head;
-        priority_queue_head = new_node;
-    } else {
-        // Find position to insert
-        PQNode *current = priority_queue_head;
-        while (current->next != NULL && 
-               current->next->question->difficulty >= question->difficulty) {
-            current = current->next;
-        }
-        
-        new_node->next = current->next;
-        current->next = new_node;
+    size_t lines = 0;
+    int c, last = '\n';
+    while ((c = getc(fp)) != EOF) {
+        if (c == '\n') lines++;
+        last = c;
     }
+    if (last != '\n') lines++;
+    fclose(fp);
+    return lines;
 }
 
-// Get highest priority question and remove from queue
-static Question* get_next_priority_question(void) {
-    if (priority_queue_head == NULL) return NULL;
+// Lines in a data file, looked up the way load_questions and load_auth_data find it
+static size_t count_data_file_lines(const char *name) {
+    const char *dirs[] = { "../backend/", "backend/", "" };
+    char path[256];
+    FILE *fp = NULL;
+    
+    for (int i = 0; i < 3 && !fp; i++) {
+        snprintf(path, sizeof(path), "%s%s", dirs[i], name);
+        fp = fopen(path, "r");
+    }
+    return count_file_lines(fp);
+}
+
+// Enough for every line of questions.txt and auth.txt at its largest footprint
+static size_t shared_arena_estimate(void) {
+    size_t lines = count_data_file_lines("questions.txt") + count_data_file_lines("auth.txt");
+    return SHARED_ARENA_MIN_SIZE + lines * SHARED_ARENA_LINE_SIZE;
+}
+
+// Reserve the shared arena; load_questions and load_auth_data allocate from it afterwards
+static int shared_arena_init(size_t size) {
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        printf("Failed to map shared arena: %s\n", strerror(errno));
+        return 0;
+    }
+    shared_arena.base = base;
+    shared_arena.size = size;
+    shared_arena.used = 0;
+    return 1;
+}
+
+// Make the loaded data read-only before the workers are forked
+static void shared_arena_seal(void) {
+    if (!shared_arena.base) return;
+    if (mprotect(shared_arena.base, shared_arena.size, PROT_READ) != 0) {
+        printf("Failed to seal shared arena: %s\n", strerror(errno));
+        return;
+    }
+    printf("Shared arena sealed: %zu KB of question and auth data\n", shared_arena.used / 1024);
+}
+
+// Allocation for the long-lived question and auth structures
+static void* data_alloc(MemTag tag, size_t size) {
+    if (!shared_arena.base) return mem_alloc(tag, size);
+    
+    size_t offset = (shared_arena.used + 15) & ~(size_t)15;
+    if (offset + size > shared_arena.size) {
+        if (!shared_arena.exhausted) {
+            printf("ERROR: shared arena of %zu MB is full; restart with a larger --arena-mb\n",
+                   shared_arena.size >> 20);
+        }
+        shared_arena.exhausted = 1;
+        return NULL;
+    }
+    shared_arena.used = offset + size;
+    return shared_arena.base + offset;
+}
+
+static void data_free(void *ptr) {
+    unsigned char *p = ptr;
+    if (shared_arena.base && p >= shared_arena.base && p < shared_arena.base + shared_arena.size) {
+        return; // Arena memory lives until the mapping goes away
+    }
+    mem_free(ptr);
+}
+
+static const char *shared_state_names[SHARED_STATE_COUNT] = {
+    "sessions", "cat", "item_stats", "rank", "trace", "tls_ticket", "submitted"
+};
+
+// Take the mappings listed in SHARED_STATE_ENV by the process we replace. Must run
+// before any of the *_init functions that map shared state.
+static void shared_state_adopt(void) {
+    const char *env = getenv(SHARED_STATE_ENV);
+    if (!env) return;
+    
+    char *list = mem_strdup(MEM_OTHER, env);
+    unsetenv(SHARED_STATE_ENV);
+    if (!list) return;
+    
+    char *rest = list;
+    char *entry;
+    while ((entry = strtok_r(rest, ",", &rest))) {
+        char name[32];
+        int fd;
+        unsigned long long size, tag;
+        if (sscanf(entry, "%31[^:]:%d:%llu:%llu", name, &fd, &size, &tag) != 4 || fd < 0) continue;
+        
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        int id = -1;
+        for (int i = 0; i < SHARED_STATE_COUNT; i++) {
+            if (strcmp(shared_state_names[i], name) == 0) id = i;
+        }
+        if (id < 0 || shared_state[id].has_inherited) {
+            close(fd); // From a newer or older binary with different state
+            continue;
+        }
+        shared_state[id].has_inherited = 1;
+        shared_state[id].inherited_fd = fd;
+        shared_state[id].inherited_size = (size_t)size;
+        shared_state[id].inherited_tag = (uint64_t)tag;
+    }
+    mem_free(list);
+}
+
+// Map a shared region, reusing the one handed over by the previous process when its
+// size and tag match. *inherited says whether the contents are live state (so locks
+// and counters must not be reinitialized) or fresh zeroes.
+static void* shared_state_map(SharedStateId id, size_t size, uint64_t tag, int *inherited) {
+    SharedState *state = &shared_state[id];
+    int fd = -1;
+    *inherited = 0;
+    
+    if (state->has_inherited) {
+        if (state->inherited_size == size && state->inherited_tag == tag) {
+            fd = state->inherited_fd;
+            *inherited = 1;
+        } else {
+            printf("Upgrade: %s changed shape, starting it empty\n", shared_state_names[id]);
+            close(state->inherited_fd);
+        }
+        state->has_inherited = 0;
+    }
+    
+    if (fd < 0) {
+        fd = memfd_create(shared_state_names[id], MFD_CLOEXEC);
+        if (fd < 0 || ftruncate(fd, (off_t)size) != 0) {
+            printf("Failed to create shared %s: %s\n", shared_state_names[id], strerror(errno));
+            if (fd >= 0) close(fd);
+            return NULL;
+        }
+    }
+    
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        printf("Failed to map shared %s: %s\n", shared_state_names[id], strerror(errno));
+        close(fd);
+        *inherited = 0;
+        return NULL;
+    }
+    state->mapped = 1;
+    state->adopted = *inherited;
+    state->fd = fd;
+    state->size = size;
+    state->tag = tag;
+    if (*inherited) printf("Upgrade: kept %s from the previous process\n", shared_state_names[id]);
+    return base;
+}
+
+// Locks inside are left alone: after an upgrade the new process is still using them
+static void shared_state_unmap(SharedStateId id, void *base) {
+    SharedState *state = &shared_state[id];
+    if (!state->mapped) return;
+    munmap(base, state->size);
+    close(state->fd);
+    state->mapped = 0;
+}
+
+// Close handed-over mappings that nothing in this binary asked for
+static void shared_state_release_unclaimed(void) {
+    for (int i = 0; i < SHARED_STATE_COUNT; i++) {
+        if (!shared_state[i].has_inherited) continue;
+        close(shared_state[i].inherited_fd);
+        shared_state[i].has_inherited = 0;
+    }
+}
+
+// SHARED_STATE_ENV value for the next process
+static void shared_state_env(char *out, size_t size) {
+    size_t offset = snprintf(out, size, "%s=", SHARED_STATE_ENV);
+    for (int i = 0; i < SHARED_STATE_COUNT && offset < size; i++) {
+        if (!shared_state[i].mapped) continue;
+        offset += snprintf(out + offset, size - offset, "%s%s:%d:%zu:%llu",
+                           out[offset - 1] == '=' ? "" : ",", shared_state_names[i],
+                           shared_state[i].fd, shared_state[i].size,
+                           (unsigned long long)shared_state[i].tag);
+    }
+}
+
+// Identifies the question bank (ids and keys in file order). State indexed by
+// question position is only adopted by a process that loaded the same bank.
+static uint64_t question_bank_fingerprint(void) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (Question *q = question_head; q; q = q->next) {
+        int fields[2] = { q->id, q->correct_answer };
+        const unsigned char *bytes = (const unsigned char*)fields;
+        for (size_t i = 0; i < sizeof(fields); i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+static int session_table_init(void) {
+    int inherited;
+    void *table = shared_state_map(SHARED_SESSIONS, SESSION_TABLE_SIZE * sizeof(SessionSlot), 0, &inherited);
+    if (!table) return 0;
+    session_table = table;
+    return 1;
+}
+
+static unsigned int session_hash(const char *token) {
+    unsigned int hash = 2166136261u;
+    while (*token) {
+        hash ^= (unsigned char)*token++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int64_t session_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Create a session for username and write its token to token_out. Lock-free:
+// a slot is claimed by CAS from EMPTY (or ACTIVE but expired) to WRITING.
+static int session_create(const char *username, char *token_out) {
+    if (!session_table) return 0;
+    
+    unsigned char random[SESSION_TOKEN_LENGTH / 2];
+    if (RAND_bytes(random, sizeof(random)) != 1) return 0;
+    for (size_t i = 0; i < sizeof(random); i++) {
+        sprintf(token_out + i * 2, "%02x", random[i]);
+    }
+    
+    int64_t now = session_now_ms();
+    unsigned int index = session_hash(token_out);
+    
+    for (int probe = 0; probe < SESSION_MAX_PROBES; probe++) {
+        SessionSlot *slot = &session_table[(index + probe) & (SESSION_TABLE_SIZE - 1)];
+        uint32_t state = atomic_load_explicit(&slot->state, memory_order_acquire);
+        uint32_t status = state & 3;
+        
+        int reusable = (status == SESSION_EMPTY) ||
+                       (status == SESSION_ACTIVE &&
+                        atomic_load_explicit(&slot->expires_ms, memory_order_relaxed) < now);
+        if (!reusable) continue;
+        
+        uint32_t generation = (state >> 2) + 1;
+        if (!atomic_compare_exchange_strong(&slot->state, &state, (generation << 2) | SESSION_WRITING)) {
+            continue;
+        }
+        
+        memcpy(slot->token, token_out, SESSION_TOKEN_LENGTH + 1);
+        strncpy(slot->username, username, MAX_USERNAME_LENGTH - 1);
+        slot->username[MAX_USERNAME_LENGTH - 1] = '\0';
+        atomic_store_explicit(&slot->expires_ms, now + SESSION_TTL_MS, memory_order_relaxed);
+        atomic_store_explicit(&slot->state, (generation << 2) | SESSION_ACTIVE, memory_order_release);
+        return 1;
+    }
+    
+    printf("Session table full near slot %u\n", index & (SESSION_TABLE_SIZE - 1));
+    return 0;
+}
+
+// Look up a session token; copies the username out and extends the session on success.
+// Returns the slot index (stable for the session's lifetime) or -1. *state_out gets the
+// slot's state word, which changes whenever the slot is reused for another session.
+static int session_find(const char *token, char *username_out, uint32_t *state_out) {
+    if (!session_table || !token || strlen(token) != SESSION_TOKEN_LENGTH) return -1;
+    
+    int64_t now = session_now_ms();
+    unsigned int index = session_hash(token);
+    
+    for (int probe = 0; probe < SESSION_MAX_PROBES; probe++) {
+        SessionSlot *slot = &session_table[(index + probe) & (SESSION_TABLE_SIZE - 1)];
+        uint32_t before = atomic_load_explicit(&slot->state, memory_order_acquire);
+        
+        if ((before & 3) == SESSION_EMPTY) return -1; // End of the probe chain
+        if ((before & 3) != SESSION_ACTIVE) continue;
+        if (memcmp(slot->token, token, SESSION_TOKEN_LENGTH) != 0) continue;
+        
+        char username[MAX_USERNAME_LENGTH];
+        memcpy(username, slot->username, MAX_USERNAME_LENGTH);
+        int64_t expires = atomic_load_explicit(&slot->expires_ms, memory_order_relaxed);
+        
+        // The slot may have been recycled while we were reading it
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->state, memory_order_relaxed) != before) continue;
+        if (expires < now) return -1;
+        
+        atomic_store_explicit(&slot->expires_ms, now + SESSION_TTL_MS, memory_order_relaxed);
+        if (username_out) {
+            memcpy(username_out, username, MAX_USERNAME_LENGTH);
+            username_out[MAX_USERNAME_LENGTH - 1] = '\0';
+        }
+        if (state_out) *state_out = before;
+        return (int)((index + probe) & (SESSION_TABLE_SIZE - 1));
+    }
+    return -1;
+}
+
+static int session_lookup(const char *token, char *username_out) {
+    return session_find(token, username_out, NULL) >= 0;
+}
+
+// Session token from the "session" cookie or the X-Session-Token header. Never from
+// the query string, where it would end up in logs and Referer headers.
+static const char* request_session_token(struct MHD_Connection *connection) {
+    const char *token = MHD_lookup_connection_value(connection, MHD_COOKIE_KIND, "session");
+    if (!token) token = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "X-Session-Token");
+    return token;
+}
+
+static int request_session_user(struct MHD_Connection *connection, char *username_out) {
+    return session_lookup(request_session_token(connection), username_out);
+}
+
+// Hash function for username
+static unsigned int hash_string(const char *str) {
+    unsigned int hash = 5381; // Initial value (arbitrary prime)
+    int c;
+    
+    while ((c = *str++)) {
+        hash = ((hash << 5) + hash) + c; // hash * 33 + c
+    }
+    
+    return hash % HASH_TABLE_SIZE;
+}
+
+// Insert into auth hash table
+static int insert_auth_entry(const char *username, const char *password) {
+    if (!username || !password) return 0;
+    
+    unsigned int index = hash_string(username);
+    
+    // Create new entry
+    AuthEntry *new_entry = (AuthEntry*)data_alloc(MEM_AUTH, sizeof(AuthEntry));
+    if (!new_entry) return 0;
+    
+    strncpy(new_entry->username, username, MAX_USERNAME_LENGTH - 1);
+    new_entry->username[MAX_USERNAME_LENGTH - 1] = '\0';
+    
+    strncpy(new_entry->password, password, MAX_PASSWORD_LENGTH - 1);
+    new_entry->password[MAX_PASSWORD_LENGTH - 1] = '\0';
+    
+    // Insert at beginning of chain (simplest approach)
+    new_entry->next = auth_hash_table[index];
+    auth_hash_table[index] = new_entry;
+    return 1;
+}
+
+// Check auth using hash table
+static int check_auth_hash_table(const char *username, const char *password) {
+    if (!username || !password) return 0;
+    
+    unsigned int index = hash_string(username);
+    AuthEntry *current = auth_hash_table[index];
+    
+    while (current) {
+        if (strcmp(current->username, username) == 0 && 
+            strcmp(current->password, password) == 0) {
+            return 1; // Found match
+        }
+        current = current->next;
+    }
+    
+    return 0; // No match found
+}
+
+// BST insertion
+static BSTNode* insert_bst(BSTNode *root, Question *question) {
+    if (root == NULL) {
+        BSTNode *new_node = (BSTNode*)data_alloc(MEM_BST, sizeof(BSTNode));
+        if (!new_node) return NULL;
+        
+        new_node->question = question;
+        new_node->left = NULL;
+        new_node->right = NULL;
+        return new_node;
+    }
+    
+    // Use question ID as key for BST
+    if (question->id < root->question->id) {
+        root->left = insert_bst(root->left, question);
+    } else if (question->id > root->question->id) {
+        root->right = insert_bst(root->right, question);
+    }
+    
+    return root;
+}
+
+// BST search
+static Question* search_bst(BSTNode *root, int id) {
+    if (root == NULL) return NULL;
+    
+    if (id == root->question->id) {
+        return root->question;
+    } else if (id < root->question->id) {
+        return search_bst(root->left, id);
+    } else {
+        return search_bst(root->right, id);
+    }
+}
+
+// Insert into priority queue (based on difficulty)
+static void insert_priority_queue(Question *question) {
+    PQNode *new_node = (PQNode*)data_alloc(MEM_PRIORITY_QUEUE, sizeof(PQNode));
+    if (!new_node) return;
+    
+    new_node->question = question;
+    
+    // Empty queue or new question has higher priority (difficulty)
+    if (priority_queue_head == NULL || question->difficulty > priority_queue_head->question->difficulty) {
+        new_node->next = priority_queue_head;
+        priority_queue_head = new_node;
+    } else {
+        // Find position to insert
+        PQNode *current = priority_queue_head;
+        while (current->next != NULL && 
+               current->next->question->difficulty >= question->difficulty) {
+            current = current->next;
+        }
+        
+        new_node->next = current->next;
+        current->next = new_node;
+    }
+}
+
+// Get highest priority question and remove from queue
+static Question* get_next_priority_question(void) {
+    if (priority_queue_head == NULL) return NULL;
     
     PQNode *top = priority_queue_head;
     Question *question = top->question;
     priority_queue_head = priority_queue_head->next;
     
-    free(top);
+    data_free(top);
     return question;
 }
 
@@ -217,7 +1566,7 @@ static void free_all_data_structures(void) {
     while (q_current) {
         Question *temp = q_current;
         q_current = q_current->next;
-        free(temp);
+        data_free(temp);
     }
     
     // Free BST
@@ -229,7 +1578,7 @@ static void free_all_data_structures(void) {
         while (current) {
             AuthEntry *temp = current;
             current = current->next;
-            free(temp);
+            data_free(temp);
         }
     }
     
@@ -238,8 +1587,16 @@ static void free_all_data_structures(void) {
     while (pq_current) {
         PQNode *temp = pq_current;
         pq_current = pq_current->next;
-        free(temp);
+        data_free(temp);
     }
+    
+    // Free id index
+    mem_free(question_index);
+    question_index = NULL;
+    question_count = 0;
+    
+    const MemTag data_tags[] = { MEM_QUESTIONS, MEM_BST, MEM_PRIORITY_QUEUE, MEM_AUTH };
+    mem_report_leaks(data_tags, sizeof(data_tags) / sizeof(data_tags[0]));
 }
 
 // Load authentication data from file into hash table
@@ -272,7 +1629,9 @@ static void load_auth_data(void) {
         char *username = line;
         char *password = colon + 1;
         
-        insert_auth_entry(username, password);
+        if (insert_auth_entry(username, password)) {
+            printf("Added user %s to hash table at index %u\n", username, hash_string(username));
+        }
     }
     
     fclose(fp);
@@ -315,12 +1674,79 @@ static void cleanup_connection_info(void **con_cls) {
     if (*con_cls) {
         ConnectionInfo *con_info = *con_cls;
         if (con_info->post_data)
-            free(con_info->post_data);
-        free(con_info);
+            mem_free(con_info->post_data);
+        mem_free(con_info);
         *con_cls = NULL;
     }
 }
 
+// Collect a POST body across MHD calls into a ConnectionInfo kept in *con_cls.
+// Returns 1 while more calls are expected, 0 once the body is complete, -1 on error.
+static int collect_post_data(void **con_cls, const char *upload_data, size_t *upload_data_size, size_t limit) {
+    if (*con_cls == NULL) {
+        ConnectionInfo *con_info = mem_calloc(MEM_CONNECTION, 1, sizeof(ConnectionInfo));
+        if (!con_info) return -1;
+        *con_cls = con_info;
+        return 1;
+    }
+    
+    ConnectionInfo *con_info = *con_cls;
+    
+    if (*upload_data_size != 0) {
+        if (con_info->post_size + *upload_data_size > limit) {
+            return -1;
+        }
+        
+        char *new_data = mem_realloc(MEM_CONNECTION, con_info->post_data, con_info->post_size + *upload_data_size + 1);
+        if (!new_data) return -1;
+        
+        con_info->post_data = new_data;
+        memcpy(con_info->post_data + con_info->post_size, upload_data, *upload_data_size);
+        con_info->post_size += *upload_data_size;
+        con_info->post_data[con_info->post_size] = '\0';
+        
+        *upload_data_size = 0;
+        return 1;
+    }
+    
+    return 0;
+}
+
+// Copy the URL-decoded value of key from a "a=1&b=2" form body; returns 0 if the key is missing or too long
+static int parse_form_value(const char *data, const char *key, char *out, size_t out_size) {
+    if (!data || !key || !out || out_size == 0) return 0;
+    
+    size_t key_len = strlen(key);
+    const char *p = data;
+    
+    while (p && *p) {
+        if (strncmp(p, key, key_len) == 0 && p[key_len] == '=') {
+            const char *value = p + key_len + 1;
+            size_t len = 0;
+            
+            while (*value && *value != '&') {
+                if (len + 1 >= out_size) return 0;
+                
+                if (*value == '+') {
+                    out[len++] = ' ';
+                    value++;
+                } else if (*value == '%' && isxdigit((unsigned char)value[1]) && isxdigit((unsigned char)value[2])) {
+                    char hex[3] = { value[1], value[2], '\0' };
+                    out[len++] = (char)strtol(hex, NULL, 16);
+                    value += 3;
+                } else {
+                    out[len++] = *value++;
+                }
+            }
+            out[len] = '\0';
+            return 1;
+        }
+        p = strchr(p, '&');
+        if (p) p++;
+    }
+    return 0;
+}
+
 // Function to copy questions file to current directory
 static void ensure_questions_file() {
     const char* source_paths[] = {
@@ -386,7 +1812,7 @@ static char* read_questions_file() {
     
     printf("File size: %ld bytes\n", size);
     
-    char* buffer = malloc(size + 1);
+    char* buffer = mem_alloc(MEM_QUESTIONS, size + 1);
     if (!buffer) {
         printf("ERROR: Failed to allocate memory\n");
         fclose(fp);
@@ -403,25 +1829,90 @@ static char* read_questions_file() {
     return buffer;
 }
 
-// Load Questions from File 
-static void load_questions() {
-    printf("\n=== Loading Questions ===\n");
+// Parse one questions.txt line into a zeroed Question:
+// id|question|option1|option2|option3|option4|correct|explanation[|image]
+// The line is split in place. Returns 0 if a required field is missing.
+static int parse_question_line(char *line, Question *question) {
+    char *token;
+    char *rest = line;
     
-    // Read the questions file directly
-    FILE *file = fopen("../backend/questions.txt", "r");
-    if (!file) {
-        file = fopen("backend/questions.txt", "r");
-        if (!file) {
-            file = fopen("questions.txt", "r");
-            if (!file) {
-                printf("Failed to open questions.txt: %s\n", strerror(errno));
-                return;
-            }
-        }
+    // Parse ID
+    token = strtok_r(rest, "|", &rest);
+    if (!token) {
+        printf("Error: Missing ID in line: %s\n", line);
+        return 0;
     }
+    question->id = atoi(token);
     
-    // Reset all data structures
-    question_head = NULL;
+    // Parse question text
+    token = strtok_r(rest, "|", &rest);
+    if (!token) {
+        printf("Error: Missing question text in line: %s\n", line);
+        return 0;
+    }
+    strncpy(question->question, token, sizeof(question->question) - 1);
+    
+    // Parse options (4 options)
+    for (int i = 0; i < 4; i++) {
+        token = strtok_r(rest, "|", &rest);
+        if (!token) {
+            printf("Error: Missing option %d in line: %s\n", i+1, line);
+            return 0;
+        }
+        strncpy(question->options[i], token, sizeof(question->options[i]) - 1);
+    }
+    
+    // Parse correct answer (1-based in file, convert to 0-based)
+    token = strtok_r(rest, "|", &rest);
+    if (!token) {
+        printf("Error: Missing correct answer in line: %s\n", line);
+        return 0;
+    }
+    question->correct_answer = atoi(token) - 1; // Convert to 0-based
+    
+    // Parse explanation
+    token = strtok_r(rest, "|", &rest);
+    if (token) {
+        strncpy(question->explanation, token, sizeof(question->explanation) - 1);
+    } else {
+        strncpy(question->explanation, "No explanation provided", sizeof(question->explanation) - 1);
+    }
+    
+    // Optional image, by the content hash printed by --pack-media
+    token = strtok_r(rest, "|", &rest);
+    if (token) {
+        if (strncmp(token, "sha256:", 7) == 0) token += 7;
+        if (strlen(token) == MEDIA_HASH_HEX && strspn(token, "0123456789abcdef") == MEDIA_HASH_HEX) {
+            strcpy(question->image, token);
+        } else {
+            printf("Warning: question %d has an invalid image hash: %s\n", question->id, token);
+        }
+    }
+    
+    // Set difficulty level based on question ID for now (could be more sophisticated)
+    question->difficulty = (question->id % 10) + 1; // 1-10 difficulty scale
+    return 1;
+}
+
+// Load Questions from File 
+static void load_questions() {
+    printf("\n=== Loading Questions ===\n");
+    
+    // Read the questions file directly
+    FILE *file = fopen("../backend/questions.txt", "r");
+    if (!file) {
+        file = fopen("backend/questions.txt", "r");
+        if (!file) {
+            file = fopen("questions.txt", "r");
+            if (!file) {
+                printf("Failed to open questions.txt: %s\n", strerror(errno));
+                return;
+            }
+        }
+    }
+    
+    // Reset all data structures
+    question_head = NULL;
     question_bst_root = NULL;
     priority_queue_head = NULL;
     Question *last = NULL;
@@ -441,70 +1932,25 @@ static void load_questions() {
         if (len == 0) continue;
         
         // Create new question
-        Question *new_question = malloc(sizeof(Question));
+        Question *new_question = data_alloc(MEM_QUESTIONS, sizeof(Question));
         if (!new_question) {
             printf("Failed to allocate memory for question\n");
+            if (shared_arena.exhausted) break;
             continue;
         }
         memset(new_question, 0, sizeof(Question));
         
-        // Parse line using pipe delimiter
-        char *token;
-        char *rest = line;
-        
-        // Parse ID
-        token = strtok_r(rest, "|", &rest);
-        if (!token) {
-            printf("Error: Missing ID in line: %s\n", line);
-            free(new_question);
+        if (!parse_question_line(line, new_question)) {
+            data_free(new_question);
             continue;
         }
-        new_question->id = atoi(token);
         printf("ID: %d\n", new_question->id);
-        
-        // Parse question text
-        token = strtok_r(rest, "|", &rest);
-        if (!token) {
-            printf("Error: Missing question text in line: %s\n", line);
-            free(new_question);
-            continue;
-        }
-        strncpy(new_question->question, token, sizeof(new_question->question) - 1);
         printf("Text: %s\n", new_question->question);
-        
-        // Parse options (4 options)
         for (int i = 0; i < 4; i++) {
-            token = strtok_r(rest, "|", &rest);
-            if (!token) {
-                printf("Error: Missing option %d in line: %s\n", i+1, line);
-                free(new_question);
-                continue;
-            }
-            strncpy(new_question->options[i], token, sizeof(new_question->options[i]) - 1);
             printf("Option %d: %s\n", i+1, new_question->options[i]);
         }
-        
-        // Parse correct answer (1-based in file, convert to 0-based)
-        token = strtok_r(rest, "|", &rest);
-        if (!token) {
-            printf("Error: Missing correct answer in line: %s\n", line);
-            free(new_question);
-            continue;
-        }
-        new_question->correct_answer = atoi(token) - 1; // Convert to 0-based
         printf("Correct answer: %d\n", new_question->correct_answer + 1);
-        
-        // Parse explanation
-        token = strtok_r(rest, "|", &rest);
-        if (token) {
-            strncpy(new_question->explanation, token, sizeof(new_question->explanation) - 1);
-            printf("Explanation: %s\n", new_question->explanation);
-        } else {
-            strncpy(new_question->explanation, "No explanation provided", sizeof(new_question->explanation) - 1);
-        }
-        
-        // Set difficulty level based on question ID for now (could be more sophisticated)
-        new_question->difficulty = (new_question->id % 10) + 1; // 1-10 difficulty scale
+        printf("Explanation: %s\n", new_question->explanation);
         
         // Add to linked list
         new_question->next = NULL;
@@ -549,17 +1995,17 @@ static struct MHD_Response* create_response(const char *content, const char *con
     }
     
     size_t len = strlen(content);
-    char *copy = malloc(len + 1);
+    char *copy = mem_alloc(MEM_RESPONSE, len + 1);
     if (!copy) {
         printf("Failed to allocate memory for response\n");
         return MHD_create_response_from_buffer(0, "", MHD_RESPMEM_PERSISTENT);
     }
     
     strcpy(copy, content);
-    struct MHD_Response *response = MHD_create_response_from_buffer(len, copy, MHD_RESPMEM_MUST_FREE);
+    struct MHD_Response *response = MHD_create_response_from_buffer_with_free_callback(len, copy, mem_free_callback);
     
     if (!response) {
-        free(copy);
+        mem_free(copy);
         return MHD_create_response_from_buffer(0, "", MHD_RESPMEM_PERSISTENT);
     }
     
@@ -567,6 +2013,23 @@ static struct MHD_Response* create_response(const char *content, const char *con
     return response;
 }
 
+// Append s as a JSON string body (without quotes)
+static size_t json_append_escaped(char *out, size_t size, size_t offset, const char *s) {
+    for (; *s && offset + 7 < size; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            out[offset++] = '\\';
+            out[offset++] = (char)c;
+        } else if (c < 0x20) {
+            offset += snprintf(out + offset, size - offset, "\\u%04x", c);
+        } else {
+            out[offset++] = (char)c;
+        }
+    }
+    out[offset] = '\0';
+    return offset;
+}
+
 // Function to get content type based on file extension
 const char* get_content_type(const char *filename) {
     const char *dot = strrchr(filename, '.');
@@ -577,6 +2040,9 @@ const char* get_content_type(const char *filename) {
     if (strcmp(dot, ".png") == 0) return "image/png";
     if (strcmp(dot, ".jpg") == 0) return "image/jpeg";
     if (strcmp(dot, ".jpeg") == 0) return "image/jpeg";
+    if (strcmp(dot, ".gif") == 0) return "image/gif";
+    if (strcmp(dot, ".svg") == 0) return "image/svg+xml";
+    if (strcmp(dot, ".webp") == 0) return "image/webp";
     return "text/plain";
 }
 
@@ -608,39 +2074,31 @@ static enum MHD_Result serve_file(struct MHD_Connection *connection, const char
     printf("Full path: %s\n", full_path);
     
     // Check if file exists and is readable
-    FILE *file = fopen(full_path, "rb");
-    if (!file) {
+    TRACE_BEGIN("open");
+    int fd = open(full_path, O_RDONLY | O_CLOEXEC);
+    TRACE_END("open");
+    if (fd < 0) {
         printf("File not found: %s (errno: %d - %s)\n", full_path, errno, strerror(errno));
         goto send_404;
     }
     
     // Get file size
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    
-    printf("File size: %ld bytes\n", file_size);
-    
-    char *file_data = malloc(file_size);
-    if (!file_data) {
-        fclose(file);
-        printf("Memory allocation failed for file: %s\n", full_path);
-        goto send_404;
-    }
-    
-    if (fread(file_data, 1, file_size, file) != (size_t)file_size) {
-        free(file_data);
-        fclose(file);
-        printf("Failed to read file: %s\n", full_path);
+    struct stat st;
+    TRACE_BEGIN("fstat");
+    int stat_result = fstat(fd, &st);
+    TRACE_END("fstat");
+    if (stat_result != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        printf("Not a regular file: %s\n", full_path);
         goto send_404;
     }
     
-    fclose(file);
+    printf("File size: %ld bytes\n", (long)st.st_size);
     
-    // Create response
-    response = MHD_create_response_from_buffer(file_size, file_data, MHD_RESPMEM_MUST_FREE);
+    // MHD sends straight from the descriptor (sendfile on plain HTTP) and closes it
+    response = MHD_create_response_from_fd((size_t)st.st_size, fd);
     if (!response) {
-        free(file_data);
+        close(fd);
         printf("Failed to create response for file: %s\n", full_path);
         return MHD_NO;
     }
@@ -648,7 +2106,9 @@ static enum MHD_Result serve_file(struct MHD_Connection *connection, const char
     MHD_add_response_header(response, "Content-Type", get_content_type(full_path));
     MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
     
+    TRACE_BEGIN("MHD_queue_response");
     ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+    TRACE_END("MHD_queue_response");
     MHD_destroy_response(response);
     printf("File served successfully: %s\n", full_path);
     return ret;
@@ -666,26 +2126,81 @@ send_404:
     return ret;
 }
 
+// Write one question as a JSON object, as a candidate may see it: no answer key or
+// explanation. QUESTION_JSON_SIZE bytes are always enough. Returns the length written.
+static int question_json(const Question *q, char *out, size_t size) {
+    int length = snprintf(out, size,
+        "{\"id\":%d,\"text\":\"%s\",\"options\":[\"%s\",\"%s\",\"%s\",\"%s\"],\"difficulty\":%d",
+        q->id, q->question, 
+        q->options[0], q->options[1], q->options[2], q->options[3],
+        q->difficulty
+    );
+    if (q->image[0]) {
+        length += snprintf(out + length, size - length, ",\"image\":\"/media/%s\"", q->image);
+    }
+    length += snprintf(out + length, size - length, "}");
+    return length;
+}
+
 // Get a specific question by ID using BST
 static char* get_question_by_id_json(int id) {
+    TRACE_BEGIN("search_bst");
     Question *q = search_bst(question_bst_root, id);
+    TRACE_END("search_bst");
     if (!q) {
-        return strdup("{\"error\":\"Question not found\"}");
+        return mem_strdup(MEM_RESPONSE, "{\"error\":\"Question not found\"}");
     }
     
-    char *json;
-    asprintf(&json, 
-        "{\"id\":%d,\"text\":\"%s\",\"options\":[\"%s\",\"%s\",\"%s\",\"%s\"],\"correct\":%d,\"explanation\":\"%s\",\"difficulty\":%d}",
-        q->id, q->question, 
-        q->options[0], q->options[1], q->options[2], q->options[3],
-        q->correct_answer,
-        q->explanation,
-        q->difficulty
-    );
+    TRACE_BEGIN("serialize");
+    char *json = mem_alloc(MEM_RESPONSE, QUESTION_JSON_SIZE);
+    if (json) question_json(q, json, QUESTION_JSON_SIZE);
+    TRACE_END("serialize");
     
     return json;
 }
 
+// Build formatted text with questions, one per line
+// Format: id|question|option1|option2|option3|option4|image
+// image is /media/<hash>, or empty when the question has none. The key and explanations are only sent back in the POST /api/submit response.
+static char* render_questions_text(size_t *length) {
+    size_t buffer_size = 1024 * 1024; // 1MB buffer
+    char *buffer = mem_alloc(MEM_RESPONSE, buffer_size);
+    if (!buffer) {
+        return NULL;
+    }
+    
+    int offset = 0;
+    Question *current = question_head;
+    
+    TRACE_BEGIN("serialize");
+    while (current != NULL && offset < buffer_size - 1024) {
+        // Format each question as pipe-delimited text
+        offset += snprintf(buffer + offset, buffer_size - offset,
+            "%d|%s|%s|%s|%s|%s|%s%s\n",
+            current->id, 
+            current->question,
+            current->options[0], 
+            current->options[1], 
+            current->options[2], 
+            current->options[3],
+            current->image[0] ? "/media/" : "",
+            current->image
+        );
+        
+        current = current->next;
+    }
+    
+    // Ensure buffer is null-terminated
+    if (offset >= buffer_size) {
+        offset = buffer_size - 1;
+    }
+    buffer[offset] = '\0';
+    TRACE_END("serialize");
+    
+    if (length) *length = (size_t)offset;
+    return buffer;
+}
+
 // Handle GET /api/questions endpoint
 static enum MHD_Result handle_get_questions(struct MHD_Connection *connection) {
     struct MHD_Response *response;
@@ -710,46 +2225,15 @@ static enum MHD_Result handle_get_questions(struct MHD_Connection *connection) {
         char *json = get_question_by_id_json(id);
         
         response = create_response(json, "application/json");
-        free(json);
+        mem_free(json);
     } else {
-        // Build formatted text with questions, one per line
-        // Format: id|question|option1|option2|option3|option4|correct|explanation
-        size_t buffer_size = 1024 * 1024; // 1MB buffer
-        char *buffer = malloc(buffer_size);
+        char *buffer = render_questions_text(NULL);
         if (!buffer) {
             return MHD_NO;
         }
         
-        int offset = 0;
-        Question *current = question_head;
-        
-        while (current != NULL && offset < buffer_size - 1024) {
-            // Format each question as pipe-delimited text
-            // Note: Adding 1 to correct_answer to convert from 0-based to 1-based
-            offset += snprintf(buffer + offset, buffer_size - offset,
-                "%d|%s|%s|%s|%s|%s|%d|%s\n",
-                current->id, 
-                current->question,
-                current->options[0], 
-                current->options[1], 
-                current->options[2], 
-                current->options[3],
-                current->correct_answer + 1, // Convert to 1-based for frontend
-                current->explanation
-            );
-            
-            current = current->next;
-        }
-        
-        // Ensure buffer is null-terminated
-        if (offset < buffer_size) {
-            buffer[offset] = '\0';
-        } else {
-            buffer[buffer_size - 1] = '\0';
-        }
-        
         response = create_response(buffer, "text/plain; charset=utf-8");
-        free(buffer);
+        mem_free(buffer);
     }
     
     // Add CORS headers
@@ -757,7 +2241,9 @@ static enum MHD_Result handle_get_questions(struct MHD_Connection *connection) {
     MHD_add_response_header(response, "Access-Control-Allow-Methods", "GET, OPTIONS");
     MHD_add_response_header(response, "Access-Control-Allow-Headers", "Content-Type");
     
+    TRACE_BEGIN("MHD_queue_response");
     ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+    TRACE_END("MHD_queue_response");
     MHD_destroy_response(response);
     
     return ret;
@@ -788,12 +2274,12 @@ static enum MHD_Result handle_get_priority_questions(struct MHD_Connection *conn
     
     // Build JSON array of questions by priority
     size_t buffer_size = 1024 * 1024; // 1MB buffer
-    char *json_buffer = malloc(buffer_size);
+    char *json_buffer = mem_alloc(MEM_RESPONSE, buffer_size);
     if (!json_buffer) {
         // Clean up temp queue
         while (temp_queue_head) {
             PQNode *next = temp_queue_head->next;
-            free(temp_queue_head);
+            mem_free(temp_queue_head);
             temp_queue_head = next;
         }
         return MHD_NO;
@@ -816,11 +2302,9 @@ static enum MHD_Result handle_get_priority_questions(struct MHD_Connection *conn
         Question *q = temp_queue_head->question;
         
         offset += snprintf(json_buffer + offset, buffer_size - offset,
-            "{\"id\":%d,\"text\":\"%s\",\"options\":[\"%s\",\"%s\",\"%s\",\"%s\"],\"correct\":%d,\"explanation\":\"%s\",\"difficulty\":%d}",
+            "{\"id\":%d,\"text\":\"%s\",\"options\":[\"%s\",\"%s\",\"%s\",\"%s\"],\"difficulty\":%d}",
             q->id, q->question, 
             q->options[0], q->options[1], q->options[2], q->options[3],
-            q->correct_answer,
-            q->explanation,
             q->difficulty
         );
         
@@ -829,20 +2313,20 @@ static enum MHD_Result handle_get_priority_questions(struct MHD_Connection *conn
         // Move to next node
         PQNode *to_free = temp_queue_head;
         temp_queue_head = temp_queue_head->next;
-        free(to_free);
+        mem_free(to_free);
     }
     
     // Free any remaining nodes
     while (temp_queue_head) {
         PQNode *next = temp_queue_head->next;
-        free(temp_queue_head);
+        mem_free(temp_queue_head);
         temp_queue_head = next;
     }
     
     offset += snprintf(json_buffer + offset, buffer_size - offset, "]");
     
     response = create_response(json_buffer, "application/json");
-    free(json_buffer);
+    mem_free(json_buffer);
     
     // Add CORS headers
     MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
@@ -865,32 +2349,12 @@ static enum MHD_Result handle_login(struct MHD_Connection *connection,
     struct MHD_Response *response;
     enum MHD_Result ret;
     
-    if (*con_cls == NULL) {
-        ConnectionInfo *con_info = calloc(1, sizeof(ConnectionInfo));
-        if (!con_info) return MHD_NO;
-        *con_cls = con_info;
-        return MHD_YES;
-    }
+    int collected = collect_post_data(con_cls, upload_data, upload_data_size, MAX_POST_SIZE);
+    if (collected < 0) return MHD_NO;
+    if (collected > 0) return MHD_YES;
     
     ConnectionInfo *con_info = *con_cls;
     
-    if (*upload_data_size != 0) {
-        if (con_info->post_size + *upload_data_size > MAX_POST_SIZE) {
-            return MHD_NO;
-        }
-        
-        char *new_data = realloc(con_info->post_data, con_info->post_size + *upload_data_size + 1);
-        if (!new_data) return MHD_NO;
-        
-        con_info->post_data = new_data;
-        memcpy(con_info->post_data + con_info->post_size, upload_data, *upload_data_size);
-        con_info->post_size += *upload_data_size;
-        con_info->post_data[con_info->post_size] = '\0';
-        
-        *upload_data_size = 0;
-        return MHD_YES;
-    }
-    
     char username[MAX_USERNAME_LENGTH] = {0};
     char password[MAX_PASSWORD_LENGTH] = {0};
     
@@ -908,10 +2372,23 @@ static enum MHD_Result handle_login(struct MHD_Connection *connection,
     
     if (authenticate(username, password)) {
         printf("Login successful for user: %s\n", username);
-        response = MHD_create_response_from_buffer(strlen(success_response),
-                                                 (void*)success_response,
-                                                 MHD_RESPMEM_PERSISTENT);
-        MHD_add_response_header(response, "Content-Type", "application/json");
+        char token[SESSION_TOKEN_LENGTH + 1];
+        
+        if (session_create(username, token)) {
+            char json[160];
+            char cookie[96];
+            snprintf(json, sizeof(json),
+                     "{\"success\":true,\"message\":\"Login successful\",\"token\":\"%s\"}", token);
+            snprintf(cookie, sizeof(cookie), "session=%s; Path=/; HttpOnly; SameSite=Strict%s",
+                     token, tls_config.enabled ? "; Secure" : "");
+            response = create_response(json, "application/json");
+            MHD_add_response_header(response, "Set-Cookie", cookie);
+        } else {
+            response = MHD_create_response_from_buffer(strlen(success_response),
+                                                     (void*)success_response,
+                                                     MHD_RESPMEM_PERSISTENT);
+            MHD_add_response_header(response, "Content-Type", "application/json");
+        }
         MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
         ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
     } else {
@@ -929,130 +2406,5939 @@ static enum MHD_Result handle_login(struct MHD_Connection *connection,
     return ret;
 }
 
-// Main request handler
-static enum MHD_Result handle_request(void *cls,
-                                    struct MHD_Connection *connection,
-                                    const char *url,
-                                    const char *method,
-                                    const char *version,
-                                    const char *upload_data,
-                                    size_t *upload_data_size,
-                                    void **con_cls) {
+// Handle GET /api/questions/{id} using the BST
+static enum MHD_Result handle_get_question_by_id(struct MHD_Connection *connection, int id) {
+    struct MHD_Response *response;
+    enum MHD_Result ret;
+    unsigned int status = MHD_HTTP_OK;
     
-    printf("Received %s request for %s\n", method, url);
+    TRACE_BEGIN("search_bst");
+    if (!search_bst(question_bst_root, id)) {
+        status = MHD_HTTP_NOT_FOUND;
+    }
+    TRACE_END("search_bst");
     
-    // Handle CORS preflight request
-    if (0 == strcmp(method, "OPTIONS")) {
-        struct MHD_Response *response = MHD_create_response_from_buffer(0, "", MHD_RESPMEM_PERSISTENT);
-        
-        MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
-        MHD_add_response_header(response, "Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-        MHD_add_response_header(response, "Access-Control-Allow-Headers", "Content-Type");
-        MHD_add_response_header(response, "Access-Control-Max-Age", "86400");
-        
-        enum MHD_Result ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
-        MHD_destroy_response(response);
-        return ret;
+    char *json = get_question_by_id_json(id);
+    if (!json) return MHD_NO;
+    response = create_response(json, "application/json");
+    mem_free(json);
+    
+    MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
+    TRACE_BEGIN("MHD_queue_response");
+    ret = MHD_queue_response(connection, status, response);
+    TRACE_END("MHD_queue_response");
+    MHD_destroy_response(response);
+    return ret;
+}
+
+// ===== Media blob pack =====
+
+static void media_hash_hex(const unsigned char *hash, char *out) {
+    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
+        sprintf(out + i * 2, "%02x", hash[i]);
+    }
+}
+
+// Parse exactly MEDIA_HASH_HEX lowercase hex digits
+static int media_parse_hash(const char *hex, unsigned char *hash) {
+    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
+        unsigned int byte;
+        if (!isxdigit((unsigned char)hex[i * 2]) || !isxdigit((unsigned char)hex[i * 2 + 1]) ||
+            sscanf(hex + i * 2, "%2x", &byte) != 1) {
+            return 0;
+        }
+        hash[i] = (unsigned char)byte;
+    }
+    return 1;
+}
+
+static int compare_media_source(const void *a, const void *b) {
+    const MediaSource *sa = a;
+    const MediaSource *sb = b;
+    int diff = memcmp(sa->entry.hash, sb->entry.hash, SHA256_DIGEST_LENGTH);
+    return diff ? diff : strcmp(sa->name, sb->name);
+}
+
+// The pack is stale if it is missing or older than the directory or any file in it
+static int media_pack_stale(const char *dir, const char *path) {
+    struct stat pack_st, st;
+    if (stat(path, &pack_st) != 0) return 1;
+    if (stat(dir, &st) == 0 && st.st_mtime > pack_st.st_mtime) return 1;
+    
+    DIR *handle = opendir(dir);
+    if (!handle) return 0;
+    int stale = 0;
+    struct dirent *entry;
+    while (!stale && (entry = readdir(handle)) != NULL) {
+        char file[PATH_MAX];
+        snprintf(file, sizeof(file), "%s/%s", dir, entry->d_name);
+        if (entry->d_name[0] != '.' && stat(file, &st) == 0 && st.st_mtime > pack_st.st_mtime) stale = 1;
+    }
+    closedir(handle);
+    return stale;
+}
+
+// Hash every file in dir and write them into one pack: header, index sorted by
+// hash, then the blobs. Identical files are stored once. Written to a temporary
+// file and renamed, so a running server keeps its mapping of the old pack.
+// Returns the number of blobs, or -1.
+static int media_pack_build(const char *dir, const char *path, int verbose) {
+    DIR *handle = opendir(dir);
+    if (!handle) {
+        printf("Cannot open %s: %s\n", dir, strerror(errno));
+        return -1;
     }
     
-    if (0 == strcmp(method, "GET")) {
-        // Handle GET requests
+    MediaSource *sources = NULL;
+    int count = 0, capacity = 0;
+    unsigned char *data = mem_alloc(MEM_MEDIA, MEDIA_MAX_FILE_SIZE);
+    int ok = data != NULL;
+    
+    struct dirent *entry;
+    while (ok && (entry = readdir(handle)) != NULL) {
+        if (entry->d_name[0] == '.' || strlen(entry->d_name) >= sizeof(sources->name)) continue;
         
-        // API endpoints
-        if (0 == strcmp(url, "/api/questions")) {
-            return handle_get_questions(connection);
-        } 
-        else if (0 == strcmp(url, "/api/priority-questions")) {
-            return handle_get_priority_questions(connection);
+        char file[PATH_MAX];
+        struct stat st;
+        snprintf(file, sizeof(file), "%s/%s", dir, entry->d_name);
+        if (stat(file, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        if (st.st_size > MEDIA_MAX_FILE_SIZE) {
+            printf("Skipping %s: larger than %d bytes\n", file, MEDIA_MAX_FILE_SIZE);
+            continue;
         }
         
-        // Static file server
-        return serve_file(connection, url);
+        FILE *in = fopen(file, "rb");
+        if (!in) continue;
+        size_t size = fread(data, 1, MEDIA_MAX_FILE_SIZE, in);
+        fclose(in);
+        
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            MediaSource *grown = mem_realloc(MEM_MEDIA, sources, capacity * sizeof(MediaSource));
+            if (!grown) {
+                ok = 0;
+                break;
+            }
+            sources = grown;
+        }
+        MediaSource *source = &sources[count++];
+        memset(source, 0, sizeof(MediaSource));
+        strcpy(source->path, file);
+        strcpy(source->name, entry->d_name);
+        SHA256(data, size, source->entry.hash);
+        source->entry.size = size;
+        strncpy(source->entry.content_type, get_content_type(entry->d_name), sizeof(source->entry.content_type) - 1);
     }
+    closedir(handle);
+    
+    if (ok) qsort(sources, count, sizeof(MediaSource), compare_media_source);
     
-    if (0 == strcmp(method, "POST")) {
-        // Handle POST requests
-        if (0 == strcmp(url, "/api/login")) {
-            return handle_login(connection, upload_data, upload_data_size, con_cls);
+    int unique = 0;
+    for (int i = 0; ok && i < count; i++) {
+        char hex[MEDIA_HASH_HEX + 1];
+        media_hash_hex(sources[i].entry.hash, hex);
+        if (verbose) printf("%s  %s\n", hex, sources[i].name);
+        if (unique > 0 && memcmp(sources[unique - 1].entry.hash, sources[i].entry.hash, SHA256_DIGEST_LENGTH) == 0) {
+            continue;
         }
+        sources[unique++] = sources[i];
     }
     
-    // Method not allowed or resource not found
-    const char* error_msg = "Not Found";
-    struct MHD_Response *response = create_response(error_msg, "text/plain");
+    // Blobs start after the index, each aligned
+    MediaPackHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MEDIA_PACK_MAGIC, sizeof(header.magic));
+    header.count = (uint32_t)unique;
+    header.data_offset = (sizeof(header) + unique * sizeof(MediaPackEntry) + MEDIA_PACK_ALIGN - 1) &
+                         ~(uint64_t)(MEDIA_PACK_ALIGN - 1);
+    uint64_t offset = header.data_offset;
+    for (int i = 0; i < unique; i++) {
+        sources[i].entry.offset = offset;
+        offset = (offset + sources[i].entry.size + MEDIA_PACK_ALIGN - 1) & ~(uint64_t)(MEDIA_PACK_ALIGN - 1);
+    }
     
-    MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, (int)getpid());
+    FILE *out = ok ? fopen(tmp_path, "wb") : NULL;
+    if (out) {
+        ok = fwrite(&header, sizeof(header), 1, out) == 1;
+        for (int i = 0; ok && i < unique; i++) {
+            ok = fwrite(&sources[i].entry, sizeof(MediaPackEntry), 1, out) == 1;
+        }
+        for (int i = 0; ok && i < unique; i++) {
+            // Contents are re-read and re-hashed so a file changed since the first pass is caught
+            FILE *in = fopen(sources[i].path, "rb");
+            size_t size = in ? fread(data, 1, MEDIA_MAX_FILE_SIZE, in) : 0;
+            if (in) fclose(in);
+            unsigned char hash[SHA256_DIGEST_LENGTH];
+            SHA256(data, size, hash);
+            if (size != sources[i].entry.size || memcmp(hash, sources[i].entry.hash, sizeof(hash)) != 0) {
+                printf("%s changed while packing\n", sources[i].path);
+                ok = 0;
+                break;
+            }
+            ok = fseek(out, (long)sources[i].entry.offset, SEEK_SET) == 0 && fwrite(data, 1, size, out) == size;
+        }
+        if (fclose(out) != 0) ok = 0;
+        if (ok && rename(tmp_path, path) != 0) ok = 0;
+        if (!ok) unlink(tmp_path);
+    } else {
+        ok = 0;
+    }
     
-    enum MHD_Result ret = MHD_queue_response(connection, MHD_HTTP_NOT_FOUND, response);
-    MHD_destroy_response(response);
+    mem_free(data);
+    mem_free(sources);
+    if (!ok) {
+        printf("Failed to write %s\n", path);
+        return -1;
+    }
+    printf("Packed %d images (%d unique) into %s\n", count, unique, path);
+    return unique;
+}
+
+// Map the pack read-only; before fork, so workers share its pages
+static int media_pack_open(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
     
-    return ret;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(MediaPackHeader)) {
+        close(fd);
+        return 0;
+    }
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return 0;
+    
+    const MediaPackHeader *header = base;
+    size_t size = (size_t)st.st_size;
+    int valid = memcmp(header->magic, MEDIA_PACK_MAGIC, sizeof(header->magic)) == 0 &&
+                sizeof(MediaPackHeader) + (size_t)header->count * sizeof(MediaPackEntry) <= size;
+    const MediaPackEntry *entries = (const MediaPackEntry*)(header + 1);
+    for (uint32_t i = 0; valid && i < header->count; i++) {
+        valid = entries[i].offset <= size && entries[i].size <= size - entries[i].offset;
+    }
+    if (!valid) {
+        printf("%s is corrupt; ignoring it\n", path);
+        munmap(base, size);
+        return 0;
+    }
+    
+    media_pack.base = base;
+    media_pack.size = size;
+    media_pack.entries = entries;
+    media_pack.count = header->count;
+    return 1;
 }
 
-// Main function
-int main(void) {
-    printf("\n=== Online Exam Platform Backend Server ===\n");
-    printf("Starting server on port %d...\n", PORT);
+static const MediaPackEntry* media_pack_find(const unsigned char *hash) {
+    int lo = 0, hi = (int)media_pack.count - 1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        int diff = memcmp(media_pack.entries[mid].hash, hash, SHA256_DIGEST_LENGTH);
+        if (diff == 0) return &media_pack.entries[mid];
+        if (diff < 0) lo = mid + 1; else hi = mid - 1;
+    }
+    return NULL;
+}
+
+// Rebuild the pack if MEDIA_DIR changed, map it, and check the images questions refer to
+static void media_pack_load(void) {
+    struct stat st;
+    if (stat(MEDIA_DIR, &st) == 0 && S_ISDIR(st.st_mode) && media_pack_stale(MEDIA_DIR, MEDIA_PACK_PATH)) {
+        media_pack_build(MEDIA_DIR, MEDIA_PACK_PATH, 0);
+    }
+    if (media_pack_open(MEDIA_PACK_PATH)) {
+        printf("Media pack: %u images, %zu KB\n", media_pack.count, media_pack.size / 1024);
+    }
     
-    // Initialize our data structures
-    load_auth_data();
-    load_questions();
+    for (Question *q = question_head; q; q = q->next) {
+        unsigned char hash[SHA256_DIGEST_LENGTH];
+        if (q->image[0] && (!media_parse_hash(q->image, hash) || !media_pack_find(hash))) {
+            printf("Warning: image %s of question %d is not in %s\n", q->image, q->id, MEDIA_PACK_PATH);
+        }
+    }
+}
+
+static void media_pack_free(void) {
+    if (media_pack.base) munmap((void*)media_pack.base, media_pack.size);
+    memset(&media_pack, 0, sizeof(media_pack));
+}
+
+// Handle GET /media/{hash}[.ext]: immutable, so cached forever and revalidated by ETag
+static enum MHD_Result handle_media(struct MHD_Connection *connection, const char *name) {
+    struct MHD_Response *response;
+    enum MHD_Result ret;
+    unsigned char hash[SHA256_DIGEST_LENGTH];
     
-    // Example of BST search
-    int test_id = 1;
-    Question *found = search_bst(question_bst_root, test_id);
-    if (found) {
-        printf("\nBST Search Test - Found question %d: %s\n", test_id, found->question);
+    size_t len = strcspn(name, ".");
+    const MediaPackEntry *entry = NULL;
+    if (len == MEDIA_HASH_HEX && media_parse_hash(name, hash)) {
+        entry = media_pack_find(hash);
+    }
+    if (!entry) {
+        response = create_response("Not Found", "text/plain");
+        MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
+        ret = MHD_queue_response(connection, MHD_HTTP_NOT_FOUND, response);
+        MHD_destroy_response(response);
+        return ret;
+    }
+    
+    char hex[MEDIA_HASH_HEX + 1];
+    char etag[MEDIA_HASH_HEX + 3];
+    media_hash_hex(entry->hash, hex);
+    snprintf(etag, sizeof(etag), "\"%s\"", hex);
+    const char *if_none_match = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "If-None-Match");
+    unsigned int status = MHD_HTTP_OK;
+    
+    if (if_none_match && strstr(if_none_match, etag)) {
+        response = MHD_create_response_from_buffer(0, "", MHD_RESPMEM_PERSISTENT);
+        status = MHD_HTTP_NOT_MODIFIED;
     } else {
-        printf("\nBST Search Test - Question %d not found\n", test_id);
+        // Straight from the mapping: nothing is copied in user space
+        response = MHD_create_response_from_buffer(entry->size, (void*)(media_pack.base + entry->offset),
+                                                   MHD_RESPMEM_PERSISTENT);
+        MHD_add_response_header(response, "Content-Type", entry->content_type);
     }
+    if (!response) return MHD_NO;
     
-    // Example of priority queue
-    printf("\nPriority Queue Test - Getting highest difficulty questions:\n");
-    for (int i = 0; i < 3; i++) {
-        Question *q = get_next_priority_question();
-        if (q) {
-            printf("- Q%d (Difficulty %d): %s\n", q->id, q->difficulty, q->question);
+    MHD_add_response_header(response, "Cache-Control", "public, max-age=31536000, immutable");
+    MHD_add_response_header(response, "ETag", etag);
+    MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
+    ret = MHD_queue_response(connection, status, response);
+    MHD_destroy_response(response);
+    return ret;
+}
+
+// ===== Proctoring event ingestion =====
+
+static const char *proctor_event_names[PROCTOR_EVENT_TYPES] = {
+    "tab_switch", "focus_loss", "copy", "paste"
+};
+
+static int64_t proctor_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int proctor_event_type(const char *name, size_t len) {
+    for (int i = 0; i < PROCTOR_EVENT_TYPES; i++) {
+        if (strlen(proctor_event_names[i]) == len && strncmp(proctor_event_names[i], name, len) == 0) {
+            return i;
         }
     }
+    return -1;
+}
+
+static int proctor_queue_init(ProctorQueue *queue, size_t size) {
+    queue->slots = mem_calloc(MEM_PROCTOR, size, sizeof(ProctorSlot));
+    if (!queue->slots) return 0;
     
-    struct MHD_Daemon *daemon = MHD_start_daemon(
-        MHD_USE_POLL_INTERNALLY | MHD_USE_DEBUG | MHD_USE_ERROR_LOG,
-        PORT, NULL, NULL, 
-        &handle_request, NULL,
-        MHD_OPTION_CONNECTION_TIMEOUT, (unsigned int) 120,
-        MHD_OPTION_END
-    );
+    queue->mask = size - 1;
+    for (size_t i = 0; i < size; i++) {
+        atomic_store_explicit(&queue->slots[i].sequence, i, memory_order_relaxed);
+    }
+    atomic_store(&queue->enqueue_pos, 0);
+    queue->dequeue_pos = 0;
+    return 1;
+}
+
+// Lock-free push from any request thread; returns 0 instead of waiting when the ring is full
+static int proctor_queue_push(ProctorQueue *queue, const ProctorEvent *event) {
+    size_t pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+    ProctorSlot *slot;
     
-    if (NULL == daemon) {
-        printf("Failed to start server\n");
-        return 1;
+    for (;;) {
+        slot = &queue->slots[pos & queue->mask];
+        size_t seq = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return 0; // Full
+        } else {
+            pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+        }
     }
     
+    slot->event = *event;
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+    return 1;
+}
+
+// Pop for the single consumer (the writer thread)
+static int proctor_queue_pop(ProctorQueue *queue, ProctorEvent *event) {
+    ProctorSlot *slot = &queue->slots[queue->dequeue_pos & queue->mask];
+    size_t seq = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    
+    if (seq != queue->dequeue_pos + 1) return 0; // Empty, or producer still writing
+    
+    *event = slot->event;
+    atomic_store_explicit(&slot->sequence, queue->dequeue_pos + queue->mask + 1, memory_order_release);
+    queue->dequeue_pos++;
+    return 1;
+}
+
+static unsigned int proctor_summary_index(const char *candidate) {
+    unsigned int hash = 5381;
+    int c;
+    while ((c = *candidate++)) {
+        hash = ((hash << 5) + hash) + c;
+    }
+    return hash % PROCTOR_SUMMARY_TABLE_SIZE;
+}
+
+// Caller holds summary_lock
+static ProctorSummary* proctor_find_summary(ProctorStore *store, const char *candidate) {
+    ProctorSummary *current = store->summaries[proctor_summary_index(candidate)];
+    while (current) {
+        if (strcmp(current->candidate, candidate) == 0) return current;
+        current = current->next;
+    }
+    return NULL;
+}
+
+static void proctor_update_summaries(ProctorStore *store, const ProctorEvent *events, int count) {
+    pthread_rwlock_wrlock(&store->summary_lock);
+    
+    for (int i = 0; i < count; i++) {
+        const ProctorEvent *event = &events[i];
+        ProctorSummary *summary = proctor_find_summary(store, event->candidate);
+        
+        if (!summary) {
+            if (store->summary_count >= PROCTOR_MAX_SUMMARIES) continue;
+            summary = mem_calloc(MEM_PROCTOR, 1, sizeof(ProctorSummary));
+            if (!summary) continue;
+            memcpy(summary->candidate, event->candidate, MAX_USERNAME_LENGTH);
+            store->summary_count++;
+            summary->first_ms = event->timestamp_ms;
+            summary->last_ms = event->timestamp_ms;
+            
+            unsigned int index = proctor_summary_index(event->candidate);
+            summary->next = store->summaries[index];
+            store->summaries[index] = summary;
+        }
+        
+        summary->counts[event->type]++;
+        if (event->timestamp_ms < summary->first_ms) summary->first_ms = event->timestamp_ms;
+        if (event->timestamp_ms > summary->last_ms) summary->last_ms = event->timestamp_ms;
+    }
+    
+    pthread_rwlock_unlock(&store->summary_lock);
+}
+
+// Growable byte buffer used to build column data
+typedef struct {
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+} ByteBuffer;
+
+static int byte_buffer_reserve(ByteBuffer *buf, size_t extra) {
+    if (buf->len + extra <= buf->cap) return 1;
+    
+    size_t cap = buf->cap ? buf->cap : 1024;
+    while (cap < buf->len + extra) cap *= 2;
+    
+    unsigned char *data = mem_realloc(MEM_PROCTOR, buf->data, cap);
+    if (!data) return 0;
+    buf->data = data;
+    buf->cap = cap;
+    return 1;
+}
+
+static int byte_buffer_append(ByteBuffer *buf, const void *bytes, size_t len) {
+    if (!byte_buffer_reserve(buf, len)) return 0;
+    memcpy(buf->data + buf->len, bytes, len);
+    buf->len += len;
+    return 1;
+}
+
+static int byte_buffer_varint(ByteBuffer *buf, uint64_t value) {
+    if (!byte_buffer_reserve(buf, 10)) return 0;
+    while (value >= 0x80) {
+        buf->data[buf->len++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    buf->data[buf->len++] = (unsigned char)value;
+    return 1;
+}
+
+static int byte_buffer_u32(ByteBuffer *buf, uint32_t value) {
+    unsigned char bytes[4] = {
+        value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF, (value >> 24) & 0xFF
+    };
+    return byte_buffer_append(buf, bytes, sizeof(bytes));
+}
+
+// Write the buffered rows as one compressed columnar block.
+// Block layout: "PEV1", rows, column count, (raw size, compressed size) per column, column data.
+// Columns: zigzag delta-varint timestamps, candidate dictionary, varint dictionary ids, event types.
+static int proctor_flush_block(ProctorStore *store) {
+    ProctorBlock *block = &store->block;
+    if (block->rows == 0) return 1;
+    
+    enum { COL_TIMESTAMP, COL_DICTIONARY, COL_CANDIDATE, COL_TYPE, COL_COUNT };
+    ByteBuffer columns[COL_COUNT] = {{0}};
+    ByteBuffer out = {0};
+    int ok = 1;
+    
+    // Dictionary-encode candidate names (open addressing on row indexes)
+    int dict_size = 2;
+    while (dict_size < block->rows * 2) dict_size <<= 1;
+    int *dict_rows = mem_alloc(MEM_PROCTOR, dict_size * sizeof(int));
+    int *dict_ids = mem_alloc(MEM_PROCTOR, dict_size * sizeof(int));
+    if (!dict_rows || !dict_ids) ok = 0;
+    if (ok) memset(dict_rows, -1, dict_size * sizeof(int));
+    
+    int dict_count = 0;
+    int64_t previous = 0;
+    for (int i = 0; ok && i < block->rows; i++) {
+        int64_t delta = block->timestamps[i] - previous;
+        previous = block->timestamps[i];
+        ok &= byte_buffer_varint(&columns[COL_TIMESTAMP], ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+        
+        const char *name = block->candidates[i];
+        unsigned int slot = proctor_summary_index(name) & (dict_size - 1);
+        while (dict_rows[slot] >= 0 && strcmp(block->candidates[dict_rows[slot]], name) != 0) {
+            slot = (slot + 1) & (dict_size - 1);
+        }
+        if (dict_rows[slot] < 0) {
+            size_t len = strlen(name);
+            dict_rows[slot] = i;
+            dict_ids[slot] = dict_count++;
+            ok &= byte_buffer_varint(&columns[COL_DICTIONARY], len);
+            ok &= byte_buffer_append(&columns[COL_DICTIONARY], name, len);
+        }
+        ok &= byte_buffer_varint(&columns[COL_CANDIDATE], dict_ids[slot]);
+    }
+    if (ok) ok = byte_buffer_append(&columns[COL_TYPE], block->types, block->rows);
+    
+    // Compress each column separately so a reader can skip the ones it doesn't need
+    ByteBuffer compressed[COL_COUNT] = {{0}};
+    for (int c = 0; ok && c < COL_COUNT; c++) {
+        uLongf comp_len = compressBound(columns[c].len);
+        if (!byte_buffer_reserve(&compressed[c], comp_len) ||
+            compress2(compressed[c].data, &comp_len, columns[c].data, columns[c].len, Z_BEST_SPEED) != Z_OK) {
+            ok = 0;
+            break;
+        }
+        compressed[c].len = comp_len;
+    }
+    
+    if (ok) {
+        ok = byte_buffer_append(&out, "PEV1", 4) &&
+             byte_buffer_u32(&out, block->rows) &&
+             byte_buffer_u32(&out, COL_COUNT);
+        for (int c = 0; ok && c < COL_COUNT; c++) {
+            ok = byte_buffer_u32(&out, columns[c].len) && byte_buffer_u32(&out, compressed[c].len);
+        }
+        for (int c = 0; ok && c < COL_COUNT; c++) {
+            ok = byte_buffer_append(&out, compressed[c].data, compressed[c].len);
+        }
+    }
+    
+    if (ok) {
+        // One file per hour of event time
+        char path[256];
+        struct tm tm_utc;
+        time_t partition_start = (time_t)block->partition * 3600;
+        gmtime_r(&partition_start, &tm_utc);
+        // Each worker process writes its own files so appends never interleave
+        char worker_suffix[16] = "";
+        if (worker_index >= 0) snprintf(worker_suffix, sizeof(worker_suffix), "-w%d", worker_index);
+        snprintf(path, sizeof(path), "%s/events-%04d%02d%02d-%02d%s.pcol", PROCTOR_DATA_DIR,
+                 tm_utc.tm_year + 1900, tm_utc.tm_mon + 1, tm_utc.tm_mday, tm_utc.tm_hour, worker_suffix);
+        
+        // A single O_APPEND write keeps blocks whole even while an old and a new
+        // server process overlap during a restart
+        int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0 || write(fd, out.data, out.len) != (ssize_t)out.len) {
+            printf("Failed to write proctor block to %s: %s\n", path, strerror(errno));
+            ok = 0;
+        }
+        if (fd >= 0) close(fd);
+    }
+    
+    if (ok) {
+        atomic_fetch_add(&store->written, block->rows);
+        atomic_fetch_add(&store->blocks, 1);
+    }
+    
+    for (int c = 0; c < COL_COUNT; c++) {
+        mem_free(columns[c].data);
+        mem_free(compressed[c].data);
+    }
+    mem_free(out.data);
+    mem_free(dict_rows);
+    mem_free(dict_ids);
+    
+    block->rows = 0;
+    return ok;
+}
+
+static void proctor_append_event(ProctorStore *store, const ProctorEvent *event) {
+    ProctorBlock *block = &store->block;
+    long partition = (long)(event->timestamp_ms / 3600000);
+    
+    if (block->rows > 0 && partition != block->partition) {
+        proctor_flush_block(store);
+    }
+    
+    block->partition = partition;
+    block->timestamps[block->rows] = event->timestamp_ms;
+    block->types[block->rows] = event->type;
+    memcpy(block->candidates[block->rows], event->candidate, MAX_USERNAME_LENGTH);
+    block->rows++;
+    
+    if (block->rows == PROCTOR_BLOCK_ROWS) {
+        proctor_flush_block(store);
+    }
+}
+
+// Single consumer: drains the queue into summaries and columnar blocks
+static void* proctor_writer_thread(void *arg) {
+    ProctorStore *store = arg;
+    ProctorEvent batch[256];
+    int64_t last_flush = proctor_now_ms();
+    
+    for (;;) {
+        int running = atomic_load(&store->running);
+        int count = 0;
+        
+        while (count < 256 && proctor_queue_pop(&store->queue, &batch[count])) {
+            count++;
+        }
+        
+        if (count > 0) {
+            proctor_update_summaries(store, batch, count);
+            for (int i = 0; i < count; i++) {
+                proctor_append_event(store, &batch[i]);
+            }
+        }
+        
+        int64_t now = proctor_now_ms();
+        if (store->block.rows == 0 || now - last_flush >= PROCTOR_FLUSH_MS) {
+            proctor_flush_block(store);
+            last_flush = now;
+        }
+        
+        if (count == 0) {
+            if (!running) break;
+            struct timespec pause = {0, 2 * 1000000}; // 2ms
+            nanosleep(&pause, NULL);
+        }
+    }
+    
+    proctor_flush_block(store);
+    return NULL;
+}
+
+static int proctor_start(ProctorStore *store) {
+    memset(store, 0, sizeof(ProctorStore));
+    
+    if (mkdir(PROCTOR_DATA_DIR, 0755) != 0 && errno != EEXIST) {
+        printf("Could not create %s: %s\n", PROCTOR_DATA_DIR, strerror(errno));
+        return 0;
+    }
+    if (!proctor_queue_init(&store->queue, PROCTOR_QUEUE_SIZE)) return 0;
+    pthread_rwlock_init(&store->summary_lock, NULL);
+    
+    atomic_store(&store->running, 1);
+    if (pthread_create(&store->writer, NULL, proctor_writer_thread, store) != 0) {
+        printf("Failed to start proctor writer thread\n");
+        pthread_rwlock_destroy(&store->summary_lock);
+        mem_free(store->queue.slots);
+        return 0;
+    }
+    
+    printf("Proctor event writer started (queue of %d events)\n", PROCTOR_QUEUE_SIZE);
+    return 1;
+}
+
+// Stop the writer after it has drained and flushed everything queued
+static void proctor_stop(ProctorStore *store) {
+    if (!store->queue.slots) return;
+    
+    atomic_store(&store->running, 0);
+    pthread_join(store->writer, NULL);
+    
+    for (int i = 0; i < PROCTOR_SUMMARY_TABLE_SIZE; i++) {
+        ProctorSummary *current = store->summaries[i];
+        while (current) {
+            ProctorSummary *temp = current;
+            current = current->next;
+            mem_free(temp);
+        }
+    }
+    pthread_rwlock_destroy(&store->summary_lock);
+    mem_free(store->queue.slots);
+    store->queue.slots = NULL;
+    
+    printf("Proctor events: %llu accepted, %llu dropped, %llu written in %llu blocks\n",
+           (unsigned long long)atomic_load(&store->accepted),
+           (unsigned long long)atomic_load(&store->dropped),
+           (unsigned long long)atomic_load(&store->written),
+           (unsigned long long)atomic_load(&store->blocks));
+}
+
+// Parse a batch for one candidate (one "type[|timestamp_ms]" per line) and enqueue it
+// without blocking. Client timestamps are clamped to the last PROCTOR_MAX_AGE_MS of the
+// server clock, since they pick the hourly partition a row is written to.
+static void proctor_ingest_batch(ProctorStore *store, const char *candidate, const char *data, size_t size,
+                                 int *accepted, int *dropped, int *rejected) {
+    const char *p = data;
+    const char *end = data + size;
+    int64_t now = proctor_now_ms();
+    
+    *accepted = *dropped = *rejected = 0;
+    
+    while (p < end) {
+        const char *line_end = memchr(p, '\n', end - p);
+        if (!line_end) line_end = end;
+        const char *line = p;
+        size_t len = line_end - line;
+        p = line_end + 1;
+        
+        if (len > 0 && line[len - 1] == '\r') len--;
+        if (len == 0) continue;
+        
+        const char *sep = memchr(line, '|', len);
+        int type = proctor_event_type(line, (sep ? sep : line + len) - line);
+        if (type < 0) {
+            (*rejected)++;
+            continue;
+        }
+        
+        ProctorEvent event;
+        memset(event.candidate, 0, sizeof(event.candidate));
+        snprintf(event.candidate, sizeof(event.candidate), "%s", candidate);
+        event.type = (uint8_t)type;
+        event.timestamp_ms = now;
+        
+        if (sep) {
+            char ts[24] = {0};
+            size_t ts_len = line + len - (sep + 1);
+            if (ts_len > 0 && ts_len < sizeof(ts)) {
+                memcpy(ts, sep + 1, ts_len);
+                long long value = atoll(ts);
+                if (value > 0) {
+                    if (value > now) value = now;
+                    if (value < now - PROCTOR_MAX_AGE_MS) value = now - PROCTOR_MAX_AGE_MS;
+                    event.timestamp_ms = value;
+                }
+            }
+        }
+        
+        if (proctor_queue_push(&store->queue, &event)) {
+            (*accepted)++;
+        } else {
+            (*dropped)++;
+        }
+    }
+    
+    atomic_fetch_add(&store->accepted, *accepted);
+    atomic_fetch_add(&store->dropped, *dropped);
+}
+
+// Handle POST /api/proctor/events from a logged-in candidate
+static enum MHD_Result handle_proctor_events(struct MHD_Connection *connection,
+                                             const char *upload_data,
+                                             size_t *upload_data_size,
+                                             void **con_cls) {
+    struct MHD_Response *response;
+    enum MHD_Result ret;
+    
+    int collected = collect_post_data(con_cls, upload_data, upload_data_size, MAX_EVENT_BATCH_SIZE);
+    if (collected < 0) return MHD_NO;
+    if (collected > 0) return MHD_YES;
+    
+    ConnectionInfo *con_info = *con_cls;
+    char username[MAX_USERNAME_LENGTH];
+    
+    if (!request_session_user(connection, username)) {
+        ret = send_json(connection, MHD_HTTP_UNAUTHORIZED, "{\"error\":\"Not logged in\"}");
+        cleanup_connection_info(con_cls);
+        return ret;
+    }
+    
+    int accepted = 0, dropped = 0, rejected = 0;
+    if (con_info->post_data) {
+        proctor_ingest_batch(&proctor_store, username, con_info->post_data, con_info->post_size,
+                             &accepted, &dropped, &rejected);
+    }
+    
+    char json[128];
+    snprintf(json, sizeof(json), "{\"accepted\":%d,\"dropped\":%d,\"rejected\":%d}",
+             accepted, dropped, rejected);
+    response = create_response(json, "application/json");
+    MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
+    
+    // 503 tells the client to back off and resend when the queue was full
+    ret = MHD_queue_response(connection, dropped ? MHD_HTTP_SERVICE_UNAVAILABLE : MHD_HTTP_ACCEPTED, response);
+    MHD_destroy_response(response);
+    cleanup_connection_info(con_cls);
+    return ret;
+}
+
+static int proctor_summary_json(const ProctorSummary *summary, char *buf, size_t size) {
+    uint64_t total = 0;
+    for (int i = 0; i < PROCTOR_EVENT_TYPES; i++) total += summary->counts[i];
+    
+    size_t offset = snprintf(buf, size, "{\"candidate\":\"");
+    offset = json_append_escaped(buf, size, offset, summary->candidate);
+    int written = snprintf(buf + offset, size - offset,
+        "\",\"tab_switch\":%llu,\"focus_loss\":%llu,\"copy\":%llu,\"paste\":%llu,"
+        "\"total\":%llu,\"first_ms\":%lld,\"last_ms\":%lld}",
+        (unsigned long long)summary->counts[PROCTOR_TAB_SWITCH],
+        (unsigned long long)summary->counts[PROCTOR_FOCUS_LOSS],
+        (unsigned long long)summary->counts[PROCTOR_COPY],
+        (unsigned long long)summary->counts[PROCTOR_PASTE],
+        (unsigned long long)total,
+        (long long)summary->first_ms, (long long)summary->last_ms);
+    return (int)offset + written;
+}
+
+// Handle GET /api/proctor/summary[?candidate=name] (admins only)
+static enum MHD_Result handle_proctor_summary(struct MHD_Connection *connection) {
+    struct MHD_Response *response;
+    enum MHD_Result ret;
+    ProctorStore *store = &proctor_store;
+    const char *candidate = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "candidate");
+    char *json = NULL;
+    unsigned int status = MHD_HTTP_OK;
+    
+    pthread_rwlock_rdlock(&store->summary_lock);
+    
+    if (candidate) {
+        ProctorSummary *summary = proctor_find_summary(store, candidate);
+        if (summary) {
+            json = mem_alloc(MEM_RESPONSE, PROCTOR_SUMMARY_JSON_SIZE);
+            if (json) proctor_summary_json(summary, json, PROCTOR_SUMMARY_JSON_SIZE);
+        } else {
+            json = mem_strdup(MEM_RESPONSE, "{\"error\":\"No events for candidate\"}");
+            status = MHD_HTTP_NOT_FOUND;
+        }
+    } else {
+        size_t count = 0;
+        for (int i = 0; i < PROCTOR_SUMMARY_TABLE_SIZE; i++) {
+            for (ProctorSummary *s = store->summaries[i]; s; s = s->next) count++;
+        }
+        
+        size_t buffer_size = (count + 1) * PROCTOR_SUMMARY_JSON_SIZE;
+        json = mem_alloc(MEM_RESPONSE, buffer_size);
+        if (json) {
+            size_t offset = snprintf(json, buffer_size,
+                "{\"accepted\":%llu,\"dropped\":%llu,\"written\":%llu,\"blocks\":%llu,\"candidates\":[",
+                (unsigned long long)atomic_load(&store->accepted),
+                (unsigned long long)atomic_load(&store->dropped),
+                (unsigned long long)atomic_load(&store->written),
+                (unsigned long long)atomic_load(&store->blocks));
+            int first = 1;
+            for (int i = 0; i < PROCTOR_SUMMARY_TABLE_SIZE; i++) {
+                for (ProctorSummary *s = store->summaries[i]; s; s = s->next) {
+                    if (!first) json[offset++] = ',';
+                    first = 0;
+                    offset += proctor_summary_json(s, json + offset, buffer_size - offset);
+                }
+            }
+            snprintf(json + offset, buffer_size - offset, "]}");
+        }
+    }
+    
+    pthread_rwlock_unlock(&store->summary_lock);
+    
+    if (!json) return MHD_NO;
+    response = create_response(json, "application/json");
+    mem_free(json);
+    MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
+    ret = MHD_queue_response(connection, status, response);
+    MHD_destroy_response(response);
+    return ret;
+}
+
+// ===== Computerized adaptive testing =====
+
+// Rasch item difficulty for a question's 1-10 difficulty level
+static double cat_level_difficulty(int level) {
+    return -2.25 + 0.5 * level; // Levels 0-9 span -2.25 .. 2.25 logits
+}
+
+static int cat_level_of(const Question *q) {
+    int level = q->difficulty - 1;
+    if (level < 0) level = 0;
+    if (level >= CAT_LEVELS) level = CAT_LEVELS - 1;
+    return level;
+}
+
+// Group the bank by difficulty, precompute response and information tables and
+// map one adaptive state per session slot. Must run before the workers fork.
+static int cat_init(CatBank *bank) {
+    memset(bank, 0, sizeof(CatBank));
+    
+    int count = 0;
+    for (Question *q = question_head; q; q = q->next) count++;
+    if (count == 0) return 1; // Nothing to adapt over; the endpoints report it
+    
+    bank->questions = mem_alloc(MEM_CAT, count * sizeof(Question*));
+    if (!bank->questions) return 0;
+    bank->count = count;
+    
+    // Counting sort by level so each level is one contiguous index range
+    int level_count[CAT_LEVELS] = {0};
+    for (Question *q = question_head; q; q = q->next) level_count[cat_level_of(q)]++;
+    for (int l = 0; l < CAT_LEVELS; l++) {
+        bank->level_start[l + 1] = bank->level_start[l] + level_count[l];
+    }
+    int fill[CAT_LEVELS];
+    memcpy(fill, bank->level_start, sizeof(fill));
+    for (Question *q = question_head; q; q = q->next) {
+        bank->questions[fill[cat_level_of(q)]++] = q;
+    }
+    
+    // P(correct) and Fisher information p(1-p) for every grid ability and level
+    for (int g = 0; g < CAT_GRID_POINTS; g++) {
+        double theta = CAT_THETA_MIN + (CAT_THETA_MAX - CAT_THETA_MIN) * g / (CAT_GRID_POINTS - 1);
+        double information[CAT_LEVELS];
+        bank->grid[g] = theta;
+        
+        for (int l = 0; l < CAT_LEVELS; l++) {
+            double p = 1.0 / (1.0 + exp(-(theta - cat_level_difficulty(l))));
+            bank->p_correct[g][l] = p;
+            information[l] = p * (1.0 - p);
+            bank->level_order[g][l] = l;
+        }
+        
+        // Most informative level first (insertion sort of 10 entries)
+        for (int i = 1; i < CAT_LEVELS; i++) {
+            int level = bank->level_order[g][i];
+            int j = i - 1;
+            while (j >= 0 && information[bank->level_order[g][j]] < information[level]) {
+                bank->level_order[g][j + 1] = bank->level_order[g][j];
+                j--;
+            }
+            bank->level_order[g][j + 1] = level;
+        }
+    }
+    
+    // Hierarchical bitset layout: level 0 has a bit per question (1 = unseen),
+    // each level above has a bit per non-empty word of the level below
+    size_t bits = count;
+    size_t words = 0;
+    for (;;) {
+        if (bank->bitset_levels >= CAT_MAX_BITSET_LEVELS) return 0;
+        bank->bitset_offset[bank->bitset_levels] = words;
+        bank->bitset_bits[bank->bitset_levels] = bits;
+        bank->bitset_levels++;
+        words += (bits + 63) / 64;
+        if (bits <= 64) break;
+        bits = (bits + 63) / 64;
+    }
+    bank->bitset_words = words;
+    bank->slot_size = (sizeof(CatState) + words * sizeof(uint64_t) + 63) & ~(size_t)63;
+    
+    // Pages are only backed once a session touches its slot
+    int inherited;
+    void *slots = shared_state_map(SHARED_CAT, SESSION_TABLE_SIZE * bank->slot_size,
+                                   question_bank_fingerprint(), &inherited);
+    if (!slots) return 0;
+    bank->slots = slots;
+    
+    printf("Adaptive testing: %d questions, %d bitset levels, %zu bytes per session\n",
+           count, bank->bitset_levels, bank->slot_size);
+    return 1;
+}
+
+static void cat_free(CatBank *bank) {
+    if (bank->slots) shared_state_unmap(SHARED_CAT, bank->slots);
+    mem_free(bank->questions);
+    memset(bank, 0, sizeof(CatBank));
+}
+
+static uint64_t* cat_bitset(CatState *state) {
+    return (uint64_t*)(state + 1);
+}
+
+static void cat_bitset_clear(const CatBank *bank, uint64_t *words, size_t bit) {
+    for (int k = 0; k < bank->bitset_levels; k++) {
+        uint64_t *word = &words[bank->bitset_offset[k] + (bit >> 6)];
+        *word &= ~(1ULL << (bit & 63));
+        if (*word) break; // Parent bit stays set
+        bit >>= 6;
+    }
+}
+
+// First unseen question index >= pos, or -1. O(log64 n).
+static long cat_bitset_next(const CatBank *bank, const uint64_t *words, size_t pos) {
+    int k = 0;
+    
+    // Climb until some level has a set bit at or after pos
+    for (;;) {
+        if (k >= bank->bitset_levels) return -1;
+        if (pos < bank->bitset_bits[k]) {
+            uint64_t word = words[bank->bitset_offset[k] + (pos >> 6)] & (~0ULL << (pos & 63));
+            if (word) {
+                pos = (pos & ~(size_t)63) + __builtin_ctzll(word);
+                break;
+            }
+        }
+        pos = (pos >> 6) + 1;
+        k++;
+    }
+    
+    // Descend through the lowest set bit of each child word
+    while (k > 0) {
+        k--;
+        pos = (pos << 6) + __builtin_ctzll(words[bank->bitset_offset[k] + pos]);
+    }
+    return (long)pos;
+}
+
+// Reset a slot for a new session: everything unseen, standard normal prior
+static void cat_state_reset(const CatBank *bank, CatState *state, uint32_t session_state) {
+    uint64_t *words = cat_bitset(state);
+    memset(words, 0, bank->bitset_words * sizeof(uint64_t));
+    for (int k = 0; k < bank->bitset_levels; k++) {
+        size_t bits = bank->bitset_bits[k];
+        uint64_t *level = words + bank->bitset_offset[k];
+        memset(level, 0xFF, (bits / 64) * sizeof(uint64_t));
+        if (bits % 64) level[bits / 64] = (1ULL << (bits % 64)) - 1;
+    }
+    
+    double total = 0.0, mean = 0.0, var = 0.0;
+    for (int g = 0; g < CAT_GRID_POINTS; g++) {
+        state->posterior[g] = exp(-0.5 * bank->grid[g] * bank->grid[g]);
+        total += state->posterior[g];
+    }
+    for (int g = 0; g < CAT_GRID_POINTS; g++) {
+        state->posterior[g] /= total;
+        mean += state->posterior[g] * bank->grid[g];
+    }
+    for (int g = 0; g < CAT_GRID_POINTS; g++) {
+        var += state->posterior[g] * (bank->grid[g] - mean) * (bank->grid[g] - mean);
+    }
+    
+    for (int l = 0; l < CAT_LEVELS; l++) {
+        state->remaining[l] = bank->level_start[l + 1] - bank->level_start[l];
+    }
+    state->session_state = session_state;
+    state->answered = 0;
+    state->correct = 0;
+    state->pending = -1;
+    state->theta = mean;
+    state->se = sqrt(var);
+}
+
+// Lock and return the adaptive state for a session slot, resetting it if the slot
+// now belongs to a different session. The lock is shared across worker processes.
+static CatState* cat_acquire(const CatBank *bank, int session_slot, uint32_t session_state) {
+    CatState *state = (CatState*)(bank->slots + (size_t)session_slot * bank->slot_size);
+    while (atomic_flag_test_and_set_explicit(&state->lock, memory_order_acquire)) {
+        sched_yield();
+    }
+    if (state->session_state != session_state) {
+        cat_state_reset(bank, state, session_state);
+    }
+    return state;
+}
+
+static void cat_release(CatState *state) {
+    atomic_flag_clear_explicit(&state->lock, memory_order_release);
+}
+
+// Pick the most informative unseen question for the current ability estimate
+static int cat_select(const CatBank *bank, CatState *state, int session_slot) {
+    // Nearest grid point to theta decides the level ranking
+    int g = (int)lround((state->theta - CAT_THETA_MIN) * (CAT_GRID_POINTS - 1) / (CAT_THETA_MAX - CAT_THETA_MIN));
+    if (g < 0) g = 0;
+    if (g >= CAT_GRID_POINTS) g = CAT_GRID_POINTS - 1;
+    
+    const uint64_t *words = cat_bitset(state);
+    for (int i = 0; i < CAT_LEVELS; i++) {
+        int level = bank->level_order[g][i];
+        if (state->remaining[level] == 0) continue;
+        
+        // Start at a per-session pseudo-random point so candidates don't all see the same order
+        size_t lo = bank->level_start[level];
+        size_t hi = bank->level_start[level + 1];
+        uint64_t mix = ((uint64_t)session_slot << 32 | (uint32_t)state->answered) * 0x9E3779B97F4A7C15ULL;
+        size_t start = lo + (size_t)((mix >> 32) % (hi - lo));
+        
+        long index = cat_bitset_next(bank, words, start);
+        if (index < 0 || (size_t)index >= hi) {
+            index = cat_bitset_next(bank, words, lo);
+        }
+        if (index >= 0 && (size_t)index < hi) return (int)index;
+    }
+    return -1;
+}
+
+// Bayesian (EAP) update of the ability posterior after one graded answer
+static void cat_update(const CatBank *bank, CatState *state, int level, int correct) {
+    double total = 0.0, mean = 0.0, var = 0.0;
+    
+    for (int g = 0; g < CAT_GRID_POINTS; g++) {
+        double p = bank->p_correct[g][level];
+        state->posterior[g] *= correct ? p : (1.0 - p);
+        total += state->posterior[g];
+    }
+    if (total <= 0.0) return; // Underflow; keep the previous estimate
+    
+    for (int g = 0; g < CAT_GRID_POINTS; g++) {
+        state->posterior[g] /= total;
+        if (state->posterior[g] < 1e-200) state->posterior[g] = 0.0; // Keep denormals out of the hot loop
+        mean += state->posterior[g] * bank->grid[g];
+    }
+    for (int g = 0; g < CAT_GRID_POINTS; g++) {
+        var += state->posterior[g] * (bank->grid[g] - mean) * (bank->grid[g] - mean);
+    }
+    
+    state->theta = mean;
+    state->se = sqrt(var);
+    state->answered++;
+    if (correct) state->correct++;
+}
+
+// Question without its answer or explanation; grading happens on the server here
+static int cat_question_json(const Question *q, const CatState *state, char *buf, size_t size) {
+    return snprintf(buf, size,
+        "{\"id\":%d,\"text\":\"%s\",\"options\":[\"%s\",\"%s\",\"%s\",\"%s\"],\"difficulty\":%d,"
+        "\"ability\":%.3f,\"se\":%.3f,\"answered\":%d}",
+        q->id, q->question,
+        q->options[0], q->options[1], q->options[2], q->options[3],
+        q->difficulty, state->theta, state->se, state->answered);
+}
+
+static enum MHD_Result send_json(struct MHD_Connection *connection, unsigned int status, const char *json) {
+    struct MHD_Response *response = create_response(json, "application/json");
+    MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
+    TRACE_BEGIN("MHD_queue_response");
+    enum MHD_Result ret = MHD_queue_response(connection, status, response);
+    TRACE_END("MHD_queue_response");
+    MHD_destroy_response(response);
+    return ret;
+}
+
+// Handle GET /api/next-question: the pending question, or a newly selected one
+static enum MHD_Result handle_next_question(struct MHD_Connection *connection) {
+    uint32_t session_state;
+    int slot = session_find(request_session_token(connection), NULL, &session_state);
+    if (slot < 0) {
+        return send_json(connection, MHD_HTTP_UNAUTHORIZED, "{\"error\":\"Not logged in\"}");
+    }
+    if (!cat_bank.slots) {
+        return send_json(connection, MHD_HTTP_OK, "{\"error\":\"No questions available\"}");
+    }
+    
+    char json[MAX_QUESTION_LENGTH + 4 * MAX_OPTION_LENGTH + 256];
+    CatState *state = cat_acquire(&cat_bank, slot, session_state);
+    
+    // A refresh must not skip the question that is waiting for an answer
+    if (state->pending < 0) {
+        state->pending = cat_select(&cat_bank, state, slot);
+        if (state->pending >= 0) {
+            cat_bitset_clear(&cat_bank, cat_bitset(state), state->pending);
+            state->remaining[cat_level_of(cat_bank.questions[state->pending])]--;
+        }
+    }
+    
+    if (state->pending < 0) {
+        snprintf(json, sizeof(json), "{\"done\":true,\"ability\":%.3f,\"se\":%.3f,\"answered\":%d,\"correct\":%d}",
+                 state->theta, state->se, state->answered, state->correct);
+    } else {
+        cat_question_json(cat_bank.questions[state->pending], state, json, sizeof(json));
+    }
+    cat_release(state);
+    
+    return send_json(connection, MHD_HTTP_OK, json);
+}
+
+// Handle POST /api/answer with question_id=<id>&answer=<1-4>
+static enum MHD_Result handle_answer(struct MHD_Connection *connection,
+                                     const char *upload_data,
+                                     size_t *upload_data_size,
+                                     void **con_cls) {
+    int collected = collect_post_data(con_cls, upload_data, upload_data_size, MAX_POST_SIZE);
+    if (collected < 0) return MHD_NO;
+    if (collected > 0) return MHD_YES;
+    
+    ConnectionInfo *con_info = *con_cls;
+    char id_value[16], answer_value[16];
+    enum MHD_Result ret;
+    
+    uint32_t session_state;
+    int slot = session_find(request_session_token(connection), NULL, &session_state);
+    if (slot < 0) {
+        ret = send_json(connection, MHD_HTTP_UNAUTHORIZED, "{\"error\":\"Not logged in\"}");
+    } else if (!cat_bank.slots ||
+               !parse_form_value(con_info->post_data, "question_id", id_value, sizeof(id_value)) ||
+               !parse_form_value(con_info->post_data, "answer", answer_value, sizeof(answer_value))) {
+        ret = send_json(connection, MHD_HTTP_BAD_REQUEST, "{\"error\":\"question_id and answer are required\"}");
+    } else {
+        int question_id = atoi(id_value);
+        int answer = atoi(answer_value) - 1; // 1-based like questions.txt
+        char json[256];
+        unsigned int status = MHD_HTTP_OK;
+        
+        CatState *state = cat_acquire(&cat_bank, slot, session_state);
+        Question *q = (state->pending >= 0) ? cat_bank.questions[state->pending] : NULL;
+        
+        if (!q || q->id != question_id) {
+            snprintf(json, sizeof(json), "{\"error\":\"Question %d is not the pending question\"}", question_id);
+            status = MHD_HTTP_CONFLICT;
+        } else {
+            int correct = (answer == q->correct_answer);
+            cat_update(&cat_bank, state, cat_level_of(q), correct);
+            state->pending = -1;
+            snprintf(json, sizeof(json),
+                     "{\"correct\":%s,\"ability\":%.3f,\"se\":%.3f,\"answered\":%d}",
+                     correct ? "true" : "false", state->theta, state->se, state->answered);
+        }
+        cat_release(state);
+        ret = send_json(connection, status, json);
+    }
+    
+    cleanup_connection_info(con_cls);
+    return ret;
+}
+
+// ===== Graded submissions and item analysis =====
+
+// Load usernames allowed to use the /api/admin endpoints
+static void load_admin_users(void) {
+    FILE *fp = fopen("../backend/admins.txt", "r");
+    if (!fp) {
+        fp = fopen("backend/admins.txt", "r");
+        if (!fp) {
+            fp = fopen("admins.txt", "r");
+            if (!fp) {
+                printf("Could not open admins file; admin endpoints are disabled\n");
+                return;
+            }
+        }
+    }
+    
+    char line[MAX_USERNAME_LENGTH + 2];
+    while (fgets(line, sizeof(line), fp) && admin_count < MAX_ADMINS) {
+        size_t len = strcspn(line, "\r\n");
+        line[len] = '\0';
+        if (len == 0) continue;
+        if (len >= MAX_USERNAME_LENGTH) {
+            printf("Skipping admin name longer than %d characters\n", MAX_USERNAME_LENGTH - 1);
+            continue;
+        }
+        
+        memcpy(admin_users[admin_count], line, len + 1);
+        admin_count++;
+    }
+    
+    fclose(fp);
+    printf("Loaded %d admin users\n", admin_count);
+}
+
+static int is_admin(const char *username) {
+    for (int i = 0; i < admin_count; i++) {
+        if (strcmp(admin_users[i], username) == 0) return 1;
+    }
+    return 0;
+}
+
+// Middleware for admin routes: a logged-in session of a user from admins.txt
+static int require_admin(RequestContext *ctx, enum MHD_Result *result) {
+    char username[MAX_USERNAME_LENGTH];
+    
+    if (!request_session_user(ctx->connection, username)) {
+        *result = send_json(ctx->connection, MHD_HTTP_UNAUTHORIZED, "{\"error\":\"Not logged in\"}");
+        return 0;
+    }
+    if (!is_admin(username)) {
+        *result = send_json(ctx->connection, MHD_HTTP_FORBIDDEN, "{\"error\":\"Admin only\"}");
+        return 0;
+    }
+    return 1;
+}
+
+// Ties fall back to file order so the first question with an id wins, as in the BST
+static int compare_question_id(const void *a, const void *b) {
+    const Question *qa = ((const IndexedQuestion*)a)->question;
+    const Question *qb = ((const IndexedQuestion*)b)->question;
+    if (qa->id != qb->id) return (qa->id > qb->id) - (qa->id < qb->id);
+    return ((const IndexedQuestion*)a)->order - ((const IndexedQuestion*)b)->order;
+}
+
+// Dense, id-sorted index of the bank. A question's position here is its item number
+// for statistics.
+static int build_question_index(void) {
+    int count = 0;
+    for (Question *q = question_head; q; q = q->next) count++;
+    if (count == 0) return 1;
+    
+    IndexedQuestion *sorted = mem_alloc(MEM_QUESTIONS, count * sizeof(IndexedQuestion));
+    question_index = mem_alloc(MEM_QUESTIONS, count * sizeof(Question*));
+    if (!sorted || !question_index) {
+        mem_free(sorted);
+        return 0;
+    }
+    
+    int n = 0;
+    for (Question *q = question_head; q; q = q->next, n++) {
+        sorted[n].question = q;
+        sorted[n].order = n;
+    }
+    qsort(sorted, n, sizeof(IndexedQuestion), compare_question_id);
+    
+    int unique = 0;
+    for (int i = 0; i < n; i++) {
+        if (unique > 0 && question_index[unique - 1]->id == sorted[i].question->id) continue;
+        question_index[unique++] = sorted[i].question;
+    }
+    question_count = unique;
+    mem_free(sorted);
+    
+    if (unique != n) {
+        printf("WARNING: %d questions share an id with an earlier question\n", n - unique);
+    }
+    return 1;
+}
+
+// Binary search the index by question id; returns the item number or -1
+static int question_index_find(int id) {
+    int lo = 0, hi = question_count - 1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        int mid_id = question_index[mid]->id;
+        if (mid_id == id) return mid;
+        if (mid_id < id) lo = mid + 1; else hi = mid - 1;
+    }
+    return -1;
+}
+
+static ItemAccumulator* item_stats_shard_items(int shard) {
+    return (ItemAccumulator*)(item_stats.base + ITEM_STATS_HEADER_SIZE + (size_t)shard * item_stats.shard_size +
+                              ITEM_STATS_HEADER_SIZE);
+}
+
+static pthread_mutex_t* item_stats_shard_lock(int shard) {
+    return (pthread_mutex_t*)(item_stats.base + ITEM_STATS_HEADER_SIZE + (size_t)shard * item_stats.shard_size);
+}
+
+// Shared across worker processes: one accumulator array per shard, each behind a
+// process-shared mutex. Must run before fork.
+static int item_stats_init(void) {
+    item_stats.count = question_count;
+    item_stats.shard_size = (ITEM_STATS_HEADER_SIZE + question_count * sizeof(ItemAccumulator) + 63) & ~(size_t)63;
+    item_stats.size = ITEM_STATS_HEADER_SIZE + ITEM_STAT_SHARDS * item_stats.shard_size;
+    
+    int inherited;
+    void *base = shared_state_map(SHARED_ITEM_STATS, item_stats.size, question_bank_fingerprint(), &inherited);
+    if (!base) return 0;
+    item_stats.base = base;
+    if (inherited) return 1;
+    
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    for (int i = 0; i < ITEM_STAT_SHARDS; i++) {
+        pthread_mutex_init(item_stats_shard_lock(i), &attr);
+    }
+    pthread_mutexattr_destroy(&attr);
+    return 1;
+}
+
+static void item_stats_free(void) {
+    if (!item_stats.base) return;
+    shared_state_unmap(SHARED_ITEM_STATS, item_stats.base);
+    memset(&item_stats, 0, sizeof(item_stats));
+}
+
+// Each thread (in any worker) sticks to one shard, handed out round-robin
+static int item_stats_shard(void) {
+    static _Thread_local int shard = -1;
+    if (shard < 0) {
+        atomic_uint *next = (atomic_uint*)item_stats.base;
+        shard = (int)(atomic_fetch_add(next, 1) % ITEM_STAT_SHARDS);
+    }
+    return shard;
+}
+
+// O(1) per answered item: counts plus the sums needed for the rest-score point-biserial
+static void item_stats_record(const GradedAnswer *answers, int count, int score) {
+    if (!item_stats.base || count == 0) return;
+    
+    int shard = item_stats_shard();
+    ItemAccumulator *items = item_stats_shard_items(shard);
+    
+    pthread_mutex_lock(item_stats_shard_lock(shard));
+    for (int i = 0; i < count; i++) {
+        const GradedAnswer *a = &answers[i];
+        ItemAccumulator *acc = &items[a->index];
+        // Proportion correct on the other items, so an item doesn't correlate with itself
+        double rest = (count > 1) ? (double)(score - a->correct) / (count - 1) : 0.0;
+        
+        acc->responses++;
+        acc->option_counts[a->option]++;
+        acc->time_sum += a->seconds;
+        acc->rest_sum += rest;
+        acc->rest_sq_sum += rest * rest;
+        if (a->correct) {
+            acc->correct++;
+            acc->rest_sum_correct += rest;
+        }
+    }
+    pthread_mutex_unlock(item_stats_shard_lock(shard));
+}
+
+// Sum one item over all shards
+static void item_stats_merge(int index, ItemAccumulator *out) {
+    memset(out, 0, sizeof(ItemAccumulator));
+    
+    for (int shard = 0; shard < ITEM_STAT_SHARDS; shard++) {
+        pthread_mutex_lock(item_stats_shard_lock(shard));
+        const ItemAccumulator *acc = &item_stats_shard_items(shard)[index];
+        out->responses += acc->responses;
+        out->correct += acc->correct;
+        for (int o = 0; o < 5; o++) out->option_counts[o] += acc->option_counts[o];
+        out->time_sum += acc->time_sum;
+        out->rest_sum += acc->rest_sum;
+        out->rest_sq_sum += acc->rest_sq_sum;
+        out->rest_sum_correct += acc->rest_sum_correct;
+        pthread_mutex_unlock(item_stats_shard_lock(shard));
+    }
+}
+
+static int item_stats_json(int index, char *buf, size_t size) {
+    ItemAccumulator acc;
+    item_stats_merge(index, &acc);
+    const Question *q = question_index[index];
+    
+    if (acc.responses == 0) {
+        return snprintf(buf, size, "{\"id\":%d,\"responses\":0}", q->id);
+    }
+    
+    double n = (double)acc.responses;
+    double p = acc.correct / n;
+    double mean_time = acc.time_sum / n;
+    
+    // Point-biserial between correctness and rest score
+    char discrimination[32] = "null";
+    if (acc.correct > 0 && acc.correct < acc.responses) {
+        double mean = acc.rest_sum / n;
+        double var = acc.rest_sq_sum / n - mean * mean;
+        if (var > 1e-12) {
+            double mean_correct = acc.rest_sum_correct / acc.correct;
+            double mean_wrong = (acc.rest_sum - acc.rest_sum_correct) / (acc.responses - acc.correct);
+            snprintf(discrimination, sizeof(discrimination), "%.3f",
+                     (mean_correct - mean_wrong) / sqrt(var) * sqrt(p * (1.0 - p)));
+        }
+    }
+    
+    // Most popular wrong option; a wrong option beating the key suggests a bad correct_answer
+    int popular_wrong = 0;
+    for (int o = 1; o <= 4; o++) {
+        if (o - 1 == q->correct_answer) continue;
+        if (popular_wrong == 0 || acc.option_counts[o] > acc.option_counts[popular_wrong]) popular_wrong = o;
+    }
+    
+    const char *flag = "ok";
+    if (discrimination[0] == '-') flag = "negative_discrimination";
+    else if (popular_wrong && acc.option_counts[popular_wrong] > acc.correct) flag = "distractor_beats_key";
+    else if (p > 0.95) flag = "too_easy";
+    else if (p < 0.2) flag = "too_hard";
+    
+    return snprintf(buf, size,
+        "{\"id\":%d,\"responses\":%llu,\"p_value\":%.3f,\"discrimination\":%s,"
+        "\"options\":[%llu,%llu,%llu,%llu],\"unanswered\":%llu,\"key\":%d,"
+        "\"mean_time\":%.1f,\"flag\":\"%s\"}",
+        q->id, (unsigned long long)acc.responses, p, discrimination,
+        (unsigned long long)acc.option_counts[1], (unsigned long long)acc.option_counts[2],
+        (unsigned long long)acc.option_counts[3], (unsigned long long)acc.option_counts[4],
+        (unsigned long long)acc.option_counts[0], q->correct_answer + 1,
+        mean_time, flag);
+}
+
+// Handle GET /api/admin/item-stats[?id=N]
+static enum MHD_Result handle_item_stats(struct MHD_Connection *connection) {
+    const char *id_param = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "id");
+    
+    if (id_param) {
+        int index = question_index_find(atoi(id_param));
+        if (index < 0) {
+            return send_json(connection, MHD_HTTP_NOT_FOUND, "{\"error\":\"Question not found\"}");
+        }
+        char json[512];
+        item_stats_json(index, json, sizeof(json));
+        return send_json(connection, MHD_HTTP_OK, json);
+    }
+    
+    size_t buffer_size = (size_t)question_count * 384 + 64;
+    char *json = mem_alloc(MEM_RESPONSE, buffer_size);
+    if (!json) return MHD_NO;
+    
+    size_t offset = snprintf(json, buffer_size, "[");
+    for (int i = 0; i < question_count; i++) {
+        if (i > 0) json[offset++] = ',';
+        offset += item_stats_json(i, json + offset, buffer_size - offset);
+    }
+    snprintf(json + offset, buffer_size - offset, "]");
+    
+    enum MHD_Result ret = send_json(connection, MHD_HTTP_OK, json);
+    mem_free(json);
+    return ret;
+}
+
+// ===== Rank and leaderboard =====
+
+// Counts are kept per percent bucket (0.1% steps) in a Fenwick tree, so rank and
+// percentile are two prefix sums. Everything lives in one shared mapping guarded by
+// a process-shared mutex, made before fork so all workers rank against the same cohort.
+static int rank_init(void) {
+    int inherited;
+    void *base = shared_state_map(SHARED_RANK, sizeof(RankBoard), 0, &inherited);
+    if (!base) return 0;
+    rank_board = base;
+    if (inherited) return 1;
+    
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(&rank_board->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    return 1;
+}
+
+static void rank_free(void) {
+    if (!rank_board) return;
+    shared_state_unmap(SHARED_RANK, rank_board);
+    rank_board = NULL;
+}
+
+static void rank_fenwick_add(int bucket, int delta) {
+    for (int i = bucket + 1; i <= RANK_BUCKETS; i += i & -i) {
+        rank_board->fenwick[i] += delta;
+    }
+}
+
+// Number of candidates with a bucket below the given one
+static int rank_fenwick_below(int bucket) {
+    int count = 0;
+    for (int i = bucket; i > 0; i -= i & -i) {
+        count += rank_board->fenwick[i];
+    }
+    return count;
+}
+
+// Find the user's result slot, or the empty slot where it would go (-1 if full)
+static int rank_slot(const char *username) {
+    unsigned int index = session_hash(username) % RANK_TABLE_SIZE;
+    for (int probe = 0; probe < RANK_TABLE_SIZE; probe++) {
+        RankResult *result = &rank_board->results[index];
+        if (!result->used || strcmp(result->username, username) == 0) return (int)index;
+        index = (index + 1) % RANK_TABLE_SIZE;
+    }
+    return -1;
+}
+
+// Higher bucket first; ties go to whoever got there earlier
+static int rank_better(const RankResult *a, const RankResult *b) {
+    if (a->bucket != b->bucket) return a->bucket > b->bucket;
+    return a->submitted_ms < b->submitted_ms;
+}
+
+// Move slot into its place in the top list. Scores only ever improve, so an
+// entry never has to leave the list for anything but a better one.
+static void rank_top_update(int slot) {
+    const RankResult *result = &rank_board->results[slot];
+    int *top = rank_board->top;
+    int pos = -1;
+    
+    for (int i = 0; i < rank_board->top_count; i++) {
+        if (top[i] == slot) {
+            pos = i;
+            break;
+        }
+    }
+    if (pos < 0) {
+        if (rank_board->top_count < RANK_TOP_SIZE) {
+            pos = rank_board->top_count++;
+        } else if (rank_better(result, &rank_board->results[top[RANK_TOP_SIZE - 1]])) {
+            pos = RANK_TOP_SIZE - 1;
+        } else {
+            return;
+        }
+    }
+    
+    while (pos > 0 && rank_better(result, &rank_board->results[top[pos - 1]])) {
+        top[pos] = top[pos - 1];
+        pos--;
+    }
+    top[pos] = slot;
+    atomic_fetch_add(&rank_board->version, 1);
+}
+
+// Record a graded submission. A candidate is ranked by their best result.
+static void rank_record(const char *username, int score, int total, int64_t submitted_ms) {
+    if (!rank_board || total <= 0) return;
+    
+    int bucket = (int)((int64_t)score * (RANK_BUCKETS - 1) / total);
+    
+    pthread_mutex_lock(&rank_board->lock);
+    int slot = rank_slot(username);
+    if (slot < 0 || (!rank_board->results[slot].used && rank_board->candidates >= RANK_TABLE_SIZE * 3 / 4)) {
+        pthread_mutex_unlock(&rank_board->lock);
+        printf("Rank table full; %s is not ranked\n", username);
+        return;
+    }
+    
+    RankResult *result = &rank_board->results[slot];
+    if (result->used) {
+        if (bucket <= result->bucket) {
+            pthread_mutex_unlock(&rank_board->lock);
+            return;
+        }
+        rank_fenwick_add(result->bucket, -1);
+    } else {
+        snprintf(result->username, MAX_USERNAME_LENGTH, "%s", username);
+        result->used = 1;
+        rank_board->candidates++;
+    }
+    
+    result->score = score;
+    result->total = total;
+    result->bucket = bucket;
+    result->submitted_ms = submitted_ms;
+    rank_fenwick_add(bucket, 1);
+    rank_top_update(slot);
+    pthread_mutex_unlock(&rank_board->lock);
+}
+
+// Handle GET /api/rank: the logged-in candidate's rank among everyone ranked
+static enum MHD_Result handle_rank(struct MHD_Connection *connection) {
+    char username[MAX_USERNAME_LENGTH];
+    if (!request_session_user(connection, username)) {
+        return send_json(connection, MHD_HTTP_UNAUTHORIZED, "{\"error\":\"Not logged in\"}");
+    }
+    
+    pthread_mutex_lock(&rank_board->lock);
+    int slot = rank_slot(username);
+    if (slot < 0 || !rank_board->results[slot].used) {
+        pthread_mutex_unlock(&rank_board->lock);
+        return send_json(connection, MHD_HTTP_NOT_FOUND, "{\"error\":\"No graded submission\"}");
+    }
+    RankResult result = rank_board->results[slot];
+    int candidates = rank_board->candidates;
+    int below = rank_fenwick_below(result.bucket);
+    int tied = rank_fenwick_below(result.bucket + 1) - below;
+    pthread_mutex_unlock(&rank_board->lock);
+    
+    // Competition ranking (ties share a rank); percentile counts half the ties as below
+    int rank = candidates - below - tied + 1;
+    double percentile = 100.0 * (below + 0.5 * tied) / candidates;
+    
+    char json[256];
+    snprintf(json, sizeof(json),
+             "{\"score\":%d,\"total\":%d,\"percent\":%.1f,\"rank\":%d,\"candidates\":%d,\"percentile\":%.1f}",
+             result.score, result.total, 100.0 * result.score / result.total, rank, candidates, percentile);
+    return send_json(connection, MHD_HTTP_OK, json);
+}
+
+// Per-process rendering of the top list, rebuilt only when the shared version moves.
+// entry_end[i] is where entry i ends, so top=N is a prefix of the same buffer.
+static pthread_mutex_t leaderboard_lock = PTHREAD_MUTEX_INITIALIZER;
+static char leaderboard_json[RANK_TOP_SIZE * LEADERBOARD_ENTRY_SIZE + 2];
+static size_t leaderboard_entry_end[RANK_TOP_SIZE + 1];
+static int leaderboard_count = 0;
+static unsigned int leaderboard_version = UINT_MAX;
+
+static void leaderboard_refresh(void) {
+    unsigned int version = atomic_load(&rank_board->version);
+    if (version == leaderboard_version) return;
+    
+    RankResult entries[RANK_TOP_SIZE];
+    int ranks[RANK_TOP_SIZE];
+    int count;
+    
+    pthread_mutex_lock(&rank_board->lock);
+    version = atomic_load(&rank_board->version);
+    count = rank_board->top_count;
+    for (int i = 0; i < count; i++) {
+        entries[i] = rank_board->results[rank_board->top[i]];
+        ranks[i] = rank_board->candidates - rank_fenwick_below(entries[i].bucket + 1) + 1;
+    }
+    pthread_mutex_unlock(&rank_board->lock);
+    
+    size_t offset = 0;
+    leaderboard_json[offset++] = '[';
+    leaderboard_entry_end[0] = offset;
+    int written = 0;
+    for (int i = 0; i < count; i++) {
+        char entry[LEADERBOARD_ENTRY_SIZE];
+        size_t length = snprintf(entry, sizeof(entry), "%s{\"rank\":%d,\"username\":\"", i > 0 ? "," : "", ranks[i]);
+        length = json_append_escaped(entry, sizeof(entry), length, entries[i].username);
+        length += snprintf(entry + length, sizeof(entry) - length,
+                           "\",\"score\":%d,\"total\":%d,\"percent\":%.1f}",
+                           entries[i].score, entries[i].total, 100.0 * entries[i].score / entries[i].total);
+        // Room is left for the closing ']' and NUL; stop rather than cut an entry short
+        if (length >= sizeof(entry) || offset + length + 2 > sizeof(leaderboard_json)) break;
+        
+        memcpy(leaderboard_json + offset, entry, length);
+        offset += length;
+        leaderboard_entry_end[++written] = offset;
+    }
+    leaderboard_count = written;
+    leaderboard_version = version;
+}
+
+// Handle GET /api/leaderboard?top=N
+static enum MHD_Result handle_leaderboard(struct MHD_Connection *connection) {
+    char username[MAX_USERNAME_LENGTH];
+    if (!request_session_user(connection, username)) {
+        return send_json(connection, MHD_HTTP_UNAUTHORIZED, "{\"error\":\"Not logged in\"}");
+    }
+    
+    const char *top_param = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "top");
+    int top = top_param ? atoi(top_param) : 10;
+    if (top < 1) top = 1;
+    if (top > RANK_TOP_SIZE) top = RANK_TOP_SIZE;
+    
+    pthread_mutex_lock(&leaderboard_lock);
+    leaderboard_refresh();
+    if (top > leaderboard_count) top = leaderboard_count;
+    size_t length = leaderboard_entry_end[top];
+    char *json = mem_alloc(MEM_RESPONSE, length + 2);
+    if (json) memcpy(json, leaderboard_json, length);
+    pthread_mutex_unlock(&leaderboard_lock);
+    if (!json) return MHD_NO;
+    json[length] = ']';
+    json[length + 1] = '\0';
+    
+    enum MHD_Result ret = send_json(connection, MHD_HTTP_OK, json);
+    mem_free(json);
+    return ret;
+}
+
+static int compare_graded_answer(const void *a, const void *b) {
+    const GradedAnswer *ga = a;
+    const GradedAnswer *gb = b;
+    return (ga->index > gb->index) - (ga->index < gb->index);
+}
+
+// Parse "id:option[:seconds],..." (option 1-4, 0 = unanswered). Unknown ids and
+// repeated questions are dropped. Returns the number of answers kept.
+static int parse_submission(char *value, GradedAnswer *answers, int max_answers) {
+    int count = 0;
+    char *rest = value;
+    char *entry;
+    
+    while ((entry = strtok_r(rest, ",", &rest)) != NULL && count < max_answers) {
+        int id, option;
+        double seconds = 0.0;
+        int fields = sscanf(entry, "%d:%d:%lf", &id, &option, &seconds);
+        if (fields < 2 || option < 0 || option > 4) continue;
+        if (seconds < 0.0 || seconds > 86400.0) seconds = 0.0;
+        
+        int index = question_index_find(id);
+        if (index < 0) continue;
+        
+        answers[count].index = index;
+        answers[count].option = option;
+        answers[count].seconds = seconds;
+        answers[count].correct = (option - 1 == question_index[index]->correct_answer);
+        count++;
+    }
+    
+    qsort(answers, count, sizeof(GradedAnswer), compare_graded_answer);
+    int unique = 0;
+    for (int i = 0; i < count; i++) {
+        if (unique > 0 && answers[unique - 1].index == answers[i].index) continue;
+        answers[unique++] = answers[i];
+    }
+    return unique;
+}
+
+static unsigned int submitted_hash(const char *username) {
+    unsigned int hash = 2166136261u;
+    while (*username) {
+        hash ^= (unsigned char)*username++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Slot holding username, or the empty slot it would go in. Caller holds the lock.
+static uint32_t submitted_slot(const char *username) {
+    uint32_t mask = submitted_table->capacity - 1;
+    uint32_t slot = submitted_hash(username) & mask;
+    while (submitted_table->usernames[slot][0] && strcmp(submitted_table->usernames[slot], username) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Caller holds the lock. Returns 0 if username was already in the table.
+static int submitted_insert(const char *username) {
+    uint32_t slot = submitted_slot(username);
+    if (submitted_table->usernames[slot][0]) return 0;
+    snprintf(submitted_table->usernames[slot], MAX_USERNAME_LENGTH, "%s", username);
+    submitted_table->count++;
+    return 1;
+}
+
+// Map the submitted set and open the log. Runs after load_auth_data: the table has
+// room for every user in auth.txt plus anyone already in the log.
+static int submissions_init(void) {
+    size_t users = count_file_lines(fopen(SUBMISSION_LOG_PATH, "r"));
+    for (int i = 0; i < HASH_TABLE_SIZE; i++) {
+        for (AuthEntry *entry = auth_hash_table[i]; entry; entry = entry->next) users++;
+    }
+    uint32_t capacity = SUBMITTED_TABLE_MIN;
+    while (capacity < users * 2) capacity *= 2;
+    
+    int inherited;
+    submitted_table = shared_state_map(SHARED_SUBMITTED,
+                                       sizeof(SubmittedTable) + (size_t)capacity * MAX_USERNAME_LENGTH, 0, &inherited);
+    if (!submitted_table) return 0;
+    if (!inherited) {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutex_init(&submitted_table->lock, &attr);
+        pthread_mutexattr_destroy(&attr);
+        submitted_table->capacity = capacity;
+    }
+    
+    submission_log_fd = open(SUBMISSION_LOG_PATH, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (submission_log_fd < 0) {
+        printf("Could not open %s: %s\n", SUBMISSION_LOG_PATH, strerror(errno));
+        return 0;
+    }
+    return 1;
+}
+
+static void submissions_free(void) {
+    if (submission_log_fd >= 0) close(submission_log_fd);
+    submission_log_fd = -1;
+    if (submitted_table) shared_state_unmap(SHARED_SUBMITTED, submitted_table);
+    submitted_table = NULL;
+}
+
+// Grade against the whole bank. graded gets one entry per question, in item order,
+// with unanswered questions as option 0 (wrong). Returns the score.
+static int grade_full_set(const GradedAnswer *answers, int count, GradedAnswer *graded) {
+    for (int i = 0; i < question_count; i++) {
+        graded[i] = (GradedAnswer){ .index = i };
+    }
+    for (int i = 0; i < count; i++) {
+        graded[answers[i].index] = answers[i];
+    }
+    
+    int score = 0;
+    for (int i = 0; i < question_count; i++) score += graded[i].correct;
+    return score;
+}
+
+// The answers in parse_submission's format, as stored in the log
+static char* submission_answers_text(const GradedAnswer *answers, int count) {
+    size_t size = (size_t)count * 40 + 1;
+    char *text = mem_alloc(MEM_REQUEST, size);
+    if (!text) return NULL;
+    
+    size_t offset = 0;
+    text[0] = '\0';
+    for (int i = 0; i < count; i++) {
+        offset += snprintf(text + offset, size - offset, "%s%d:%d:%.1f", i ? "," : "",
+                           question_index[answers[i].index]->id, answers[i].option, answers[i].seconds);
+    }
+    return text;
+}
+
+// Claim the candidate's one submission, appending "submitted_ms|score|total|answers|username"
+// to the log. Returns 1, 0 if the candidate already submitted, -1 if it could not be logged.
+static int submission_commit(const char *username, int64_t submitted_ms, int score, int total,
+                             const char *answers_text) {
+    size_t size = strlen(answers_text) + MAX_USERNAME_LENGTH + 64;
+    char *line = mem_alloc(MEM_REQUEST, size);
+    if (!line) return -1;
+    int length = snprintf(line, size, "%lld|%d|%d|%s|%s\n",
+                          (long long)submitted_ms, score, total, answers_text, username);
+    int result = 1;
+    
+    pthread_mutex_lock(&submitted_table->lock);
+    uint32_t slot = submitted_slot(username);
+    if (submitted_table->usernames[slot][0]) {
+        result = 0;
+    } else if (submitted_table->count >= submitted_table->capacity * 3 / 4) {
+        printf("ERROR: submitted table full; %s's submission was not recorded\n", username);
+        result = -1;
+    } else if (write(submission_log_fd, line, length) != length) {
+        printf("ERROR: could not append to %s: %s\n", SUBMISSION_LOG_PATH, strerror(errno));
+        result = -1;
+    } else {
+        submitted_insert(username);
+    }
+    pthread_mutex_unlock(&submitted_table->lock);
+    mem_free(line);
+    
+    // Outside the lock so concurrent submissions share the journal commit
+    if (result == 1 && fdatasync(submission_log_fd) != 0) {
+        printf("WARNING: could not sync %s: %s\n", SUBMISSION_LOG_PATH, strerror(errno));
+    }
+    return result;
+}
+
+// Split a log line (newline already stripped) in place. Returns 0 if it is malformed.
+static int submission_log_parse(char *line, int64_t *submitted_ms, int *score, int *total,
+                                char **answers_text, char **username) {
+    long long ms;
+    int consumed = 0;
+    char *separator;
+    if (sscanf(line, "%lld|%d|%d|%n", &ms, score, total, &consumed) != 3 || consumed == 0 ||
+        !(separator = strchr(line + consumed, '|')) || !separator[1] ||
+        strlen(separator + 1) >= MAX_USERNAME_LENGTH) {
+        return 0;
+    }
+    *separator = '\0';
+    *submitted_ms = ms;
+    *answers_text = line + consumed;
+    *username = separator + 1;
+    return 1;
+}
+
+// Rebuild from the log whatever did not come over from a previous process: the
+// submitted set, item statistics (regraded against the current key) and ranks.
+static int submission_log_replay(void) {
+    int rebuild_submitted = !shared_state[SHARED_SUBMITTED].adopted;
+    int rebuild_items = !shared_state[SHARED_ITEM_STATS].adopted && question_count > 0;
+    int rebuild_rank = !shared_state[SHARED_RANK].adopted;
+    if (!rebuild_submitted && !rebuild_items && !rebuild_rank) return 1;
+    
+    FILE *fp = fopen(SUBMISSION_LOG_PATH, "r");
+    if (!fp) return errno == ENOENT;
+    
+    GradedAnswer *graded = mem_alloc(MEM_REQUEST, (question_count + 1) * sizeof(GradedAnswer));
+    if (!graded) {
+        fclose(fp);
+        return 0;
+    }
+    
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t length;
+    int replayed = 0, skipped = 0;
+    
+    while ((length = getline(&line, &line_size, fp)) > 0) {
+        if (line[length - 1] == '\n') line[--length] = '\0';
+        
+        int64_t submitted_ms;
+        int score, total;
+        char *answers_text, *username;
+        if (!submission_log_parse(line, &submitted_ms, &score, &total, &answers_text, &username)) {
+            skipped++;
+            continue;
+        }
+        
+        if (rebuild_submitted) {
+            pthread_mutex_lock(&submitted_table->lock);
+            int fresh = submitted_insert(username);
+            pthread_mutex_unlock(&submitted_table->lock);
+            if (!fresh) {
+                skipped++; // Only the first submission of a candidate counts
+                continue;
+            }
+        }
+        if (rebuild_items) {
+            GradedAnswer *answers = mem_alloc(MEM_REQUEST, (strlen(answers_text) / 4 + 1) * sizeof(GradedAnswer));
+            if (answers) {
+                int count = parse_submission(answers_text, answers, (int)(strlen(answers_text) / 4 + 1));
+                int regraded = grade_full_set(answers, count, graded);
+                item_stats_record(graded, question_count, regraded);
+                mem_free(answers);
+            }
+        }
+        if (rebuild_rank) rank_record(username, score, total, submitted_ms);
+        replayed++;
+    }
+    
+    free(line); // From getline
+    mem_free(graded);
+    fclose(fp);
+    printf("Replayed %d graded submissions from %s", replayed, SUBMISSION_LOG_PATH);
+    if (skipped) printf(" (%d lines skipped)", skipped);
+    printf("\n");
+    return 1;
+}
+
+// Score, total and, per question, the candidate's option, the key and the explanation.
+// Sent only after grading, since the question endpoints leave the key out.
+static char* submission_result_json(const GradedAnswer *graded, int score) {
+    size_t size = 128;
+    for (int i = 0; i < question_count; i++) {
+        size += 96 + strlen(question_index[i]->explanation) * 6;
+    }
+    char *json = mem_alloc(MEM_RESPONSE, size);
+    if (!json) return NULL;
+    
+    size_t offset = snprintf(json, size, "{\"score\":%d,\"total\":%d,\"percent\":%.1f,\"results\":[",
+                             score, question_count, 100.0 * score / question_count);
+    for (int i = 0; i < question_count; i++) {
+        const Question *q = question_index[i];
+        offset += snprintf(json + offset, size - offset, "%s{\"id\":%d,\"answer\":%d,\"correct\":%d,\"explanation\":\"",
+                           i ? "," : "", q->id, graded[i].option, q->correct_answer + 1);
+        offset = json_append_escaped(json, size, offset, q->explanation);
+        offset += snprintf(json + offset, size - offset, "\"}");
+    }
+    snprintf(json + offset, size - offset, "]}");
+    return json;
+}
+
+// Handle POST /api/submit with answers=<id>:<option>[:<seconds>],...
+// The exam is every question in the bank; questions left out count as unanswered.
+static enum MHD_Result handle_submit(struct MHD_Connection *connection,
+                                     const char *upload_data,
+                                     size_t *upload_data_size,
+                                     void **con_cls) {
+    int collected = collect_post_data(con_cls, upload_data, upload_data_size, MAX_SUBMISSION_SIZE);
+    if (collected < 0) return MHD_NO;
+    if (collected > 0) return MHD_YES;
+    
+    ConnectionInfo *con_info = *con_cls;
+    char username[MAX_USERNAME_LENGTH];
+    enum MHD_Result ret;
+    char *value = NULL;
+    char *answers_text = NULL;
+    char *json = NULL;
+    GradedAnswer *answers = NULL;
+    GradedAnswer *graded = NULL;
+    
+    if (!request_session_user(connection, username)) {
+        ret = send_json(connection, MHD_HTTP_UNAUTHORIZED, "{\"error\":\"Not logged in\"}");
+        goto done;
+    }
+    if (question_count == 0) {
+        ret = send_json(connection, MHD_HTTP_SERVICE_UNAVAILABLE, "{\"error\":\"No questions loaded\"}");
+        goto done;
+    }
+    
+    size_t value_size = (con_info->post_data ? con_info->post_size : 0) + 1;
+    value = mem_alloc(MEM_REQUEST, value_size);
+    if (!value || !con_info->post_data || !parse_form_value(con_info->post_data, "answers", value, value_size)) {
+        ret = send_json(connection, MHD_HTTP_BAD_REQUEST, "{\"error\":\"answers is required\"}");
+        goto done;
+    }
+    
+    // Every entry needs at least "1:1," so this bounds the answer count
+    int max_answers = (int)(strlen(value) / 4) + 1;
+    answers = mem_alloc(MEM_REQUEST, max_answers * sizeof(GradedAnswer));
+    graded = mem_alloc(MEM_REQUEST, question_count * sizeof(GradedAnswer));
+    if (!answers || !graded) {
+        ret = MHD_NO;
+        goto done;
+    }
+    int count = parse_submission(value, answers, max_answers);
+    int score = grade_full_set(answers, count, graded);
+    int64_t submitted_ms = session_now_ms();
+    
+    answers_text = submission_answers_text(answers, count);
+    int committed = answers_text ? submission_commit(username, submitted_ms, score, question_count, answers_text) : -1;
+    if (committed == 0) {
+        ret = send_json(connection, MHD_HTTP_CONFLICT, "{\"error\":\"Exam already submitted\"}");
+        goto done;
+    }
+    if (committed < 0) {
+        ret = send_json(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, "{\"error\":\"Could not record submission\"}");
+        goto done;
+    }
+    
+    item_stats_record(graded, question_count, score);
+    rank_record(username, score, question_count, submitted_ms);
+    printf("Graded submission from %s: %d/%d (%d answered)\n", username, score, question_count, count);
+    
+    json = submission_result_json(graded, score);
+    ret = json ? send_json(connection, MHD_HTTP_OK, json) : MHD_NO;
+
+done:
+    mem_free(value);
+    mem_free(answers_text);
+    mem_free(json);
+    mem_free(answers);
+    mem_free(graded);
+    cleanup_connection_info(con_cls);
+    return ret;
+}
+
+// ===== Results export =====
+
+// Read every graded submission from the log, the durable record, rather than the
+// rank board. The log's length is taken under the submitted lock, which appends hold,
+// so the export is one consistent cohort of whole lines however long the client
+// takes to download it. As in submission_log_replay, only a candidate's first line
+// counts. This runs on the MHD thread: the encoder thread has idle priority and must
+// never hold a lock the request path waits on.
+static int export_snapshot(ExportJob *job) {
+    struct stat st;
+    pthread_mutex_lock(&submitted_table->lock);
+    int have_size = fstat(submission_log_fd, &st) == 0;
+    pthread_mutex_unlock(&submitted_table->lock);
+    if (!have_size) return 0;
+    
+    FILE *fp = fopen(SUBMISSION_LOG_PATH, "r");
+    if (!fp) return 0;
+    
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t length;
+    off_t offset = 0;
+    int capacity = 0, count = 0, ok = 1;
+    int *seen = NULL; // Open-addressed set of row index + 1, by username
+    uint32_t seen_mask = 0;
+    
+    while (offset < st.st_size && (length = getline(&line, &line_size, fp)) > 0) {
+        offset += length;
+        if (line[length - 1] == '\n') line[--length] = '\0';
+        
+        int64_t submitted_ms;
+        int score, total;
+        char *answers_text, *username;
+        if (!submission_log_parse(line, &submitted_ms, &score, &total, &answers_text, &username) ||
+            total <= 0 || score < 0 || score > total) {
+            continue;
+        }
+        
+        if (count * 2 >= capacity) {
+            // Keep the set at most half full; rows and set grow together
+            int grown = capacity ? capacity * 2 : 1024;
+            ExportRow *rows = mem_realloc(MEM_RESPONSE, job->rows, grown * sizeof(ExportRow));
+            int *grown_seen = mem_calloc(MEM_RESPONSE, grown, sizeof(int));
+            if (!rows || !grown_seen) {
+                if (rows) job->rows = rows;
+                mem_free(grown_seen);
+                ok = 0;
+                break;
+            }
+            job->rows = rows;
+            mem_free(seen);
+            seen = grown_seen;
+            seen_mask = (uint32_t)grown - 1;
+            capacity = grown;
+            for (int i = 0; i < count; i++) {
+                uint32_t slot = submitted_hash(job->rows[i].username) & seen_mask;
+                while (seen[slot]) slot = (slot + 1) & seen_mask;
+                seen[slot] = i + 1;
+            }
+        }
+        
+        uint32_t slot = submitted_hash(username) & seen_mask;
+        while (seen[slot] && strcmp(job->rows[seen[slot] - 1].username, username) != 0) {
+            slot = (slot + 1) & seen_mask;
+        }
+        if (seen[slot]) continue;
+        seen[slot] = count + 1;
+        
+        ExportRow *row = &job->rows[count++];
+        snprintf(row->username, MAX_USERNAME_LENGTH, "%s", username);
+        row->score = score;
+        row->total = total;
+        row->bucket = (int)((int64_t)score * (RANK_BUCKETS - 1) / total); // As rank_record
+        row->submitted_ms = submitted_ms;
+    }
+    
+    free(line); // From getline
+    mem_free(seen);
+    fclose(fp);
+    job->row_count = count;
+    return ok;
+}
+
+static ExportJob* export_job_create(struct MHD_Connection *connection, int columnar, int gzip) {
+    ExportJob *job = mem_calloc(MEM_RESPONSE, 1, sizeof(ExportJob));
+    if (!job) return NULL;
+    job->connection = connection;
+    job->columnar = columnar;
+    job->gzip = gzip;
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->space, NULL);
+    
+    for (int i = 0; i < EXPORT_QUEUE_CHUNKS; i++) {
+        job->chunks[i] = mem_alloc(MEM_RESPONSE, sizeof(ExportChunk));
+        if (!job->chunks[i]) {
+            for (int j = 0; j < i; j++) mem_free(job->chunks[j]);
+            pthread_mutex_destroy(&job->lock);
+            pthread_cond_destroy(&job->space);
+            mem_free(job);
+            return NULL;
+        }
+        job->chunks[i]->length = 0;
+    }
+    return job;
+}
+
+static void export_job_free(ExportJob *job) {
+    for (int i = 0; i < EXPORT_QUEUE_CHUNKS; i++) mem_free(job->chunks[i]);
+    pthread_mutex_destroy(&job->lock);
+    pthread_cond_destroy(&job->space);
+    mem_free(job->rows);
+    mem_free(job);
+    atomic_fetch_sub(&export_running, 1);
+}
+
+// Best first, in leaderboard order
+static int compare_export_row(const void *a, const void *b) {
+    const ExportRow *ra = a;
+    const ExportRow *rb = b;
+    if (ra->bucket != rb->bucket) return ra->bucket > rb->bucket ? -1 : 1;
+    if (ra->submitted_ms != rb->submitted_ms) return ra->submitted_ms < rb->submitted_ms ? -1 : 1;
+    return strcmp(ra->username, rb->username);
+}
+
+// End of the tie group starting at row i. Ranks and percentiles follow handle_rank:
+// a group ranks one past the rows above it, and half of it counts as below.
+static int export_tie_end(const ExportJob *job, int i) {
+    int end = i + 1;
+    while (end < job->row_count && job->rows[end].bucket == job->rows[i].bucket) end++;
+    return end;
+}
+
+// Queue the chunk being filled and wake the reader. Unless it is the last chunk,
+// then wait until fewer than EXPORT_QUEUE_CHUNKS are queued, so a slow client holds
+// back the encoder instead of piling up memory. Returns 0 once the response is gone.
+static int export_publish(ExportJob *job, int last) {
+    pthread_mutex_lock(&job->lock);
+    if (job->chunks[job->fill]->length > 0) {
+        job->count++;
+        job->fill = (job->fill + 1) % EXPORT_QUEUE_CHUNKS;
+    }
+    if (last) job->done = 1;
+    int resume = job->suspended;
+    job->suspended = 0;
+    pthread_mutex_unlock(&job->lock);
+    
+    // A suspended connection can't be closed, so it is still there to resume
+    if (resume) MHD_resume_connection(job->connection);
+    if (last) return 1;
+    
+    pthread_mutex_lock(&job->lock);
+    while (job->count == EXPORT_QUEUE_CHUNKS && !job->released) {
+        pthread_cond_wait(&job->space, &job->lock);
+    }
+    int alive = !job->released;
+    pthread_mutex_unlock(&job->lock);
+    
+    job->chunks[job->fill]->length = 0;
+    return alive;
+}
+
+// Append output bytes, queueing each chunk as it fills up
+static int export_emit(ExportJob *job, const unsigned char *bytes, size_t length) {
+    while (length > 0) {
+        ExportChunk *chunk = job->chunks[job->fill];
+        size_t n = EXPORT_CHUNK_SIZE - chunk->length;
+        if (n > length) n = length;
+        memcpy(chunk->data + chunk->length, bytes, n);
+        chunk->length += n;
+        bytes += n;
+        length -= n;
+        if (chunk->length == EXPORT_CHUNK_SIZE && !export_publish(job, 0)) return 0;
+    }
+    return 1;
+}
+
+// Pass the encoded bytes collected in raw on, through gzip if it was asked for
+static int export_flush_raw(ExportJob *job, int flush) {
+    if (!job->gzip) {
+        int ok = export_emit(job, job->raw, job->raw_length);
+        job->raw_length = 0;
+        return ok;
+    }
+    
+    unsigned char out[16384];
+    job->zstream.next_in = job->raw;
+    job->zstream.avail_in = (uInt)job->raw_length;
+    do {
+        job->zstream.next_out = out;
+        job->zstream.avail_out = sizeof(out);
+        if (deflate(&job->zstream, flush) == Z_STREAM_ERROR) return 0;
+        if (!export_emit(job, out, sizeof(out) - job->zstream.avail_out)) return 0;
+    } while (job->zstream.avail_out == 0);
+    job->raw_length = 0;
+    return 1;
+}
+
+static int export_write(ExportJob *job, const void *bytes, size_t length) {
+    const unsigned char *p = bytes;
+    while (length > 0) {
+        size_t n = sizeof(job->raw) - job->raw_length;
+        if (n > length) n = length;
+        memcpy(job->raw + job->raw_length, p, n);
+        job->raw_length += n;
+        p += n;
+        length -= n;
+        if (job->raw_length == sizeof(job->raw) && !export_flush_raw(job, Z_NO_FLUSH)) return 0;
+    }
+    return 1;
+}
+
+// CSV with a header row. Usernames are quoted when they need it; times are UTC.
+static int export_encode_csv(ExportJob *job) {
+    static const char header[] = "rank,username,score,total,percent,percentile,submitted_at\r\n";
+    if (!export_write(job, header, sizeof(header) - 1)) return 0;
+    
+    int n = job->row_count;
+    int group_end = 0, rank = 0;
+    double percentile = 0;
+    for (int i = 0; i < n; i++) {
+        if (i == group_end) {
+            group_end = export_tie_end(job, i);
+            rank = i + 1;
+            percentile = 100.0 * ((n - group_end) + 0.5 * (group_end - i)) / n;
+        }
+        const ExportRow *row = &job->rows[i];
+        
+        char username[MAX_USERNAME_LENGTH * 2 + 3];
+        size_t u = 0;
+        if (strpbrk(row->username, ",\"\r\n")) {
+            username[u++] = '"';
+            for (const char *c = row->username; *c; c++) {
+                if (*c == '"') username[u++] = '"';
+                username[u++] = *c;
+            }
+            username[u++] = '"';
+        } else {
+            u = strlen(row->username);
+            memcpy(username, row->username, u);
+        }
+        username[u] = '\0';
+        
+        time_t seconds = (time_t)(row->submitted_ms / 1000);
+        struct tm tm_utc;
+        gmtime_r(&seconds, &tm_utc);
+        
+        char line[MAX_USERNAME_LENGTH * 2 + 160];
+        int length = snprintf(line, sizeof(line), "%d,%s,%d,%d,%.1f,%.1f,%04d-%02d-%02dT%02d:%02d:%02d.%03dZ\r\n",
+                              rank, username, row->score, row->total, 100.0 * row->score / row->total, percentile,
+                              tm_utc.tm_year + 1900, tm_utc.tm_mon + 1, tm_utc.tm_mday,
+                              tm_utc.tm_hour, tm_utc.tm_min, tm_utc.tm_sec, (int)(row->submitted_ms % 1000));
+        if (!export_write(job, line, length)) return 0;
+    }
+    return 1;
+}
+
+static size_t export_put_varint(unsigned char *out, uint64_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (unsigned char)value;
+    return n;
+}
+
+static void export_put_u32(unsigned char *out, uint32_t value) {
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+    out[2] = (value >> 16) & 0xFF;
+    out[3] = (value >> 24) & 0xFF;
+}
+
+// Columnar form: blocks of up to EXPORT_BLOCK_ROWS rows laid out like the proctor
+// files: "RES1", rows, column count, (raw size, compressed size) per column, then
+// each column deflated on its own. Columns: varint length + username, then varint
+// score, total, rank and percentile (tenths of a percent), then submitted_ms as a
+// zigzag delta from the previous row of the block.
+static int export_encode_columnar(ExportJob *job) {
+    enum { COL_USERNAME, COL_SCORE, COL_TOTAL, COL_RANK, COL_PERCENTILE, COL_SUBMITTED, COL_COUNT };
+    unsigned char *columns[COL_COUNT] = {0};
+    size_t column_length[COL_COUNT];
+    uLong capacity = 0;
+    int ok = 1;
+    
+    for (int c = 0; ok && c < COL_COUNT; c++) {
+        size_t size = (size_t)EXPORT_BLOCK_ROWS * (c == COL_USERNAME ? MAX_USERNAME_LENGTH + 1 : 10);
+        columns[c] = mem_alloc(MEM_RESPONSE, size);
+        if (!columns[c]) ok = 0;
+        capacity += compressBound(size);
+    }
+    unsigned char *packed = ok ? mem_alloc(MEM_RESPONSE, capacity) : NULL;
+    if (!packed) ok = 0;
+    
+    int n = job->row_count;
+    int group_end = 0, rank = 0, percentile = 0;
+    for (int start = 0; ok && start < n; start += EXPORT_BLOCK_ROWS) {
+        int rows = n - start < EXPORT_BLOCK_ROWS ? n - start : EXPORT_BLOCK_ROWS;
+        memset(column_length, 0, sizeof(column_length));
+        int64_t previous = 0;
+        
+        for (int i = start; i < start + rows; i++) {
+            if (i == group_end) {
+                group_end = export_tie_end(job, i);
+                rank = i + 1;
+                percentile = (int)(1000.0 * ((n - group_end) + 0.5 * (group_end - i)) / n + 0.5);
+            }
+            const ExportRow *row = &job->rows[i];
+            size_t len = strlen(row->username);
+            column_length[COL_USERNAME] += export_put_varint(columns[COL_USERNAME] + column_length[COL_USERNAME], len);
+            memcpy(columns[COL_USERNAME] + column_length[COL_USERNAME], row->username, len);
+            column_length[COL_USERNAME] += len;
+            
+            column_length[COL_SCORE] += export_put_varint(columns[COL_SCORE] + column_length[COL_SCORE], row->score);
+            column_length[COL_TOTAL] += export_put_varint(columns[COL_TOTAL] + column_length[COL_TOTAL], row->total);
+            column_length[COL_RANK] += export_put_varint(columns[COL_RANK] + column_length[COL_RANK], rank);
+            column_length[COL_PERCENTILE] += export_put_varint(columns[COL_PERCENTILE] + column_length[COL_PERCENTILE],
+                                                               percentile);
+            int64_t delta = row->submitted_ms - previous;
+            previous = row->submitted_ms;
+            column_length[COL_SUBMITTED] += export_put_varint(columns[COL_SUBMITTED] + column_length[COL_SUBMITTED],
+                                                              ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+        }
+        
+        unsigned char header[12 + 8 * COL_COUNT];
+        memcpy(header, "RES1", 4);
+        export_put_u32(header + 4, rows);
+        export_put_u32(header + 8, COL_COUNT);
+        size_t offset = 0;
+        for (int c = 0; ok && c < COL_COUNT; c++) {
+            uLongf comp_len = capacity - offset;
+            if (compress2(packed + offset, &comp_len, columns[c], column_length[c], Z_BEST_SPEED) != Z_OK) {
+                ok = 0;
+                break;
+            }
+            export_put_u32(header + 12 + 8 * c, column_length[c]);
+            export_put_u32(header + 16 + 8 * c, comp_len);
+            offset += comp_len;
+        }
+        if (ok) ok = export_write(job, header, sizeof(header)) && export_write(job, packed, offset);
+    }
+    
+    for (int c = 0; c < COL_COUNT; c++) mem_free(columns[c]);
+    mem_free(packed);
+    return ok;
+}
+
+// Encoder thread. It runs at idle priority, so it only gets CPU that exam traffic
+// leaves over, and at most EXPORT_QUEUE_CHUNKS chunks ahead of the client.
+static void* export_thread(void *arg) {
+    ExportJob *job = arg;
+    
+    struct sched_param param = {0};
+    if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) != 0) {
+        setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);
+    }
+    
+    qsort(job->rows, job->row_count, sizeof(ExportRow), compare_export_row);
+    
+    int ok = 1;
+    if (job->gzip) {
+        ok = deflateInit2(&job->zstream, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+        job->zstream_ready = ok;
+    }
+    if (ok) ok = job->columnar ? export_encode_columnar(job) : export_encode_csv(job);
+    if (ok) ok = export_flush_raw(job, Z_FINISH) && export_publish(job, 1);
+    if (job->zstream_ready) deflateEnd(&job->zstream);
+    
+    pthread_mutex_lock(&job->lock);
+    int resume = 0;
+    if (!ok) {
+        job->failed = 1;
+        resume = job->suspended;
+        job->suspended = 0;
+    }
+    job->exited = 1;
+    int released = job->released;
+    pthread_mutex_unlock(&job->lock);
+    
+    if (resume) MHD_resume_connection(job->connection);
+    if (released) export_job_free(job);
+    return NULL;
+}
+
+// MHD content reader: hand out queued chunks. With nothing queued yet the connection
+// is suspended, not polled, until export_publish resumes it.
+static ssize_t export_reader(void *cls, uint64_t pos, char *buf, size_t max) {
+    ExportJob *job = cls;
+    (void)pos;
+    ssize_t result;
+    
+    pthread_mutex_lock(&job->lock);
+    if (job->failed) {
+        result = MHD_CONTENT_READER_END_WITH_ERROR;
+    } else if (job->count > 0) {
+        ExportChunk *chunk = job->chunks[job->head];
+        size_t n = chunk->length - job->head_offset;
+        if (n > max) n = max;
+        memcpy(buf, chunk->data + job->head_offset, n);
+        job->head_offset += n;
+        if (job->head_offset == chunk->length) {
+            job->head = (job->head + 1) % EXPORT_QUEUE_CHUNKS;
+            job->count--;
+            job->head_offset = 0;
+            pthread_cond_signal(&job->space);
+        }
+        result = (ssize_t)n;
+    } else if (job->done) {
+        result = MHD_CONTENT_READER_END_OF_STREAM;
+    } else {
+        job->suspended = 1;
+        MHD_suspend_connection(job->connection);
+        result = 0;
+    }
+    pthread_mutex_unlock(&job->lock);
+    return result;
+}
+
+// MHD is done with the response. The encoder may still be running (it stops at its
+// next chunk); whichever of the two finishes last frees the job.
+static void export_release(void *cls) {
+    ExportJob *job = cls;
+    pthread_mutex_lock(&job->lock);
+    job->released = 1;
+    pthread_cond_signal(&job->space);
+    int exited = job->exited;
+    pthread_mutex_unlock(&job->lock);
+    if (exited) export_job_free(job);
+}
+
+// Handle GET /api/admin/export?format=csv|columnar[&gzip=1]: every graded submission
+// in the log, streamed while it is encoded
+static enum MHD_Result handle_export(struct MHD_Connection *connection) {
+    const char *format = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "format");
+    const char *gzip_param = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "gzip");
+    int columnar;
+    if (!format || strcmp(format, "csv") == 0) {
+        columnar = 0;
+    } else if (strcmp(format, "columnar") == 0) {
+        columnar = 1;
+    } else {
+        return send_json(connection, MHD_HTTP_BAD_REQUEST, "{\"error\":\"format must be csv or columnar\"}");
+    }
+    int gzip = gzip_param && strcmp(gzip_param, "1") == 0;
+    
+    if (atomic_fetch_add(&export_running, 1) >= EXPORT_MAX_RUNNING) {
+        atomic_fetch_sub(&export_running, 1);
+        return send_json(connection, MHD_HTTP_SERVICE_UNAVAILABLE, "{\"error\":\"Too many exports running\"}");
+    }
+    
+    ExportJob *job = export_job_create(connection, columnar, gzip);
+    if (!job) {
+        atomic_fetch_sub(&export_running, 1);
+        return MHD_NO;
+    }
+    pthread_t thread;
+    if (!export_snapshot(job) || pthread_create(&thread, NULL, export_thread, job) != 0) {
+        export_job_free(job);
+        return MHD_NO;
+    }
+    pthread_detach(thread);
+    printf("Exporting %d results as %s%s\n", job->row_count, columnar ? "columnar" : "CSV", gzip ? " (gzip)" : "");
+    
+    struct MHD_Response *response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, EXPORT_CHUNK_SIZE,
+                                                                      export_reader, job, export_release);
+    if (!response) {
+        export_release(job);
+        return MHD_NO;
+    }
+    MHD_add_response_header(response, "Content-Type", columnar ? "application/octet-stream" : "text/csv; charset=utf-8");
+    MHD_add_response_header(response, "Content-Disposition",
+                            columnar ? "attachment; filename=\"results.col\"" : "attachment; filename=\"results.csv\"");
+    if (gzip) MHD_add_response_header(response, "Content-Encoding", "gzip");
+    MHD_add_response_header(response, "Cache-Control", "no-store");
+    MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
+    
+    enum MHD_Result ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+    MHD_destroy_response(response);
+    return ret;
+}
+
+// ===== Full-text search =====
+
+static uint32_t search_hash(const char *text, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Words are runs of letters, digits and non-ASCII bytes, compared case-insensitively.
+// Copies the next word of *text into word and returns its length (0 at the end).
+static size_t search_next_word(const char **text, char *word) {
+    const unsigned char *p = (const unsigned char*)*text;
+    while (*p && !isalnum(*p) && *p < 0x80) p++;
+    
+    size_t len = 0;
+    while (*p && (isalnum(*p) || *p >= 0x80)) {
+        if (len < SEARCH_MAX_TERM) word[len++] = (char)tolower(*p);
+        p++;
+    }
+    *text = (const char*)p;
+    return len;
+}
+
+// Slot of the term, or of the empty slot where it would go
+static uint32_t search_slot(const SearchIndex *index, const char *word, size_t len) {
+    uint32_t slot = search_hash(word, len) & index->mask;
+    while (index->terms[slot].text) {
+        const char *text = index->terms[slot].text;
+        if (strncmp(text, word, len) == 0 && text[len] == '\0') break;
+        slot = (slot + 1) & index->mask;
+    }
+    return slot;
+}
+
+static int search_grow_table(SearchIndex *index) {
+    uint32_t old_size = index->terms ? index->mask + 1 : 0;
+    uint32_t new_size = old_size ? old_size * 2 : 16384;
+    SearchTerm *old_terms = index->terms;
+    
+    index->terms = mem_calloc(MEM_SEARCH, new_size, sizeof(SearchTerm));
+    if (!index->terms) {
+        index->terms = old_terms;
+        return 0;
+    }
+    index->mask = new_size - 1;
+    for (uint32_t i = 0; i < old_size; i++) {
+        if (!old_terms[i].text) continue;
+        index->terms[search_slot(index, old_terms[i].text, strlen(old_terms[i].text))] = old_terms[i];
+    }
+    mem_free(old_terms);
+    return 1;
+}
+
+static int search_put_varint(SearchTerm *term, uint32_t value) {
+    if (term->length + 5 > term->capacity) {
+        size_t capacity = term->capacity ? term->capacity * 2 : 16;
+        uint8_t *postings = mem_realloc(MEM_SEARCH, term->postings, capacity);
+        if (!postings) return 0;
+        term->postings = postings;
+        term->capacity = capacity;
+    }
+    while (value >= 0x80) {
+        term->postings[term->length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    term->postings[term->length++] = (uint8_t)value;
+    return 1;
+}
+
+static uint32_t search_get_varint(const uint8_t **p) {
+    uint32_t value = 0;
+    int shift = 0;
+    while (**p & 0x80) {
+        value |= (uint32_t)(*(*p)++ & 0x7f) << shift;
+        shift += 7;
+    }
+    value |= (uint32_t)(*(*p)++) << shift;
+    return value;
+}
+
+// Tokenize one field, continuing the document's position count
+static int search_tokenize(SearchIndex *index, const char *text, SearchToken *tokens, int *count,
+                           uint32_t *position) {
+    char word[SEARCH_MAX_TERM];
+    size_t len;
+    
+    while ((len = search_next_word(&text, word)) > 0 && *count < SEARCH_MAX_DOC_TOKENS) {
+        uint32_t slot = search_slot(index, word, len);
+        if (!index->terms[slot].text) {
+            index->terms[slot].text = mem_strndup(MEM_SEARCH, word, len);
+            if (!index->terms[slot].text) return 0;
+            index->term_count++;
+        }
+        tokens[*count].term = slot;
+        tokens[*count].position = (*position)++;
+        (*count)++;
+    }
+    *position += SEARCH_FIELD_GAP;
+    return 1;
+}
+
+static int compare_search_token(const void *a, const void *b) {
+    const SearchToken *ta = a;
+    const SearchToken *tb = b;
+    if (ta->term != tb->term) return (ta->term > tb->term) - (ta->term < tb->term);
+    return (ta->position > tb->position) - (ta->position < tb->position);
+}
+
+// Append doc's postings for the term whose tokens are tokens[0..count)
+static int search_add_posting(SearchTerm *term, uint32_t doc, const SearchToken *tokens, int count) {
+    if (term->doc_count > 0 && term->doc_count % SEARCH_SKIP_INTERVAL == 0) {
+        if (term->skip_count == term->skip_capacity) {
+            uint32_t capacity = term->skip_capacity ? term->skip_capacity * 2 : 8;
+            SearchSkip *skips = mem_realloc(MEM_SEARCH, term->skips, capacity * sizeof(SearchSkip));
+            if (!skips) return 0;
+            term->skips = skips;
+            term->skip_capacity = capacity;
+        }
+        term->skips[term->skip_count].doc = term->last_doc;
+        term->skips[term->skip_count].offset = (uint32_t)term->length;
+        term->skip_count++;
+    }
+    
+    if (!search_put_varint(term, doc - term->last_doc) || !search_put_varint(term, (uint32_t)count)) return 0;
+    uint32_t previous = 0;
+    for (int i = 0; i < count; i++) {
+        if (!search_put_varint(term, tokens[i].position - previous)) return 0;
+        previous = tokens[i].position;
+    }
+    term->last_doc = doc;
+    term->doc_count++;
+    return 1;
+}
+
+// Build the inverted index over question_index. Documents are added in order, so
+// document deltas are never negative.
+static int search_build(void) {
+    memset(&search_index, 0, sizeof(search_index));
+    if (!search_grow_table(&search_index)) return 0;
+    
+    SearchToken *tokens = mem_alloc(MEM_SEARCH, SEARCH_MAX_DOC_TOKENS * sizeof(SearchToken));
+    if (!tokens) return 0;
+    
+    int64_t start = session_now_ms();
+    for (int doc = 0; doc < question_count; doc++) {
+        // Room for every new term this document can add, so slots stay valid within it
+        while ((search_index.term_count + SEARCH_MAX_DOC_TOKENS) * 2 > search_index.mask + 1) {
+            if (!search_grow_table(&search_index)) goto fail;
+        }
+        
+        const Question *q = question_index[doc];
+        int count = 0;
+        uint32_t position = 0;
+        if (!search_tokenize(&search_index, q->question, tokens, &count, &position)) goto fail;
+        for (int o = 0; o < 4; o++) {
+            if (!search_tokenize(&search_index, q->options[o], tokens, &count, &position)) goto fail;
+        }
+        if (!search_tokenize(&search_index, q->explanation, tokens, &count, &position)) goto fail;
+        
+        qsort(tokens, count, sizeof(SearchToken), compare_search_token);
+        for (int i = 0; i < count;) {
+            int run = i + 1;
+            while (run < count && tokens[run].term == tokens[i].term) run++;
+            if (!search_add_posting(&search_index.terms[tokens[i].term], (uint32_t)doc, tokens + i, run - i)) {
+                goto fail;
+            }
+            i = run;
+        }
+    }
+    mem_free(tokens);
+    
+    // Postings are final: give back the slack from doubling
+    for (uint32_t i = 0; i <= search_index.mask; i++) {
+        SearchTerm *term = &search_index.terms[i];
+        if (!term->text) continue;
+        uint8_t *postings = mem_realloc(MEM_SEARCH, term->postings, term->length);
+        if (postings) term->postings = postings;
+        search_index.posting_bytes += term->length;
+    }
+    search_index.doc_count = (uint32_t)question_count;
+    
+    printf("Search index: %u terms over %u questions, %zu KB of postings, built in %lld ms\n",
+           search_index.term_count, search_index.doc_count, search_index.posting_bytes / 1024,
+           (long long)(session_now_ms() - start));
+    return 1;
+
+fail:
+    mem_free(tokens);
+    printf("Out of memory building the search index\n");
+    return 0;
+}
+
+static void search_free(void) {
+    if (!search_index.terms) return;
+    for (uint32_t i = 0; i <= search_index.mask; i++) {
+        SearchTerm *term = &search_index.terms[i];
+        if (!term->text) continue;
+        mem_free(term->text);
+        mem_free(term->postings);
+        mem_free(term->skips);
+    }
+    mem_free(search_index.terms);
+    memset(&search_index, 0, sizeof(search_index));
+}
+
+// Move to the next posting; returns 0 at the end of the list
+static int search_cursor_next(SearchCursor *cursor) {
+    const SearchTerm *term = cursor->term;
+    if (cursor->started) {
+        // Step over the current document's positions
+        const uint8_t *p = cursor->positions;
+        for (uint32_t i = 0; i < cursor->position_count; i++) search_get_varint(&p);
+        cursor->offset = (size_t)(p - term->postings);
+    }
+    if (cursor->offset >= term->length) return 0;
+    
+    const uint8_t *p = term->postings + cursor->offset;
+    cursor->doc = (cursor->started ? cursor->doc : 0) + search_get_varint(&p);
+    cursor->position_count = search_get_varint(&p);
+    cursor->positions = p;
+    cursor->started = 1;
+    return 1;
+}
+
+// Advance to the first document >= target, jumping over whole blocks via the skips
+static int search_cursor_seek(SearchCursor *cursor, uint32_t target) {
+    if (cursor->started && cursor->doc >= target) return 1;
+    
+    const SearchTerm *term = cursor->term;
+    int lo = 0, hi = (int)term->skip_count - 1, best = -1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (term->skips[mid].doc < target) {
+            best = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    if (best >= 0 && (!cursor->started || term->skips[best].offset > cursor->offset)) {
+        cursor->offset = term->skips[best].offset;
+        cursor->doc = term->skips[best].doc;
+        cursor->started = 1;
+        cursor->position_count = 0;
+        cursor->positions = term->postings + cursor->offset;
+    }
+    
+    while (!cursor->started || cursor->doc < target) {
+        if (!search_cursor_next(cursor)) return 0;
+    }
+    return 1;
+}
+
+static int search_cursor_positions(const SearchCursor *cursor, uint32_t *out) {
+    const uint8_t *p = cursor->positions;
+    uint32_t position = 0;
+    for (uint32_t i = 0; i < cursor->position_count; i++) {
+        position += search_get_varint(&p);
+        out[i] = position;
+    }
+    return (int)cursor->position_count;
+}
+
+// All cursors sit on the same document: check that every phrase clause's words
+// appear at consecutive positions
+static int search_phrases_match(SearchCursor *cursors, int count, uint32_t *scratch) {
+    for (int i = 0; i < count; i++) {
+        if (cursors[i].phrase_offset != 0) continue;
+        
+        // cursors[i] starts a clause; its other words follow it in the array
+        int words = 1;
+        while (i + words < count && cursors[i + words].clause == cursors[i].clause) words++;
+        if (words == 1) continue;
+        
+        uint32_t *first = scratch;
+        int first_count = search_cursor_positions(&cursors[i], first);
+        uint32_t *other = scratch + SEARCH_MAX_DOC_TOKENS;
+        int matched = 0;
+        
+        for (int f = 0; f < first_count && !matched; f++) {
+            matched = 1;
+            for (int w = 1; w < words && matched; w++) {
+                int other_count = search_cursor_positions(&cursors[i + w], other);
+                uint32_t want = first[f] + (uint32_t)cursors[i + w].phrase_offset;
+                matched = 0;
+                for (int o = 0; o < other_count && other[o] <= want; o++) {
+                    if (other[o] == want) matched = 1;
+                }
+            }
+        }
+        if (!matched) return 0;
+    }
+    return 1;
+}
+
+// Parse a query into cursors: bare words are separate clauses, words inside double
+// quotes form one phrase clause. Returns the number of cursors, 0 if some word is
+// not in the index (nothing can match), -1 if the query has no words or too many.
+static int search_parse_query(const char *query, SearchCursor *cursors) {
+    int count = 0, clause = 0, in_phrase = 0, phrase_offset = 0;
+    const char *p = query;
+    
+    while (*p) {
+        if (*p == '"') {
+            in_phrase = !in_phrase;
+            if (phrase_offset > 0) clause++;
+            phrase_offset = 0;
+            p++;
+            continue;
+        }
+        
+        const char *word_start = p;
+        while (*p && *p != '"' && !isalnum((unsigned char)*p) && (unsigned char)*p < 0x80) p++;
+        if (p != word_start) continue;
+        
+        char word[SEARCH_MAX_TERM];
+        const char *end = p;
+        while (*end && *end != '"' && (isalnum((unsigned char)*end) || (unsigned char)*end >= 0x80)) end++;
+        size_t len = 0;
+        for (const char *c = p; c < end && len < SEARCH_MAX_TERM; c++) word[len++] = (char)tolower((unsigned char)*c);
+        p = end;
+        
+        if (count == SEARCH_MAX_QUERY_TERMS) return -1;
+        uint32_t slot = search_slot(&search_index, word, len);
+        if (!search_index.terms[slot].text) return 0;
+        
+        memset(&cursors[count], 0, sizeof(SearchCursor));
+        cursors[count].term = &search_index.terms[slot];
+        cursors[count].clause = clause;
+        cursors[count].phrase_offset = in_phrase ? phrase_offset++ : 0;
+        if (!in_phrase) clause++;
+        count++;
+    }
+    return count > 0 ? count : -1;
+}
+
+static int compare_cursor_frequency(const void *a, const void *b) {
+    uint32_t da = (*(SearchCursor* const*)a)->term->doc_count;
+    uint32_t db = (*(SearchCursor* const*)b)->term->doc_count;
+    return (da > db) - (da < db);
+}
+
+// Documents matching every clause, in id order. Returns the total match count and
+// stores up to limit of them in results.
+static int search_query(SearchCursor *cursors, int count, int *results, int limit, uint32_t *scratch) {
+    // Intersect using the rarest list to propose candidates; phrases are checked on
+    // the original (clause-ordered) cursors
+    SearchCursor *order[SEARCH_MAX_QUERY_TERMS];
+    for (int i = 0; i < count; i++) order[i] = &cursors[i];
+    qsort(order, count, sizeof(SearchCursor*), compare_cursor_frequency);
+    
+    int total = 0;
+    if (!search_cursor_next(order[0])) return 0;
+    uint32_t candidate = order[0]->doc;
+    
+    for (;;) {
+        int aligned = 1;
+        for (int i = 1; i < count; i++) {
+            if (!search_cursor_seek(order[i], candidate)) return total;
+            if (order[i]->doc != candidate) {
+                candidate = order[i]->doc;
+                aligned = 0;
+                break;
+            }
+        }
+        
+        if (aligned) {
+            if (search_phrases_match(cursors, count, scratch)) {
+                if (total < limit) results[total] = (int)candidate;
+                total++;
+            }
+            candidate++;
+        }
+        if (!search_cursor_seek(order[0], candidate)) return total;
+        candidate = order[0]->doc;
+    }
+}
+
+// Handle GET /api/admin/search?q=...[&limit=N]
+static enum MHD_Result handle_search(struct MHD_Connection *connection) {
+    const char *query = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "q");
+    const char *limit_param = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "limit");
+    int limit = limit_param ? atoi(limit_param) : SEARCH_DEFAULT_LIMIT;
+    if (limit < 1) limit = 1;
+    if (limit > 1000) limit = 1000;
+    if (!query) {
+        return send_json(connection, MHD_HTTP_BAD_REQUEST, "{\"error\":\"Missing q\"}");
+    }
+    
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    SearchCursor cursors[SEARCH_MAX_QUERY_TERMS];
+    int count = search_index.terms ? search_parse_query(query, cursors) : 0;
+    if (count < 0) {
+        return send_json(connection, MHD_HTTP_BAD_REQUEST, "{\"error\":\"Query needs 1 to 16 words\"}");
+    }
+    
+    int *results = mem_alloc(MEM_REQUEST, limit * sizeof(int));
+    uint32_t *scratch = mem_alloc(MEM_REQUEST, 2 * SEARCH_MAX_DOC_TOKENS * sizeof(uint32_t));
+    if (!results || !scratch) {
+        mem_free(results);
+        mem_free(scratch);
+        return MHD_NO;
+    }
+    
+    TRACE_BEGIN("search_query");
+    int total = count > 0 ? search_query(cursors, count, results, limit, scratch) : 0;
+    TRACE_END("search_query");
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double took_us = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3;
+    
+    int shown = total < limit ? total : limit;
+    size_t size = (size_t)shown * (MAX_QUESTION_LENGTH * 6 + 32) + strlen(query) * 6 + 128;
+    char *json = mem_alloc(MEM_RESPONSE, size);
+    if (!json) {
+        mem_free(results);
+        mem_free(scratch);
+        return MHD_NO;
+    }
+    
+    size_t offset = snprintf(json, size, "{\"query\":\"");
+    offset = json_append_escaped(json, size, offset, query);
+    offset += snprintf(json + offset, size - offset, "\",\"total\":%d,\"took_us\":%.1f,\"results\":[", total, took_us);
+    for (int i = 0; i < shown; i++) {
+        const Question *q = question_index[results[i]];
+        offset += snprintf(json + offset, size - offset, "%s{\"id\":%d,\"text\":\"", i > 0 ? "," : "", q->id);
+        offset = json_append_escaped(json, size, offset, q->question);
+        offset += snprintf(json + offset, size - offset, "\"}");
+    }
+    snprintf(json + offset, size - offset, "]}");
+    
+    enum MHD_Result ret = send_json(connection, MHD_HTTP_OK, json);
+    mem_free(json);
+    mem_free(results);
+    mem_free(scratch);
+    return ret;
+}
+
+// ===== Near-duplicate detection =====
+
+// Word 3-shingles of the question and its options, hashed to 32 bits
+static int dedup_shingles(const Question *q, uint32_t *shingles, int max_shingles) {
+    const char *fields[5] = { q->question, q->options[0], q->options[1], q->options[2], q->options[3] };
+    uint64_t window[DEDUP_SHINGLE_WORDS] = { 0 };
+    int words = 0, count = 0;
+    char word[SEARCH_MAX_TERM];
+    size_t len;
+    
+    for (int f = 0; f < 5; f++) {
+        const char *text = fields[f];
+        while ((len = search_next_word(&text, word)) > 0) {
+            uint64_t hash = 14695981039346656037ULL;
+            for (size_t i = 0; i < len; i++) {
+                hash ^= (unsigned char)word[i];
+                hash *= 1099511628211ULL;
+            }
+            memmove(window, window + 1, (DEDUP_SHINGLE_WORDS - 1) * sizeof(uint64_t));
+            window[DEDUP_SHINGLE_WORDS - 1] = hash;
+            if (++words < DEDUP_SHINGLE_WORDS || count == max_shingles) continue;
+            
+            uint64_t shingle = 0;
+            for (int i = 0; i < DEDUP_SHINGLE_WORDS; i++) shingle = shingle * 0x100000001b3ULL + window[i];
+            shingles[count++] = (uint32_t)(shingle ^ (shingle >> 32));
+        }
+    }
+    
+    // Shorter than one shingle: use the words seen as a single shingle
+    if (count == 0 && words > 0) {
+        uint64_t shingle = 0;
+        for (int i = 0; i < DEDUP_SHINGLE_WORDS; i++) shingle = shingle * 0x100000001b3ULL + window[i];
+        shingles[count++] = (uint32_t)(shingle ^ (shingle >> 32));
+    }
+    return count;
+}
+
+// MinHash kernel: for every shingle, DEDUP_HASHES independent hashes and a running
+// minimum. The inner loop is branch-free 32-bit arithmetic over arrays so it
+// vectorizes; the AVX2 clone is picked at run time where the CPU has it.
+__attribute__((target_clones("avx2", "default")))
+static void dedup_minhash(const uint32_t *restrict shingles, int count, const uint32_t *restrict seeds,
+                          uint32_t *restrict signature) {
+    uint32_t minimum[DEDUP_HASHES];
+    for (int i = 0; i < DEDUP_HASHES; i++) minimum[i] = UINT32_MAX;
+    
+    for (int s = 0; s < count; s++) {
+        uint32_t x = shingles[s];
+        for (int i = 0; i < DEDUP_HASHES; i++) {
+            uint32_t h = (x ^ seeds[i]) * 0x9e3779b1u;
+            h ^= h >> 15;
+            h *= 0x85ebca77u;
+            h ^= h >> 13;
+            minimum[i] = h < minimum[i] ? h : minimum[i];
+        }
+    }
+    memcpy(signature, minimum, sizeof(minimum));
+}
+
+static void* dedup_signature_thread(void *arg) {
+    DedupJob *job = arg;
+    DedupRun *run = job->run;
+    uint32_t *shingles = mem_alloc(MEM_QUESTIONS, DEDUP_MAX_SHINGLES * sizeof(uint32_t));
+    if (!shingles) {
+        job->failed = 1;
+        return NULL;
+    }
+    
+    for (int d = job->first; d < job->last; d++) {
+        int count = dedup_shingles(run->docs[d], shingles, DEDUP_MAX_SHINGLES);
+        run->empty[d] = count == 0;
+        dedup_minhash(shingles, count, run->seeds, run->signatures + (size_t)d * DEDUP_HASHES);
+    }
+    mem_free(shingles);
+    return NULL;
+}
+
+// LSD radix sort on the key, 16 bits per pass. Stable, so equal keys stay in
+// document order. Returns whichever buffer holds the result.
+static DedupBandEntry* dedup_sort_band(DedupBandEntry *entries, DedupBandEntry *scratch, int count,
+                                       uint32_t *histogram) {
+    for (int shift = 0; shift < 64; shift += 16) {
+        memset(histogram, 0, 65536 * sizeof(uint32_t));
+        for (int i = 0; i < count; i++) histogram[(entries[i].key >> shift) & 0xffff]++;
+        uint32_t total = 0;
+        for (int b = 0; b < 65536; b++) {
+            uint32_t n = histogram[b];
+            histogram[b] = total;
+            total += n;
+        }
+        for (int i = 0; i < count; i++) scratch[histogram[(entries[i].key >> shift) & 0xffff]++] = entries[i];
+        
+        DedupBandEntry *swap = entries;
+        entries = scratch;
+        scratch = swap;
+    }
+    return entries;
+}
+
+static int dedup_add_pair(DedupJob *job, uint32_t a, uint32_t b, float similarity) {
+    if (job->pair_count == job->pair_capacity) {
+        int capacity = job->pair_capacity ? job->pair_capacity * 2 : 256;
+        DedupPair *pairs = mem_realloc(MEM_QUESTIONS, job->pairs, capacity * sizeof(DedupPair));
+        if (!pairs) return 0;
+        job->pairs = pairs;
+        job->pair_capacity = capacity;
+    }
+    job->pairs[job->pair_count].a = a;
+    job->pairs[job->pair_count].b = b;
+    job->pairs[job->pair_count].similarity = similarity;
+    job->pair_count++;
+    return 1;
+}
+
+// Candidate pair from band: keep it if this is the first band they share and their
+// estimated Jaccard similarity reaches the threshold
+static int dedup_check_pair(DedupJob *job, int band, uint32_t a, uint32_t b) {
+    DedupRun *run = job->run;
+    const uint32_t *sa = run->signatures + (size_t)a * DEDUP_HASHES;
+    const uint32_t *sb = run->signatures + (size_t)b * DEDUP_HASHES;
+    
+    for (int earlier = 0; earlier < band; earlier++) {
+        if (memcmp(sa + earlier * DEDUP_ROWS, sb + earlier * DEDUP_ROWS, DEDUP_ROWS * sizeof(uint32_t)) == 0) {
+            return 1; // Already considered in that band
+        }
+    }
+    
+    int equal = 0;
+    for (int i = 0; i < DEDUP_HASHES; i++) equal += sa[i] == sb[i];
+    float similarity = (float)equal / DEDUP_HASHES;
+    if (similarity < run->threshold) return 1;
+    return dedup_add_pair(job, a, b, similarity);
+}
+
+// Bands are handed out to threads one at a time. Each band sorts (band hash, doc)
+// and compares documents within runs of equal hashes. Documents without words all
+// share the all-UINT32_MAX signature, so they are left out rather than paired at 1.0.
+static void* dedup_band_thread(void *arg) {
+    DedupJob *job = arg;
+    DedupRun *run = job->run;
+    
+    // Claim a band before allocating, so a thread with nothing to do costs nothing
+    int band = atomic_fetch_add(&run->next_band, 1);
+    if (band >= DEDUP_BANDS) {
+        return NULL;
+    }
+    DedupBandEntry *buffers = mem_alloc(MEM_QUESTIONS, 2 * (size_t)run->count * sizeof(DedupBandEntry));
+    uint32_t *histogram = mem_alloc(MEM_QUESTIONS, 65536 * sizeof(uint32_t));
+    if (!buffers || !histogram) {
+        mem_free(buffers);
+        mem_free(histogram);
+        job->failed = 1;
+        return NULL;
+    }
+    
+    for (; !job->failed && band < DEDUP_BANDS; band = atomic_fetch_add(&run->next_band, 1)) {
+        DedupBandEntry *entries = buffers;
+        int signed_docs = 0;
+        for (int d = 0; d < run->count; d++) {
+            if (run->empty[d]) continue;
+            const uint32_t *rows = run->signatures + (size_t)d * DEDUP_HASHES + band * DEDUP_ROWS;
+            uint64_t key = 14695981039346656037ULL;
+            for (int r = 0; r < DEDUP_ROWS; r++) key = (key ^ rows[r]) * 1099511628211ULL;
+            entries[signed_docs].key = key;
+            entries[signed_docs].doc = (uint32_t)d;
+            signed_docs++;
+        }
+        entries = dedup_sort_band(entries, buffers + run->count, signed_docs, histogram);
+        
+        for (int start = 0; start < signed_docs && !job->failed;) {
+            int end = start + 1;
+            while (end < signed_docs && entries[end].key == entries[start].key) end++;
+            
+            // Very large buckets compare each member against the first
+            // DEDUP_MAX_BUCKET only, so one boilerplate cluster stays linear
+            int anchors = end - start < DEDUP_MAX_BUCKET ? end - start : DEDUP_MAX_BUCKET;
+            for (int i = start; i < start + anchors && !job->failed; i++) {
+                for (int j = i + 1; j < end; j++) {
+                    if (!dedup_check_pair(job, band, entries[i].doc, entries[j].doc)) {
+                        job->failed = 1;
+                        break;
+                    }
+                }
+            }
+            start = end;
+        }
+    }
+    mem_free(buffers);
+    mem_free(histogram);
+    return NULL;
+}
+
+static int compare_dedup_pair(const void *a, const void *b) {
+    const DedupPair *pa = a;
+    const DedupPair *pb = b;
+    if (pa->similarity != pb->similarity) return pa->similarity < pb->similarity ? 1 : -1;
+    if (pa->a != pb->a) return (pa->a > pb->a) - (pa->a < pb->a);
+    return (pa->b > pb->b) - (pa->b < pb->b);
+}
+
+// Find pairs of questions in the loaded bank (every line of questions.txt,
+// including ones whose id repeats) with estimated similarity >= threshold, using
+// all cores. Prints up to max_print pairs (all if negative); returns the number
+// of pairs or -1.
+static int dedup_report(float threshold, int max_print) {
+    DedupRun run;
+    memset(&run, 0, sizeof(run));
+    run.threshold = threshold;
+    for (Question *q = question_head; q; q = q->next) run.count++;
+    if (run.count < 2) return 0;
+    
+    int64_t start = session_now_ms();
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int thread_count = cpus < 1 ? 1 : cpus > DEDUP_MAX_THREADS ? DEDUP_MAX_THREADS : (int)cpus;
+    
+    run.docs = mem_alloc(MEM_QUESTIONS, run.count * sizeof(Question*));
+    run.signatures = mem_alloc(MEM_QUESTIONS, (size_t)run.count * DEDUP_HASHES * sizeof(uint32_t));
+    run.empty = mem_alloc(MEM_QUESTIONS, run.count);
+    DedupJob *jobs = mem_calloc(MEM_QUESTIONS, thread_count, sizeof(DedupJob));
+    pthread_t threads[DEDUP_MAX_THREADS];
+    int pairs = -1;
+    if (!run.docs || !run.signatures || !run.empty || !jobs) goto done;
+    
+    int d = 0;
+    for (Question *q = question_head; q; q = q->next) run.docs[d++] = q;
+    
+    // Fixed seeds so signatures and results are reproducible between runs
+    uint32_t seed = 0x2545f491u;
+    for (int i = 0; i < DEDUP_HASHES; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        run.seeds[i] = seed;
+    }
+    
+    int failed = 0;
+    for (int phase = 0; phase < 2 && !failed; phase++) {
+        // There are only DEDUP_BANDS bands to hand out in the second phase
+        int phase_threads = phase == 1 && thread_count > DEDUP_BANDS ? DEDUP_BANDS : thread_count;
+        int started = 0;
+        for (int t = 0; t < phase_threads; t++) {
+            jobs[t].run = &run;
+            jobs[t].first = (int)((long long)run.count * t / thread_count);
+            jobs[t].last = (int)((long long)run.count * (t + 1) / thread_count);
+            if (pthread_create(&threads[t], NULL, phase == 0 ? dedup_signature_thread : dedup_band_thread,
+                               &jobs[t]) != 0) {
+                failed = 1;
+                break;
+            }
+            started++;
+        }
+        for (int t = 0; t < started; t++) {
+            pthread_join(threads[t], NULL);
+            if (jobs[t].failed) failed = 1;
+        }
+    }
+    
+    int total = 0;
+    for (int t = 0; t < thread_count; t++) total += jobs[t].pair_count;
+    DedupPair *all = failed ? NULL : mem_alloc(MEM_QUESTIONS, (total + 1) * sizeof(DedupPair));
+    if (all) {
+        int n = 0;
+        for (int t = 0; t < thread_count; t++) {
+            if (jobs[t].pair_count) memcpy(all + n, jobs[t].pairs, jobs[t].pair_count * sizeof(DedupPair));
+            n += jobs[t].pair_count;
+        }
+        qsort(all, total, sizeof(DedupPair), compare_dedup_pair);
+        
+        printf("Near-duplicate check: %d questions, %d pairs at similarity >= %.2f (%d threads, %lld ms)\n",
+               run.count, total, threshold, thread_count, (long long)(session_now_ms() - start));
+        for (int i = 0; i < total && (max_print < 0 || i < max_print); i++) {
+            const Question *qa = run.docs[all[i].a];
+            const Question *qb = run.docs[all[i].b];
+            printf("  %.2f  question %d ~ question %d%s: %.60s\n", all[i].similarity, qa->id, qb->id,
+                   qa->id == qb->id ? " (same id)" : "", qa->question);
+        }
+        if (max_print >= 0 && total > max_print) {
+            printf("  ... %d more; run ./server --dedup for the full list\n", total - max_print);
+        }
+        mem_free(all);
+        pairs = total;
+    }
+    
+done:
+    if (pairs < 0) printf("Near-duplicate check failed\n");
+    if (jobs) {
+        for (int t = 0; t < thread_count; t++) mem_free(jobs[t].pairs);
+    }
+    mem_free(jobs);
+    mem_free(run.signatures);
+    mem_free(run.empty);
+    mem_free(run.docs);
+    return pairs;
+}
+
+// ===== Sampling profiler =====
+
+// SIGPROF handler: copy this thread's stack into the next free sample. backtrace() is
+// primed at startup so it doesn't load libgcc from inside a signal handler.
+static void profile_signal(int sig) {
+    (void)sig;
+    int saved_errno = errno;
+    
+    atomic_fetch_add(&profiler.in_handler, 1);
+    if (atomic_load(&profiler.active)) {
+        unsigned int index = atomic_fetch_add(&profiler.next, 1);
+        if (index < PROFILE_MAX_SAMPLES) {
+            ProfileSample *sample = &profiler.samples[index];
+            sample->depth = backtrace(sample->frames, PROFILE_MAX_DEPTH);
+        } else {
+            atomic_fetch_add(&profiler.dropped, 1);
+        }
+    }
+    atomic_fetch_sub(&profiler.in_handler, 1);
+    
+    errno = saved_errno;
+}
+
+static void profile_init(void) {
+    void *frames[2];
+    backtrace(frames, 2);
+}
+
+// Start sampling this process; returns 0 if a profile is already running
+static int profile_start(void) {
+    int expected = 0;
+    if (!atomic_compare_exchange_strong(&profiler.busy, &expected, 1)) return 0;
+    
+    profiler.samples = mem_alloc(MEM_DEBUG, PROFILE_MAX_SAMPLES * sizeof(ProfileSample));
+    if (!profiler.samples) {
+        atomic_store(&profiler.busy, 0);
+        return 0;
+    }
+    atomic_store(&profiler.next, 0);
+    atomic_store(&profiler.dropped, 0);
+    atomic_store(&profiler.active, 1);
+    
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = profile_signal;
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGPROF, &action, NULL);
+    
+    // ITIMER_PROF counts CPU time of the whole process, so busy threads get sampled
+    struct itimerval timer = { { 0, 1000000 / PROFILE_HZ }, { 0, 1000000 / PROFILE_HZ } };
+    setitimer(ITIMER_PROF, &timer, NULL);
+    return 1;
+}
+
+// Stop the timer and wait out handlers that are still writing a sample
+static void profile_stop(void) {
+    struct itimerval off;
+    memset(&off, 0, sizeof(off));
+    setitimer(ITIMER_PROF, &off, NULL);
+    
+    atomic_store(&profiler.active, 0);
+    while (atomic_load(&profiler.in_handler) > 0) {
+        sched_yield();
+    }
+    signal(SIGPROF, SIG_IGN);
+}
+
+static void profile_release(void) {
+    mem_free(profiler.samples);
+    profiler.samples = NULL;
+    atomic_store(&profiler.busy, 0);
+}
+
+static unsigned int profile_stack_hash(const ProfileSample *sample) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (int i = PROFILE_SKIP_FRAMES; i < sample->depth; i++) {
+        hash ^= (uint64_t)(uintptr_t)sample->frames[i];
+        hash *= 1099511628211ULL;
+    }
+    return (unsigned int)(hash ^ (hash >> 32));
+}
+
+static int profile_same_stack(const ProfileSample *a, const ProfileSample *b) {
+    return a->depth == b->depth &&
+           memcmp(a->frames, b->frames, a->depth * sizeof(void*)) == 0;
+}
+
+// Name a frame: symbol if the dynamic symbol table has one (link with -rdynamic),
+// otherwise module+offset, which addr2line can resolve
+static void profile_frame_name(void *pc, int is_return_address, char *out, size_t size) {
+    // A return address points after the call; step back into the calling instruction
+    uintptr_t address = (uintptr_t)pc - (is_return_address ? 1 : 0);
+    Dl_info info;
+    int found = dladdr((void*)address, &info);
+    
+    if (found && info.dli_sname) {
+        snprintf(out, size, "%s", info.dli_sname);
+    } else if (found && info.dli_fname) {
+        const char *module = strrchr(info.dli_fname, '/');
+        snprintf(out, size, "%s+0x%lx", module ? module + 1 : info.dli_fname,
+                 (unsigned long)(address - (uintptr_t)info.dli_fbase));
+    } else {
+        snprintf(out, size, "0x%lx", (unsigned long)address);
+    }
+}
+
+static int compare_profile_folded(const void *a, const void *b) {
+    return strcmp(((const ProfileStack*)a)->folded, ((const ProfileStack*)b)->folded);
+}
+
+static int compare_profile_count(const void *a, const void *b) {
+    const ProfileStack *sa = a;
+    const ProfileStack *sb = b;
+    return (sb->count > sa->count) - (sb->count < sa->count);
+}
+
+// "root;...;leaf" for one sample, outermost frame first
+static char* profile_render_stack(const ProfileSample *sample) {
+    size_t size = (size_t)(sample->depth - PROFILE_SKIP_FRAMES) * 256 + 1;
+    char *out = mem_alloc(MEM_DEBUG, size);
+    if (!out) return NULL;
+    
+    size_t length = 0;
+    out[0] = '\0';
+    for (int f = sample->depth - 1; f >= PROFILE_SKIP_FRAMES; f--) {
+        char frame[256];
+        profile_frame_name(sample->frames[f], f > PROFILE_SKIP_FRAMES, frame, sizeof(frame));
+        length += snprintf(out + length, size - length, "%s%s", frame, f > PROFILE_SKIP_FRAMES ? ";" : "");
+    }
+    return out;
+}
+
+// Aggregate identical stacks and render them in folded form ("root;...;leaf count"),
+// hottest first. Stacks are merged by address first, then again by name, since
+// different addresses in one function fold to the same line. Returns a malloc'd string.
+static char* profile_fold(unsigned int sample_count, size_t *length_out) {
+    unsigned int capacity = 1;
+    while (capacity < sample_count * 2) capacity <<= 1;
+    
+    int *table = mem_alloc(MEM_DEBUG, capacity * sizeof(int));
+    ProfileStack *stacks = mem_alloc(MEM_DEBUG, (sample_count + 1) * sizeof(ProfileStack));
+    if (!table || !stacks) {
+        mem_free(table);
+        mem_free(stacks);
+        return NULL;
+    }
+    memset(table, -1, capacity * sizeof(int));
+    
+    int stack_count = 0;
+    for (unsigned int i = 0; i < sample_count; i++) {
+        const ProfileSample *sample = &profiler.samples[i];
+        if (sample->depth <= PROFILE_SKIP_FRAMES) continue;
+        
+        unsigned int slot = profile_stack_hash(sample) & (capacity - 1);
+        while (table[slot] >= 0 &&
+               !profile_same_stack(&profiler.samples[stacks[table[slot]].sample], sample)) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        if (table[slot] < 0) {
+            table[slot] = stack_count;
+            stacks[stack_count].sample = i;
+            stacks[stack_count].count = 0;
+            stack_count++;
+        }
+        stacks[table[slot]].count++;
+    }
+    mem_free(table);
+    
+    int rendered = 0;
+    for (int i = 0; i < stack_count; i++) {
+        stacks[i].folded = profile_render_stack(&profiler.samples[stacks[i].sample]);
+        if (stacks[i].folded) stacks[rendered++] = stacks[i];
+    }
+    
+    qsort(stacks, rendered, sizeof(ProfileStack), compare_profile_folded);
+    int merged = 0;
+    for (int i = 0; i < rendered; i++) {
+        if (merged > 0 && strcmp(stacks[merged - 1].folded, stacks[i].folded) == 0) {
+            stacks[merged - 1].count += stacks[i].count;
+            mem_free(stacks[i].folded);
+            continue;
+        }
+        stacks[merged++] = stacks[i];
+    }
+    qsort(stacks, merged, sizeof(ProfileStack), compare_profile_count);
+    
+    size_t size = 1;
+    for (int i = 0; i < merged; i++) size += strlen(stacks[i].folded) + 16;
+    
+    char *out = mem_alloc(MEM_DEBUG, size);
+    size_t length = 0;
+    for (int i = 0; i < merged; i++) {
+        if (out) length += snprintf(out + length, size - length, "%s %u\n", stacks[i].folded, stacks[i].count);
+        mem_free(stacks[i].folded);
+    }
+    mem_free(stacks);
+    
+    if (out) {
+        out[length] = '\0';
+        *length_out = length;
+    }
+    return out;
+}
+
+// Runs off the MHD thread: sample for the requested window, fold, then wake the request
+static void* profile_thread(void *arg) {
+    ProfileRequest *request = arg;
+    
+    struct timespec window = { request->seconds, 0 };
+    while (nanosleep(&window, &window) != 0 && errno == EINTR) {
+    }
+    profile_stop();
+    
+    unsigned int samples = atomic_load(&profiler.next);
+    if (samples > PROFILE_MAX_SAMPLES) samples = PROFILE_MAX_SAMPLES;
+    request->samples = samples;
+    request->dropped = atomic_load(&profiler.dropped);
+    request->output = profile_fold(samples, &request->output_length);
+    profile_release();
+    
+    // If the connection went away meanwhile, nobody is left to resume or free the request
+    int expected = PROFILE_RUNNING;
+    if (!atomic_compare_exchange_strong(&request->state, &expected, PROFILE_DONE)) {
+        mem_free(request->output);
+        mem_free(request);
+        return NULL;
+    }
+    MHD_resume_connection(request->connection);
+    return NULL;
+}
+
+// Handle GET /debug/profile?seconds=N. The connection is suspended while sampling
+// so the server keeps serving (and being profiled) meanwhile.
+static enum MHD_Result handle_profile(struct MHD_Connection *connection, void **con_cls) {
+    ProfileRequest *request = *con_cls;
+    
+    if (!request) {
+        const char *seconds_param = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "seconds");
+        int seconds = seconds_param ? atoi(seconds_param) : 10;
+        if (seconds < 1) seconds = 1;
+        if (seconds > PROFILE_MAX_SECONDS) seconds = PROFILE_MAX_SECONDS;
+        
+        request = mem_calloc(MEM_DEBUG, 1, sizeof(ProfileRequest));
+        if (!request) return MHD_NO;
+        request->connection = connection;
+        request->seconds = seconds;
+        
+        if (!profile_start()) {
+            mem_free(request);
+            return send_json(connection, MHD_HTTP_CONFLICT, "{\"error\":\"A profile is already running\"}");
+        }
+        
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, profile_thread, request) != 0) {
+            profile_stop();
+            profile_release();
+            mem_free(request);
+            return MHD_NO;
+        }
+        pthread_detach(thread);
+        
+        *con_cls = request;
+        printf("Profiling for %d seconds\n", seconds);
+        MHD_suspend_connection(connection);
+        return MHD_YES;
+    }
+    
+    if (atomic_load(&request->state) != PROFILE_DONE) return MHD_YES;
+    if (!request->output) return MHD_NO;
+    
+    struct MHD_Response *response = MHD_create_response_from_buffer_with_free_callback(request->output_length,
+                                                                                       request->output,
+                                                                                       mem_free_callback);
+    request->output = NULL;
+    if (!response) return MHD_NO;
+    
+    char header[32];
+    MHD_add_response_header(response, "Content-Type", "text/plain");
+    snprintf(header, sizeof(header), "%u", request->samples);
+    MHD_add_response_header(response, "X-Profile-Samples", header);
+    snprintf(header, sizeof(header), "%u", request->dropped);
+    MHD_add_response_header(response, "X-Profile-Dropped", header);
+    
+    enum MHD_Result ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+    MHD_destroy_response(response);
+    return ret;
+}
+
+// Route cleanup: free the request, or leave that to the sampling thread if it still runs
+static void profile_request_cleanup(void **con_cls) {
+    ProfileRequest *request = *con_cls;
+    if (!request) return;
+    
+    int expected = PROFILE_RUNNING;
+    if (!atomic_compare_exchange_strong(&request->state, &expected, PROFILE_ABANDONED)) {
+        mem_free(request->output);
+        mem_free(request);
+    }
+    *con_cls = NULL;
+}
+
+// ===== Request tracing =====
+
+// Shared so enabling tracing on one worker enables it on all. Must run before fork.
+static int trace_init(void) {
+    int inherited;
+    void *base = shared_state_map(SHARED_TRACE, sizeof(TraceConfig), 0, &inherited);
+    if (!base) return 0;
+    trace_config = base;
+    if (!inherited) atomic_store(&trace_config->sample_every, 1);
+    return 1;
+}
+
+static void trace_free(void) {
+    int count = atomic_load(&trace_ring_count);
+    if (count > TRACE_MAX_THREADS) count = TRACE_MAX_THREADS;
+    for (int i = 0; i < count; i++) {
+        mem_free(trace_rings[i]);
+        trace_rings[i] = NULL;
+    }
+    atomic_store(&trace_ring_count, 0);
+    
+    if (trace_config) {
+        shared_state_unmap(SHARED_TRACE, trace_config);
+        trace_config = NULL;
+    }
+}
+
+// Decide whether a new request is traced: off, or one in sample_every
+static int trace_should_sample(void) {
+    if (!trace_config || !atomic_load_explicit(&trace_config->enabled, memory_order_relaxed)) return 0;
+    unsigned int every = atomic_load_explicit(&trace_config->sample_every, memory_order_relaxed);
+    return atomic_fetch_add_explicit(&trace_config->counter, 1, memory_order_relaxed) % every == 0;
+}
+
+static int64_t trace_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Append to this thread's ring, registering the ring on first use. The ring has a
+// single writer; head is published after the event so readers can tell what's valid.
+static void trace_event(const char *name, char phase) {
+    static _Thread_local int ring_unavailable = 0;
+    
+    if (!trace_ring) {
+        if (ring_unavailable) return;
+        int index = atomic_fetch_add(&trace_ring_count, 1);
+        TraceRing *ring = index < TRACE_MAX_THREADS ? mem_calloc(MEM_DEBUG, 1, sizeof(TraceRing)) : NULL;
+        if (!ring) {
+            ring_unavailable = 1;
+            if (index < TRACE_MAX_THREADS) trace_rings[index] = NULL;
+            return;
+        }
+        ring->tid = (int)syscall(SYS_gettid);
+        trace_ring = ring;
+        atomic_store(&trace_rings[index], ring);
+    }
+    
+    uint64_t head = atomic_load_explicit(&trace_ring->head, memory_order_relaxed);
+    TraceEvent *event = &trace_ring->events[head & (TRACE_RING_SIZE - 1)];
+    event->name = name;
+    event->ts_ns = trace_now_ns();
+    event->phase = phase;
+    atomic_store_explicit(&trace_ring->head, head + 1, memory_order_release);
+}
+
+// Copy the events still in a ring. Anything the writer may have overwritten while
+// we copied is dropped by checking head again afterwards.
+static int trace_ring_snapshot(TraceRing *ring, TraceEvent *out) {
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t start = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+    
+    for (uint64_t i = start; i < head; i++) {
+        out[i - start] = ring->events[i & (TRACE_RING_SIZE - 1)];
+    }
+    
+    uint64_t head_after = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t valid_from = head_after > TRACE_RING_SIZE ? head_after - TRACE_RING_SIZE : 0;
+    if (valid_from <= start) return (int)(head - start);
+    if (valid_from >= head) return 0;
+    
+    int skip = (int)(valid_from - start);
+    memmove(out, out + skip, (head - valid_from) * sizeof(TraceEvent));
+    return (int)(head - valid_from);
+}
+
+// Handle GET /debug/trace: this process's rings as Chrome trace event JSON
+static enum MHD_Result handle_trace_dump(struct MHD_Connection *connection) {
+    int ring_count = atomic_load(&trace_ring_count);
+    if (ring_count > TRACE_MAX_THREADS) ring_count = TRACE_MAX_THREADS;
+    
+    TraceEvent *events = mem_alloc(MEM_DEBUG, TRACE_RING_SIZE * sizeof(TraceEvent));
+    size_t size = (size_t)ring_count * (TRACE_RING_SIZE * 160 + 128) + 64;
+    char *json = mem_alloc(MEM_RESPONSE, size);
+    if (!events || !json) {
+        mem_free(events);
+        mem_free(json);
+        return MHD_NO;
+    }
+    
+    int pid = (int)getpid();
+    size_t offset = snprintf(json, size, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    int first = 1;
+    
+    for (int r = 0; r < ring_count; r++) {
+        TraceRing *ring = atomic_load(&trace_rings[r]);
+        if (!ring) continue;
+        
+        offset += snprintf(json + offset, size - offset,
+                           "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+                           first ? "" : ",", pid, ring->tid, ring->tid);
+        first = 0;
+        
+        int count = trace_ring_snapshot(ring, events);
+        for (int i = 0; i < count; i++) {
+            offset += snprintf(json + offset, size - offset,
+                               ",{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lld.%03lld,\"pid\":%d,\"tid\":%d}",
+                               events[i].name, events[i].phase,
+                               (long long)(events[i].ts_ns / 1000), (long long)(events[i].ts_ns % 1000),
+                               pid, ring->tid);
+        }
+    }
+    snprintf(json + offset, size - offset, "]}");
+    mem_free(events);
+    
+    enum MHD_Result ret = send_json(connection, MHD_HTTP_OK, json);
+    mem_free(json);
+    return ret;
+}
+
+// Handle POST /debug/trace with enabled=0|1 and/or sample_every=N
+static enum MHD_Result handle_trace_config(struct MHD_Connection *connection,
+                                           const char *upload_data,
+                                           size_t *upload_data_size,
+                                           void **con_cls) {
+    int collected = collect_post_data(con_cls, upload_data, upload_data_size, MAX_POST_SIZE);
+    if (collected < 0) return MHD_NO;
+    if (collected > 0) return MHD_YES;
+    
+    ConnectionInfo *con_info = *con_cls;
+    char value[32];
+    
+    if (con_info->post_data && parse_form_value(con_info->post_data, "sample_every", value, sizeof(value))) {
+        int every = atoi(value);
+        if (every < 1) {
+            cleanup_connection_info(con_cls);
+            return send_json(connection, MHD_HTTP_BAD_REQUEST, "{\"error\":\"sample_every must be at least 1\"}");
+        }
+        atomic_store(&trace_config->sample_every, (unsigned int)every);
+    }
+    if (con_info->post_data && parse_form_value(con_info->post_data, "enabled", value, sizeof(value))) {
+        atomic_store(&trace_config->enabled, atoi(value) != 0);
+    }
+    cleanup_connection_info(con_cls);
+    
+    char json[96];
+    snprintf(json, sizeof(json), "{\"enabled\":%s,\"sample_every\":%u}",
+             atomic_load(&trace_config->enabled) ? "true" : "false",
+             atomic_load(&trace_config->sample_every));
+    printf("Tracing %s, sampling 1 in %u requests\n",
+           atomic_load(&trace_config->enabled) ? "enabled" : "disabled",
+           atomic_load(&trace_config->sample_every));
+    return send_json(connection, MHD_HTTP_OK, json);
+}
+
+// Handle GET /debug/memory: live, peak and per-request allocation figures per tag
+static enum MHD_Result handle_memory(struct MHD_Connection *connection) {
+    unsigned long long requests = atomic_load(&mem_requests);
+    double uptime = (session_now_ms() - mem_start_ms) / 1000.0;
+    if (uptime <= 0) uptime = 1e-3;
+    
+    // Resident set size, to compare with what the tags account for
+    long rss_pages = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm) {
+        if (fscanf(statm, "%*s %ld", &rss_pages) != 1) rss_pages = 0;
+        fclose(statm);
+    }
+    
+    char json[MEM_TAG_COUNT * 256 + 512];
+    long long total_live = 0;
+    size_t offset = snprintf(json, sizeof(json), "{\"tags\":[");
+    
+    for (int t = 0; t < MEM_TAG_COUNT; t++) {
+        MemTagStats *stats = &mem_stats[t];
+        long long live = atomic_load(&stats->live_bytes);
+        unsigned long long allocs = atomic_load(&stats->total_allocs);
+        total_live += live;
+        
+        offset += snprintf(json + offset, sizeof(json) - offset,
+            "%s{\"tag\":\"%s\",\"live_bytes\":%lld,\"live_allocs\":%lld,\"peak_bytes\":%lld,"
+            "\"total_allocs\":%llu,\"total_bytes\":%llu,\"allocs_per_request\":%.2f,\"allocs_per_second\":%.1f}",
+            t > 0 ? "," : "", mem_tag_names[t], live, (long long)atomic_load(&stats->live_allocs),
+            (long long)atomic_load(&stats->peak_bytes), allocs,
+            (unsigned long long)atomic_load(&stats->total_bytes),
+            requests ? (double)allocs / requests : 0.0, allocs / uptime);
+    }
+    
+    snprintf(json + offset, sizeof(json) - offset,
+             "],\"live_bytes\":%lld,\"requests\":%llu,\"shared_arena_bytes\":%zu,\"rss_bytes\":%lld,\"debug\":%s}",
+             total_live, requests, shared_arena.used,
+             (long long)rss_pages * sysconf(_SC_PAGESIZE), mem_debug.enabled ? "true" : "false");
+    return send_json(connection, MHD_HTTP_OK, json);
+}
+
+// Map an HTTP method string to its router index (-1 if unsupported)
+static int router_method_index(const char *method) {
+    if (!method) return -1;
+    if (strcmp(method, "GET") == 0) return 0;
+    if (strcmp(method, "POST") == 0) return 1;
+    if (strcmp(method, "PUT") == 0) return 2;
+    if (strcmp(method, "DELETE") == 0) return 3;
+    return -1;
+}
+
+// FNV-1a hash of a path segment (not NUL terminated)
+static unsigned int router_hash_segment(const char *seg, size_t len) {
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)seg[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static RouteNode* router_new_node(void) {
+    RouteNode *node = mem_calloc(MEM_ROUTER, 1, sizeof(RouteNode));
+    if (!node) printf("Failed to allocate memory for route node\n");
+    return node;
+}
+
+// Split a path into segments; returns segment count or -1 if too deep
+static int router_split_path(const char *path, const char **segs, size_t *lens) {
+    int count = 0;
+    const char *p = path;
+    
+    while (*p) {
+        while (*p == '/') p++;
+        if (!*p) break;
+        
+        const char *start = p;
+        while (*p && *p != '/') p++;
+        
+        if (count >= ROUTER_MAX_SEGMENTS) return -1;
+        segs[count] = start;
+        lens[count] = p - start;
+        count++;
+    }
+    return count;
+}
+
+// Register a route. Pattern segments are either static text, {name} or {name:int}.
+static Route* router_add(Router *router, unsigned int methods, const char *pattern, RouteHandler handler) {
+    if (!router || !pattern || !handler || methods == 0) return NULL;
+    
+    if (!router->root) {
+        router->root = router_new_node();
+        if (!router->root) return NULL;
+    }
+    
+    Route *route = mem_calloc(MEM_ROUTER, 1, sizeof(Route));
+    if (!route) return NULL;
+    route->pattern = mem_strdup(MEM_ROUTER, pattern);
+    if (!route->pattern) {
+        mem_free(route);
+        return NULL;
+    }
+    route->methods = methods;
+    route->handler = handler;
+    
+    const char *segs[ROUTER_MAX_SEGMENTS];
+    size_t lens[ROUTER_MAX_SEGMENTS];
+    int count = router_split_path(pattern, segs, lens);
+    if (count < 0) {
+        printf("Route pattern too deep: %s\n", pattern);
+        goto fail;
+    }
+    
+    RouteNode *node = router->root;
+    for (int i = 0; i < count; i++) {
+        const char *seg = segs[i];
+        size_t len = lens[i];
+        
+        if (len >= 2 && seg[0] == '{' && seg[len - 1] == '}') {
+            // Parameter segment
+            if (route->param_count >= ROUTER_MAX_PARAMS) {
+                printf("Too many parameters in route: %s\n", pattern);
+                goto fail;
+            }
+            
+            size_t name_len = len - 2;
+            RouteParamType type = PARAM_STRING;
+            const char *colon = memchr(seg + 1, ':', name_len);
+            if (colon) {
+                size_t type_len = (seg + len - 1) - (colon + 1);
+                if (type_len == 3 && strncmp(colon + 1, "int", 3) == 0) {
+                    type = PARAM_INT;
+                } else if (!(type_len == 3 && strncmp(colon + 1, "str", 3) == 0)) {
+                    printf("Unknown parameter type in route: %s\n", pattern);
+                    goto fail;
+                }
+                name_len = colon - (seg + 1);
+            }
+            
+            char *name = mem_strndup(MEM_ROUTER, seg + 1, name_len);
+            if (!name) goto fail;
+            route->param_names[route->param_count] = name;
+            route->param_types[route->param_count] = type;
+            route->param_count++;
+            
+            RouteNode **slot = (type == PARAM_INT) ? &node->int_param : &node->str_param;
+            if (!*slot) {
+                *slot = router_new_node();
+                if (!*slot) goto fail;
+            }
+            node = *slot;
+        } else {
+            // Static segment
+            unsigned int hash = router_hash_segment(seg, len);
+            RouteNode *child = node->children;
+            while (child) {
+                if (child->hash == hash && child->segment_len == len &&
+                    memcmp(child->segment, seg, len) == 0) {
+                    break;
+                }
+                child = child->sibling;
+            }
+            
+            if (!child) {
+                child = router_new_node();
+                if (!child) goto fail;
+                child->segment = mem_strndup(MEM_ROUTER, seg, len);
+                if (!child->segment) {
+                    mem_free(child);
+                    goto fail;
+                }
+                child->segment_len = len;
+                child->hash = hash;
+                child->sibling = node->children;
+                node->children = child;
+            }
+            node = child;
+        }
+    }
+    
+    for (int m = 0; m < ROUTE_METHOD_COUNT; m++) {
+        if ((methods & (1u << m)) && node->routes[m]) {
+            printf("Duplicate route ignored: %s (conflicts with %s)\n", pattern, node->routes[m]->pattern);
+            goto fail;
+        }
+    }
+    for (int m = 0; m < ROUTE_METHOD_COUNT; m++) {
+        if (methods & (1u << m)) node->routes[m] = route;
+    }
+    
+    route->next = router->routes;
+    router->routes = route;
+    router->route_count++;
+    router->compiled = 0;
+    return route;
+
+fail:
+    // Trie nodes created on the way stay in place; they are harmless and freed with the router
+    for (int i = 0; i < route->param_count; i++) mem_free((char*)route->param_names[i]);
+    mem_free(route->pattern);
+    mem_free(route);
+    return NULL;
+}
+
+// Attach a middleware to a route; middleware runs in the order it was added
+static int route_use(Route *route, RouteMiddleware middleware) {
+    if (!route || !middleware) return 0;
+    if (route->middleware_count >= ROUTER_MAX_MIDDLEWARE) {
+        printf("Too many middleware on route %s\n", route->pattern);
+        return 0;
+    }
+    route->middleware[route->middleware_count++] = middleware;
+    return 1;
+}
+
+// Handler used for any path that matches no route
+static void router_set_fallback(Router *router, unsigned int methods, RouteHandler handler) {
+    for (int m = 0; m < ROUTE_METHOD_COUNT; m++) {
+        if (methods & (1u << m)) router->fallback[m] = handler;
+    }
+}
+
+// Build the hash table of static children for every node
+static int router_compile_node(RouteNode *node) {
+    if (!node) return 1;
+    
+    unsigned int count = 0;
+    for (RouteNode *c = node->children; c; c = c->sibling) count++;
+    
+    mem_free(node->child_table);
+    node->child_table = NULL;
+    node->child_mask = 0;
+    
+    if (count > 0) {
+        // Keep the load factor at or below 1/2 so probes stay short
+        unsigned int size = 2;
+        while (size < count * 2) size <<= 1;
+        
+        node->child_table = mem_calloc(MEM_ROUTER, size, sizeof(RouteNode*));
+        if (!node->child_table) return 0;
+        node->child_mask = size - 1;
+        
+        for (RouteNode *c = node->children; c; c = c->sibling) {
+            unsigned int idx = c->hash & node->child_mask;
+            while (node->child_table[idx]) idx = (idx + 1) & node->child_mask;
+            node->child_table[idx] = c;
+        }
+    }
+    
+    for (RouteNode *c = node->children; c; c = c->sibling) {
+        if (!router_compile_node(c)) return 0;
+    }
+    return router_compile_node(node->int_param) && router_compile_node(node->str_param);
+}
+
+static int router_compile(Router *router) {
+    if (!router->root) {
+        router->root = router_new_node();
+        if (!router->root) return 0;
+    }
+    router->compiled = router_compile_node(router->root);
+    return router->compiled;
+}
+
+static RouteNode* router_find_child(const RouteNode *node, const char *seg, size_t len) {
+    if (!node->child_table) return NULL;
+    
+    unsigned int hash = router_hash_segment(seg, len);
+    unsigned int idx = hash & node->child_mask;
+    RouteNode *child;
+    while ((child = node->child_table[idx]) != NULL) {
+        if (child->hash == hash && child->segment_len == len &&
+            memcmp(child->segment, seg, len) == 0) {
+            return child;
+        }
+        idx = (idx + 1) & node->child_mask;
+    }
+    return NULL;
+}
+
+// True if some route, for any method, ends at node
+static int router_node_has_routes(const RouteNode *node) {
+    for (int i = 0; i < ROUTE_METHOD_COUNT; i++) {
+        if (node->routes[i]) return 1;
+    }
+    return 0;
+}
+
+// Walk the trie. Static segments win over {name:int}, which win over {name}.
+// A path ending on an intermediate node (/api) backtracks to the parameter branches.
+static const RouteNode* router_match_node(const RouteNode *node, const char **segs, const size_t *lens,
+                                          int depth, int count, RouteParam *params, int *param_count) {
+    if (depth == count) return router_node_has_routes(node) ? node : NULL;
+    
+    const char *seg = segs[depth];
+    size_t len = lens[depth];
+    const RouteNode *found;
+    
+    RouteNode *child = router_find_child(node, seg, len);
+    if (child) {
+        found = router_match_node(child, segs, lens, depth + 1, count, params, param_count);
+        if (found) return found;
+    }
+    
+    if ((node->int_param || node->str_param) && len < MAX_PARAM_LENGTH && *param_count < ROUTER_MAX_PARAMS) {
+        RouteParam *param = &params[*param_count];
+        memcpy(param->value, seg, len);
+        param->value[len] = '\0';
+        param->int_value = 0;
+        
+        if (node->int_param) {
+            int digits = len > 0 && len <= 18;
+            for (size_t i = 0; digits && i < len; i++) {
+                if (!isdigit((unsigned char)seg[i])) digits = 0;
+            }
+            if (digits) {
+                param->int_value = strtol(param->value, NULL, 10);
+                (*param_count)++;
+                found = router_match_node(node->int_param, segs, lens, depth + 1, count, params, param_count);
+                if (found) return found;
+                (*param_count)--;
+            }
+        }
+        
+        if (node->str_param) {
+            (*param_count)++;
+            found = router_match_node(node->str_param, segs, lens, depth + 1, count, params, param_count);
+            if (found) return found;
+            (*param_count)--;
+        }
+    }
+    
+    return NULL;
+}
+
+// Resolve a method and path to a route, filling in ctx->params on success.
+// When the path exists but not for this method, *allowed gets the methods it does accept (405).
+static const Route* router_match(const Router *router, int method_index, const char *path,
+                                 RequestContext *ctx, unsigned int *allowed) {
+    *allowed = 0;
+    ctx->param_count = 0;
+    if (!router->compiled || !router->root) return NULL;
+    
+    const char *segs[ROUTER_MAX_SEGMENTS];
+    size_t lens[ROUTER_MAX_SEGMENTS];
+    int count = router_split_path(path, segs, lens);
+    if (count < 0) return NULL;
+    
+    const RouteNode *node = router_match_node(router->root, segs, lens, 0, count,
+                                              ctx->params, &ctx->param_count);
+    if (!node) return NULL;
+    
+    const Route *route = (method_index >= 0) ? node->routes[method_index] : NULL;
+    if (!route) {
+        for (int m = 0; m < ROUTE_METHOD_COUNT; m++) {
+            if (node->routes[m]) *allowed |= 1u << m;
+        }
+        ctx->param_count = 0;
+        return NULL;
+    }
+    
+    // Values were collected in path order, which is also the order of param_names
+    for (int i = 0; i < ctx->param_count; i++) {
+        ctx->params[i].name = route->param_names[i];
+    }
+    return route;
+}
+
+static void router_free_node(RouteNode *node) {
+    if (!node) return;
+    RouteNode *child = node->children;
+    while (child) {
+        RouteNode *next = child->sibling;
+        router_free_node(child);
+        child = next;
+    }
+    router_free_node(node->int_param);
+    router_free_node(node->str_param);
+    mem_free(node->child_table);
+    mem_free(node->segment);
+    mem_free(node);
+}
+
+static void router_free(Router *router) {
+    Route *route = router->routes;
+    while (route) {
+        Route *next = route->next;
+        for (int i = 0; i < route->param_count; i++) mem_free((char*)route->param_names[i]);
+        mem_free(route->pattern);
+        mem_free(route);
+        route = next;
+    }
+    router_free_node(router->root);
+    memset(router, 0, sizeof(Router));
+}
+
+// Look up a path parameter by name
+static const char* route_param(const RequestContext *ctx, const char *name) {
+    for (int i = 0; i < ctx->param_count; i++) {
+        if (ctx->params[i].name && strcmp(ctx->params[i].name, name) == 0) {
+            return ctx->params[i].value;
+        }
+    }
+    return NULL;
+}
+
+static long route_param_int(const RequestContext *ctx, const char *name, long fallback) {
+    for (int i = 0; i < ctx->param_count; i++) {
+        if (ctx->params[i].name && strcmp(ctx->params[i].name, name) == 0) {
+            return ctx->params[i].int_value;
+        }
+    }
+    return fallback;
+}
+
+// Handle GET /api/session: who is logged in with this token
+static enum MHD_Result handle_get_session(struct MHD_Connection *connection) {
+    struct MHD_Response *response;
+    enum MHD_Result ret;
+    char username[MAX_USERNAME_LENGTH];
+    char json[128];
+    unsigned int status = MHD_HTTP_OK;
+    
+    if (request_session_user(connection, username)) {
+        snprintf(json, sizeof(json), "{\"username\":\"%s\"}", username);
+    } else {
+        snprintf(json, sizeof(json), "{\"error\":\"Not logged in\"}");
+        status = MHD_HTTP_UNAUTHORIZED;
+    }
+    
+    response = create_response(json, "application/json");
+    MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
+    ret = MHD_queue_response(connection, status, response);
+    MHD_destroy_response(response);
+    return ret;
+}
+
+// Route adapters for the existing handlers
+static enum MHD_Result route_get_questions(RequestContext *ctx) {
+    return handle_get_questions(ctx->connection);
+}
+
+static enum MHD_Result route_get_question(RequestContext *ctx) {
+    return handle_get_question_by_id(ctx->connection, (int)route_param_int(ctx, "id", -1));
+}
+
+// The same two responses rendered without MHD, for the io_uring engine
+static int render_get_questions(const RequestContext *ctx, RenderedBody *out) {
+    (void)ctx;
+    if (!question_head) {
+        out->data = "{\"error\":\"No questions available\"}";
+        out->length = strlen(out->data);
+        return 1;
+    }
+    out->owned = render_questions_text(&out->length);
+    out->data = out->owned;
+    out->content_type = "text/plain; charset=utf-8";
+    return out->owned != NULL;
+}
+
+static int render_get_question(const RequestContext *ctx, RenderedBody *out) {
+    int id = (int)route_param_int(ctx, "id", -1);
+    if (!search_bst(question_bst_root, id)) out->status = MHD_HTTP_NOT_FOUND;
+    out->owned = get_question_by_id_json(id);
+    if (!out->owned) return 0;
+    out->data = out->owned;
+    out->length = strlen(out->owned);
+    return 1;
+}
+
+static enum MHD_Result route_get_priority_questions(RequestContext *ctx) {
+    return handle_get_priority_questions(ctx->connection);
+}
+
+static enum MHD_Result route_login(RequestContext *ctx) {
+    return handle_login(ctx->connection, ctx->upload_data, ctx->upload_data_size, &ctx->handler_state);
+}
+
+static enum MHD_Result route_get_session(RequestContext *ctx) {
+    return handle_get_session(ctx->connection);
+}
+
+static enum MHD_Result route_next_question(RequestContext *ctx) {
+    return handle_next_question(ctx->connection);
+}
+
+static enum MHD_Result route_answer(RequestContext *ctx) {
+    return handle_answer(ctx->connection, ctx->upload_data, ctx->upload_data_size, &ctx->handler_state);
+}
+
+static enum MHD_Result route_submit(RequestContext *ctx) {
+    return handle_submit(ctx->connection, ctx->upload_data, ctx->upload_data_size, &ctx->handler_state);
+}
+
+static enum MHD_Result route_item_stats(RequestContext *ctx) {
+    return handle_item_stats(ctx->connection);
+}
+
+static enum MHD_Result route_search(RequestContext *ctx) {
+    return handle_search(ctx->connection);
+}
+
+static enum MHD_Result route_export(RequestContext *ctx) {
+    return handle_export(ctx->connection);
+}
+
+static enum MHD_Result route_media(RequestContext *ctx) {
+    return handle_media(ctx->connection, route_param(ctx, "name"));
+}
+
+static enum MHD_Result route_profile(RequestContext *ctx) {
+    return handle_profile(ctx->connection, &ctx->handler_state);
+}
+
+static enum MHD_Result route_trace_dump(RequestContext *ctx) {
+    return handle_trace_dump(ctx->connection);
+}
+
+static enum MHD_Result route_trace_config(RequestContext *ctx) {
+    return handle_trace_config(ctx->connection, ctx->upload_data, ctx->upload_data_size, &ctx->handler_state);
+}
+
+static enum MHD_Result route_memory(RequestContext *ctx) {
+    return handle_memory(ctx->connection);
+}
+
+static enum MHD_Result route_rank(RequestContext *ctx) {
+    return handle_rank(ctx->connection);
+}
+
+static enum MHD_Result route_leaderboard(RequestContext *ctx) {
+    return handle_leaderboard(ctx->connection);
+}
+
+static enum MHD_Result route_proctor_events(RequestContext *ctx) {
+    return handle_proctor_events(ctx->connection, ctx->upload_data, ctx->upload_data_size, &ctx->handler_state);
+}
+
+static enum MHD_Result route_proctor_summary(RequestContext *ctx) {
+    return handle_proctor_summary(ctx->connection);
+}
+
+static enum MHD_Result route_static_file(RequestContext *ctx) {
+    return serve_file(ctx->connection, ctx->url);
+}
+
+static enum MHD_Result route_not_found(RequestContext *ctx) {
+    const char* error_msg = "Not Found";
+    struct MHD_Response *response = create_response(error_msg, "text/plain");
+    
+    MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
+    
+    enum MHD_Result ret = MHD_queue_response(ctx->connection, MHD_HTTP_NOT_FOUND, response);
+    MHD_destroy_response(response);
+    
+    return ret;
+}
+
+static enum MHD_Result route_method_not_allowed(RequestContext *ctx) {
+    static const char *names[ROUTE_METHOD_COUNT] = {"GET", "POST", "PUT", "DELETE"};
+    char allow[64] = "OPTIONS";
+    
+    for (int m = 0; m < ROUTE_METHOD_COUNT; m++) {
+        if (ctx->allowed_methods & (1u << m)) {
+            strncat(allow, ", ", sizeof(allow) - strlen(allow) - 1);
+            strncat(allow, names[m], sizeof(allow) - strlen(allow) - 1);
+        }
+    }
+    
+    struct MHD_Response *response = create_response("Method Not Allowed", "text/plain");
+    MHD_add_response_header(response, "Allow", allow);
+    MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
+    
+    enum MHD_Result ret = MHD_queue_response(ctx->connection, MHD_HTTP_METHOD_NOT_ALLOWED, response);
+    MHD_destroy_response(response);
+    return ret;
+}
+
+// Register every endpoint and compile the routing table
+static int setup_routes(Router *router) {
+    Route *route;
+    
+    route = router_add(router, ROUTE_GET, "/api/questions", route_get_questions);
+    if (!route) return 0;
+    route->render = render_get_questions;
+    
+    route = router_add(router, ROUTE_GET, "/api/questions/{id:int}", route_get_question);
+    if (!route) return 0;
+    route->render = render_get_question;
+    
+    if (!router_add(router, ROUTE_GET, "/api/priority-questions", route_get_priority_questions)) return 0;
+    if (!router_add(router, ROUTE_GET, "/media/{name}", route_media)) return 0;
+    
+    route = router_add(router, ROUTE_POST, "/api/login", route_login);
+    if (!route) return 0;
+    route->cleanup = cleanup_connection_info;
+    
+    if (!router_add(router, ROUTE_GET, "/api/session", route_get_session)) return 0;
+    if (!router_add(router, ROUTE_GET, "/api/next-question", route_next_question)) return 0;
+    
+    route = router_add(router, ROUTE_POST, "/api/answer", route_answer);
+    if (!route) return 0;
+    route->cleanup = cleanup_connection_info;
+    
+    route = router_add(router, ROUTE_POST, "/api/submit", route_submit);
+    if (!route) return 0;
+    route->cleanup = cleanup_connection_info;
+    
+    route = router_add(router, ROUTE_GET, "/api/admin/item-stats", route_item_stats);
+    if (!route || !route_use(route, require_admin)) return 0;
+    
+    route = router_add(router, ROUTE_GET, "/api/admin/search", route_search);
+    if (!route || !route_use(route, require_admin)) return 0;
+    
+    route = router_add(router, ROUTE_GET, "/api/admin/export", route_export);
+    if (!route || !route_use(route, require_admin)) return 0;
+    
+    if (!router_add(router, ROUTE_GET, "/api/rank", route_rank)) return 0;
+    if (!router_add(router, ROUTE_GET, "/api/leaderboard", route_leaderboard)) return 0;
+    
+    route = router_add(router, ROUTE_GET, "/debug/profile", route_profile);
+    if (!route || !route_use(route, require_admin)) return 0;
+    route->cleanup = profile_request_cleanup;
+    
+    route = router_add(router, ROUTE_GET, "/debug/memory", route_memory);
+    if (!route || !route_use(route, require_admin)) return 0;
+    
+    route = router_add(router, ROUTE_GET, "/debug/trace", route_trace_dump);
+    if (!route || !route_use(route, require_admin)) return 0;
+    
+    route = router_add(router, ROUTE_POST, "/debug/trace", route_trace_config);
+    if (!route || !route_use(route, require_admin)) return 0;
+    route->cleanup = cleanup_connection_info;
+    
+    route = router_add(router, ROUTE_POST, "/api/proctor/events", route_proctor_events);
+    if (!route) return 0;
+    route->cleanup = cleanup_connection_info;
+    route = router_add(router, ROUTE_GET, "/api/proctor/summary", route_proctor_summary);
+    if (!route || !route_use(route, require_admin)) return 0;
+    
+    // Anything else under GET is a static file from the frontend directory
+    router_set_fallback(router, ROUTE_GET, route_static_file);
+    
+    if (!router_compile(router)) return 0;
+    printf("Router compiled with %d routes\n", router->route_count);
+    return 1;
+}
+
+// Main request handler
+static enum MHD_Result handle_request(void *cls,
+                                    struct MHD_Connection *connection,
+                                    const char *url,
+                                    const char *method,
+                                    const char *version,
+                                    const char *upload_data,
+                                    size_t *upload_data_size,
+                                    void **con_cls) {
+    Router *router = cls;
+    RequestContext *ctx = *con_cls;
+    
+    if (ctx == NULL) {
+        printf("Received %s request for %s\n", method, url);
+        
+        // Handle CORS preflight request
+        if (0 == strcmp(method, "OPTIONS")) {
+            struct MHD_Response *response = MHD_create_response_from_buffer(0, "", MHD_RESPMEM_PERSISTENT);
+            
+            MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
+            MHD_add_response_header(response, "Access-Control-Allow-Methods", "GET, POST, OPTIONS");
+            MHD_add_response_header(response, "Access-Control-Allow-Headers", "Content-Type");
+            MHD_add_response_header(response, "Access-Control-Max-Age", "86400");
+            
+            enum MHD_Result ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+            MHD_destroy_response(response);
+            return ret;
+        }
+        
+        // First call for this request: resolve the route once and keep it for later calls
+        ctx = mem_calloc(MEM_REQUEST, 1, sizeof(RequestContext));
+        if (!ctx) return MHD_NO;
+        ctx->connection = connection;
+        ctx->url = url;
+        ctx->method = method;
+        ctx->traced = trace_should_sample();
+        atomic_fetch_add_explicit(&mem_requests, 1, memory_order_relaxed);
+        *con_cls = ctx;
+        trace_request_active = ctx->traced;
+        
+        TRACE_BEGIN("route_match");
+        int method_index = router_method_index(method);
+        ctx->route = router_match(router, method_index, url, ctx, &ctx->allowed_methods);
+        TRACE_END("route_match");
+        
+        if (ctx->route) {
+            ctx->handler = ctx->route->handler;
+        } else if (ctx->allowed_methods) {
+            ctx->handler = route_method_not_allowed;
+        } else if (method_index >= 0 && router->fallback[method_index]) {
+            ctx->handler = router->fallback[method_index];
+        } else {
+            ctx->handler = route_not_found;
+        }
+        
+        if (ctx->route) {
+            for (int i = 0; i < ctx->route->middleware_count; i++) {
+                enum MHD_Result result = MHD_NO;
+                TRACE_BEGIN("middleware");
+                int passed = ctx->route->middleware[i](ctx, &result);
+                TRACE_END("middleware");
+                if (!passed) {
+                    ctx->finished = 1;
+                    trace_request_active = 0;
+                    return result;
+                }
+            }
+        }
+    }
+    
+    if (ctx->finished) {
+        // Response already queued by a middleware; discard any remaining upload
+        *upload_data_size = 0;
+        return MHD_YES;
+    }
+    
+    ctx->upload_data = upload_data;
+    ctx->upload_data_size = upload_data_size;
+    
+    // Named after the route pattern so spans group by endpoint
+    const char *span = ctx->route ? ctx->route->pattern : "fallback";
+    trace_request_active = ctx->traced;
+    TRACE_BEGIN(span);
+    enum MHD_Result ret = ctx->handler(ctx);
+    TRACE_END(span);
+    trace_request_active = 0;
+    return ret;
+}
+
+// Free the router state once MHD is done with a request
+static void request_completed(void *cls,
+                              struct MHD_Connection *connection,
+                              void **con_cls,
+                              enum MHD_RequestTerminationCode toe) {
+    RequestContext *ctx = *con_cls;
+    if (!ctx) return;
+    
+    if (ctx->handler_state && ctx->route && ctx->route->cleanup) {
+        ctx->route->cleanup(&ctx->handler_state);
+    }
+    mem_free(ctx);
+    *con_cls = NULL;
+}
+
+// Read a whole file (certificate or key) into a NUL-terminated buffer
+static char* read_file_to_string(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        printf("Could not open %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    
+    char *buffer = (size >= 0) ? mem_alloc(MEM_OTHER, size + 1) : NULL;
+    if (!buffer) {
+        fclose(fp);
+        return NULL;
+    }
+    
+    size_t read = fread(buffer, 1, size, fp);
+    buffer[read] = '\0';
+    fclose(fp);
+    return buffer;
+}
+
+// Replace the ticket key with a fresh one. Caller holds ticket->lock.
+static int tls_ticket_rotate(TlsTicketKey *ticket) {
+    gnutls_datum_t key = { NULL, 0 };
+    if (gnutls_session_ticket_key_generate(&key) != GNUTLS_E_SUCCESS) return 0;
+    
+    if (key.size <= sizeof(ticket->key)) {
+        memcpy(ticket->key, key.data, key.size);
+        ticket->size = key.size;
+        ticket->rotated_ms = session_now_ms();
+    }
+    gnutls_memset(key.data, 0, key.size);
+    gnutls_free(key.data);
+    return ticket->size == key.size;
+}
+
+// Copy out the current key, rotating it first once it is TLS_TICKET_ROTATE_MS old.
+// Whichever process gets the first handshake after that does the rotation.
+static unsigned int tls_ticket_current(unsigned char *out) {
+    TlsTicketKey *ticket = tls_config.ticket;
+    
+    pthread_mutex_lock(&ticket->lock);
+    if (session_now_ms() - ticket->rotated_ms >= TLS_TICKET_ROTATE_MS) {
+        if (!tls_ticket_rotate(ticket)) printf("Failed to rotate TLS session ticket key\n");
+    }
+    unsigned int size = ticket->size;
+    memcpy(out, ticket->key, size);
+    pthread_mutex_unlock(&ticket->lock);
+    return size;
+}
+
+// Load the PEM certificate and key and set up the session ticket key, keeping the
+// previous process's key after an upgrade
+static int tls_init(const char *cert_path, const char *key_path) {
+    tls_config.cert_pem = read_file_to_string(cert_path);
+    tls_config.key_pem = read_file_to_string(key_path);
+    if (!tls_config.cert_pem || !tls_config.key_pem) {
+        mem_free(tls_config.cert_pem);
+        mem_free(tls_config.key_pem);
+        tls_config.cert_pem = tls_config.key_pem = NULL;
+        return 0;
+    }
+    
+    int inherited;
+    tls_config.ticket = shared_state_map(SHARED_TLS_TICKET, sizeof(TlsTicketKey), 0, &inherited);
+    if (!tls_config.ticket) return 0;
+    if (!inherited || tls_config.ticket->size == 0) {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutex_init(&tls_config.ticket->lock, &attr);
+        pthread_mutexattr_destroy(&attr);
+        if (!tls_ticket_rotate(tls_config.ticket)) {
+            printf("Failed to generate TLS session ticket key\n");
+            return 0;
+        }
+    }
+    
+    tls_config.enabled = 1;
+    printf("TLS enabled with certificate %s\n", cert_path);
+    return 1;
+}
+
+static void tls_free(void) {
+    if (!tls_config.enabled) return;
+    
+    printf("TLS connections: %llu, resumed from ticket: %llu, kTLS: %llu\n",
+           (unsigned long long)atomic_load(&tls_config.connections),
+           (unsigned long long)atomic_load(&tls_config.resumed),
+           (unsigned long long)atomic_load(&tls_config.ktls));
+    
+    mem_free(tls_config.cert_pem);
+    mem_free(tls_config.key_pem);
+    shared_state_unmap(SHARED_TLS_TICKET, tls_config.ticket);
+    memset(&tls_config, 0, sizeof(tls_config));
+}
+
+// Called by MHD before the TLS handshake starts and again when the connection closes
+static void tls_notify_connection(void *cls,
+                                  struct MHD_Connection *connection,
+                                  void **socket_context,
+                                  enum MHD_ConnectionNotificationCode toe) {
+    const union MHD_ConnectionInfo *info = MHD_get_connection_info(connection, MHD_CONNECTION_INFO_GNUTLS_SESSION);
+    if (!info || !info->tls_session) return;
+    gnutls_session_t session = (gnutls_session_t)info->tls_session;
+    
+    if (toe == MHD_CONNECTION_NOTIFY_STARTED) {
+        // Use the shared key so tickets (TLS 1.2 and 1.3) survive reconnects to any
+        // worker. GnuTLS copies the key into the session.
+        unsigned char key[TLS_TICKET_KEY_MAX];
+        gnutls_datum_t datum = { key, tls_ticket_current(key) };
+        gnutls_session_ticket_enable_server(session, &datum);
+        gnutls_memset(key, 0, sizeof(key));
+        atomic_fetch_add(&tls_config.connections, 1);
+    } else if (toe == MHD_CONNECTION_NOTIFY_CLOSED) {
+        if (gnutls_session_is_resumed(session)) {
+            atomic_fetch_add(&tls_config.resumed, 1);
+        }
+#if GNUTLS_VERSION_NUMBER >= 0x030703
+        // GnuTLS hands records to the kernel when built with kTLS, "ktls = true"
+        // is set in its system config and the tls module is loaded
+        if (gnutls_transport_is_ktls_enabled(session)) {
+            atomic_fetch_add(&tls_config.ktls, 1);
+        }
+#endif
+    }
+}
+
+static unsigned int listen_port(void) {
+    return tls_config.enabled ? HTTPS_PORT : PORT;
+}
+
+// ===== io_uring serving engine =====
+
+// Thin wrappers over the raw syscalls; the build has no liburing
+static int uring_queue_init(UringQueue *queue, unsigned int entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(queue, 0, sizeof(UringQueue));
+    
+    queue->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (queue->fd < 0) return 0;
+    
+    queue->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    queue->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    int single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        if (queue->cq_ring_size > queue->sq_ring_size) queue->sq_ring_size = queue->cq_ring_size;
+        queue->cq_ring_size = queue->sq_ring_size;
+    }
+    
+    queue->sq_ring = mmap(NULL, queue->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          queue->fd, IORING_OFF_SQ_RING);
+    if (queue->sq_ring == MAP_FAILED) goto fail;
+    
+    if (single_mmap) {
+        queue->cq_ring = queue->sq_ring;
+    } else {
+        queue->cq_ring = mmap(NULL, queue->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              queue->fd, IORING_OFF_CQ_RING);
+        if (queue->cq_ring == MAP_FAILED) goto fail;
+    }
+    
+    queue->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    queue->sqes = mmap(NULL, queue->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       queue->fd, IORING_OFF_SQES);
+    if (queue->sqes == MAP_FAILED) goto fail;
+    
+    unsigned char *sq = queue->sq_ring;
+    unsigned char *cq = queue->cq_ring;
+    queue->sq_head = (_Atomic unsigned int*)(sq + params.sq_off.head);
+    queue->sq_tail = (_Atomic unsigned int*)(sq + params.sq_off.tail);
+    queue->sq_mask = *(unsigned int*)(sq + params.sq_off.ring_mask);
+    queue->sq_entries = params.sq_entries;
+    queue->sq_array = (unsigned int*)(sq + params.sq_off.array);
+    queue->cq_head = (_Atomic unsigned int*)(cq + params.cq_off.head);
+    queue->cq_tail = (_Atomic unsigned int*)(cq + params.cq_off.tail);
+    queue->cq_mask = *(unsigned int*)(cq + params.cq_off.ring_mask);
+    queue->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    queue->local_tail = atomic_load(queue->sq_tail);
+    return 1;
+
+fail:
+    if (queue->sqes && queue->sqes != MAP_FAILED) munmap(queue->sqes, queue->sqes_size);
+    if (queue->cq_ring && queue->cq_ring != MAP_FAILED && queue->cq_ring != queue->sq_ring) {
+        munmap(queue->cq_ring, queue->cq_ring_size);
+    }
+    if (queue->sq_ring && queue->sq_ring != MAP_FAILED) munmap(queue->sq_ring, queue->sq_ring_size);
+    close(queue->fd);
+    queue->fd = -1;
+    return 0;
+}
+
+static void uring_queue_free(UringQueue *queue) {
+    if (queue->fd < 0) return;
+    munmap(queue->sqes, queue->sqes_size);
+    if (queue->cq_ring != queue->sq_ring) munmap(queue->cq_ring, queue->cq_ring_size);
+    munmap(queue->sq_ring, queue->sq_ring_size);
+    close(queue->fd);
+    queue->fd = -1;
+}
+
+// Publish queued SQEs and optionally wait for completions: the only syscall in the loop
+static int uring_submit(UringQueue *queue, unsigned int wait_nr) {
+    atomic_store_explicit(queue->sq_tail, queue->local_tail, memory_order_release);
+    unsigned int to_submit = queue->local_tail - atomic_load_explicit(queue->sq_head, memory_order_acquire);
+    
+    int ret = (int)syscall(__NR_io_uring_enter, queue->fd, to_submit, wait_nr,
+                           wait_nr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    atomic_fetch_add_explicit(&uring_server.enters, 1, memory_order_relaxed);
+    if (ret < 0) {
+        return errno == EINTR || errno == EBUSY || errno == EAGAIN ? 0 : -1;
+    }
+    return 0;
+}
+
+// Make room for count SQEs, so linked ones are never split by a full ring.
+// Returns 0 if the kernel has not consumed enough of the ring.
+static int uring_reserve_sqes(UringQueue *queue, unsigned int count) {
+    unsigned int head = atomic_load_explicit(queue->sq_head, memory_order_acquire);
+    if (queue->local_tail - head + count > queue->sq_entries) {
+        // Ring full: hand what we have to the kernel without waiting
+        if (uring_submit(queue, 0) < 0) return 0;
+        head = atomic_load_explicit(queue->sq_head, memory_order_acquire);
+        if (queue->local_tail - head + count > queue->sq_entries) return 0;
+    }
+    return 1;
+}
+
+static struct io_uring_sqe* uring_get_sqe(UringQueue *queue) {
+    if (!uring_reserve_sqes(queue, 1)) return NULL;
+    
+    unsigned int index = queue->local_tail & queue->sq_mask;
+    struct io_uring_sqe *sqe = &queue->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    queue->sq_array[index] = index;
+    queue->local_tail++;
+    return sqe;
+}
+
+// Build a table of the frontend files, opened once and registered with the ring
+static void uring_add_assets(const char *dir, const char *url_prefix) {
+    DIR *handle = opendir(dir);
+    if (!handle) return;
+    
+    struct dirent *entry;
+    while ((entry = readdir(handle)) != NULL && uring_server.asset_count < URING_MAX_ASSETS) {
+        if (entry->d_name[0] == '.') continue;
+        
+        char path[1024], url[URING_MAX_URL];
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        if (snprintf(url, sizeof(url), "%s/%s", url_prefix, entry->d_name) >= (int)sizeof(url)) continue;
+        
+        struct stat st;
+        if (stat(path, &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            uring_add_assets(path, url);
+            continue;
+        }
+        if (!S_ISREG(st.st_mode)) continue;
+        
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+        
+        UringAsset *asset = &uring_server.assets[uring_server.asset_count++];
+        strcpy(asset->url, url);
+        asset->fd = fd;
+        asset->size = (size_t)st.st_size;
+        asset->content_type = get_content_type(path);
+    }
+    closedir(handle);
+}
+
+static const UringAsset* uring_find_asset(const char *url) {
+    if (strcmp(url, "/") == 0) url = "/index.html";
+    for (int i = 0; i < uring_server.asset_count; i++) {
+        if (strcmp(uring_server.assets[i].url, url) == 0) return &uring_server.assets[i];
+    }
+    return NULL;
+}
+
+static void uring_register_resources(void) {
+    int fds[URING_MAX_ASSETS];
+    for (int i = 0; i < uring_server.asset_count; i++) fds[i] = uring_server.assets[i].fd;
+    
+    if (uring_server.asset_count > 0 &&
+        syscall(__NR_io_uring_register, uring_server.ring.fd, IORING_REGISTER_FILES,
+                fds, uring_server.asset_count) == 0) {
+        uring_server.files_registered = 1;
+    }
+    
+    struct iovec iov[URING_BUFFER_COUNT];
+    for (int i = 0; i < URING_BUFFER_COUNT; i++) {
+        iov[i].iov_base = uring_server.buffers + (size_t)i * URING_BUFFER_SIZE;
+        iov[i].iov_len = URING_BUFFER_SIZE;
+        uring_server.free_buffers[i] = i;
+    }
+    uring_server.free_buffer_count = URING_BUFFER_COUNT;
+    
+    if (syscall(__NR_io_uring_register, uring_server.ring.fd, IORING_REGISTER_BUFFERS,
+                iov, URING_BUFFER_COUNT) == 0) {
+        uring_server.buffers_registered = 1;
+    }
+}
+
+static void uring_close(UringConn *conn);
+
+// If the ring is full the accept is left unarmed and the event loop retries it
+static void uring_queue_accept(void) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&uring_server.ring);
+    if (!sqe) return;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = uring_server.listen_fd;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = URING_TAG_ACCEPT;
+    uring_server.accept_armed = 1;
+}
+
+// The queue functions below are only called with nothing in flight on conn, so
+// when the ring has no room they can close it outright.
+static void uring_queue_recv(UringConn *conn) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&uring_server.ring);
+    if (!sqe) {
+        uring_close(conn);
+        return;
+    }
+    conn->state = URING_CONN_RECV;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->fd;
+    sqe->addr = (uintptr_t)(conn->recv + conn->recv_len);
+    sqe->len = URING_RECV_SIZE - conn->recv_len;
+    sqe->user_data = (uintptr_t)conn;
+}
+
+static void uring_queue_sendmsg(UringConn *conn) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&uring_server.ring);
+    if (!sqe) {
+        uring_close(conn);
+        return;
+    }
+    conn->state = URING_CONN_SEND;
+    memset(&conn->msg, 0, sizeof(conn->msg));
+    conn->msg.msg_iov = conn->iov + conn->iov_first;
+    conn->msg.msg_iovlen = conn->iov_count - conn->iov_first;
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = conn->fd;
+    sqe->addr = (uintptr_t)&conn->msg;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = (uintptr_t)conn;
+}
+
+// Next file chunk: a read into the connection's buffer linked to the send of it, so
+// both go to the kernel in one submission. The first chunk carries the headers.
+static void uring_queue_file_chunk(UringConn *conn, size_t prefix_len) {
+    size_t len = URING_BUFFER_SIZE - prefix_len;
+    if (len > conn->file_remaining) len = conn->file_remaining;
+    
+    unsigned char *buffer = uring_server.buffers + (size_t)conn->buffer * URING_BUFFER_SIZE;
+    const UringAsset *asset = &uring_server.assets[conn->asset];
+    
+    if (!uring_reserve_sqes(&uring_server.ring, 2)) {
+        uring_close(conn);
+        return;
+    }
+    struct io_uring_sqe *read_sqe = uring_get_sqe(&uring_server.ring);
+    if (uring_server.buffers_registered) {
+        read_sqe->opcode = IORING_OP_READ_FIXED;
+        read_sqe->buf_index = (uint16_t)conn->buffer;
+    } else {
+        read_sqe->opcode = IORING_OP_READ;
+    }
+    if (uring_server.files_registered) {
+        read_sqe->fd = conn->asset;
+        read_sqe->flags |= IOSQE_FIXED_FILE;
+    } else {
+        read_sqe->fd = asset->fd;
+    }
+    read_sqe->flags |= IOSQE_IO_LINK;
+    read_sqe->addr = (uintptr_t)(buffer + prefix_len);
+    read_sqe->len = (unsigned int)len;
+    read_sqe->off = conn->file_offset;
+    read_sqe->user_data = (uintptr_t)conn | URING_TAG_FILE_READ;
+    
+    struct io_uring_sqe *send_sqe = uring_get_sqe(&uring_server.ring);
+    send_sqe->opcode = IORING_OP_SEND;
+    send_sqe->fd = conn->fd;
+    send_sqe->addr = (uintptr_t)buffer;
+    send_sqe->len = (unsigned int)(prefix_len + len);
+    send_sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    send_sqe->user_data = (uintptr_t)conn;
+    
+    conn->state = URING_CONN_FILE;
+    conn->chunk_len = prefix_len + len;
+    conn->file_offset += len;
+    conn->file_remaining -= len;
+}
+
+// Take a registered buffer and send the asset from it, headers first
+static void uring_start_file(UringConn *conn) {
+    conn->buffer = uring_server.free_buffers[--uring_server.free_buffer_count];
+    memcpy(uring_server.buffers + (size_t)conn->buffer * URING_BUFFER_SIZE, conn->header, conn->header_len);
+    uring_queue_file_chunk(conn, conn->header_len);
+}
+
+// Return conn's buffer to the pool, or straight to the oldest connection waiting
+// for one. At stop the ring is gone, so waiters are only closed.
+static void uring_release_buffer(UringConn *conn) {
+    if (conn->buffer < 0) return;
+    uring_server.free_buffers[uring_server.free_buffer_count++] = conn->buffer;
+    conn->buffer = -1;
+    
+    UringConn *waiter = uring_server.buffer_wait_head;
+    if (!waiter || !uring_server.running) return;
+    uring_server.buffer_wait_head = waiter->wait_next;
+    if (!uring_server.buffer_wait_head) uring_server.buffer_wait_tail = NULL;
+    waiter->wait_next = NULL;
+    uring_start_file(waiter);
+}
+
+static void uring_close(UringConn *conn) {
+    if (conn->state == URING_CONN_BUFFER_WAIT) {
+        UringConn **link = &uring_server.buffer_wait_head;
+        UringConn *previous = NULL;
+        while (*link && *link != conn) {
+            previous = *link;
+            link = &(*link)->wait_next;
+        }
+        if (*link) *link = conn->wait_next;
+        if (uring_server.buffer_wait_tail == conn) uring_server.buffer_wait_tail = previous;
+    }
+    uring_release_buffer(conn);
+    close(conn->fd);
+    if (conn->prev) conn->prev->next = conn->next; else uring_server.connections = conn->next;
+    if (conn->next) conn->next->prev = conn->prev;
+    uring_server.connection_count--;
+    mem_free(conn->owned_body);
+    mem_free(conn);
+}
+
+// Case-insensitive header lookup in the raw request head; copies the trimmed value
+static int uring_header(const char *head, const char *name, char *out, size_t out_size) {
+    size_t name_len = strlen(name);
+    const char *line = strstr(head, "\r\n");
+    
+    while (line && line[2] != '\r') {
+        line += 2;
+        if (strncasecmp(line, name, name_len) == 0 && line[name_len] == ':') {
+            const char *value = line + name_len + 1;
+            while (*value == ' ') value++;
+            size_t len = strcspn(value, "\r\n");
+            if (len >= out_size) len = out_size - 1;
+            memcpy(out, value, len);
+            out[len] = '\0';
+            return 1;
+        }
+        line = strstr(line, "\r\n");
+    }
+    return 0;
+}
+
+static void uring_set_header(UringConn *conn, unsigned int status, const char *reason,
+                             const char *content_type, size_t length, const char *extra) {
+    conn->header_len = snprintf(conn->header, sizeof(conn->header),
+        "HTTP/1.1 %u %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+        "Access-Control-Allow-Origin: *\r\nConnection: %s\r\n%s\r\n",
+        status, reason, content_type, length, conn->keep_alive ? "keep-alive" : "close", extra);
+}
+
+static void uring_respond_memory(UringConn *conn, const char *body, size_t len) {
+    conn->iov[0].iov_base = conn->header;
+    conn->iov[0].iov_len = conn->header_len;
+    conn->iov[1].iov_base = (void*)body;
+    conn->iov[1].iov_len = conn->head_only ? 0 : len;
+    conn->iov_first = 0;
+    conn->iov_count = 2;
+    uring_queue_sendmsg(conn);
+}
+
+static void uring_url_decode(char *path) {
+    char *out = path;
+    for (const char *in = path; *in; in++) {
+        if (*in == '%' && isxdigit((unsigned char)in[1]) && isxdigit((unsigned char)in[2])) {
+            char hex[3] = { in[1], in[2], '\0' };
+            *out++ = (char)strtol(hex, NULL, 16);
+            in += 2;
+        } else {
+            *out++ = *in;
+        }
+    }
+    *out = '\0';
+}
+
+// Parse one request from the receive buffer and queue its response. Returns 0 if
+// the request head is still incomplete.
+static int uring_handle_request(UringConn *conn) {
+    char *end = memmem(conn->recv, conn->recv_len, "\r\n\r\n", 4);
+    if (!end) return 0;
+    *end = '\0';
+    conn->request_len = (size_t)(end + 4 - conn->recv);
+    atomic_fetch_add_explicit(&uring_server.requests, 1, memory_order_relaxed);
+    
+    char method[8], target[URING_MAX_URL], version[16];
+    if (sscanf(conn->recv, "%7s %1023s %15s", method, target, version) != 3) {
+        conn->keep_alive = 0;
+        uring_set_header(conn, 400, "Bad Request", "text/plain", 0, "");
+        uring_respond_memory(conn, "", 0);
+        return 1;
+    }
+    
+    char connection_header[32] = "";
+    uring_header(conn->recv, "Connection", connection_header, sizeof(connection_header));
+    conn->keep_alive = strcmp(version, "HTTP/1.1") == 0 ? strcasecmp(connection_header, "close") != 0
+                                                        : strcasecmp(connection_header, "keep-alive") == 0;
+    conn->head_only = strcmp(method, "HEAD") == 0;
+    
+    // Only GET/HEAD without a body are served here; the rest belongs to MHD
+    int servable = strcmp(method, "GET") == 0 || conn->head_only;
+    
+    char path[URING_MAX_URL];
+    size_t path_len = strcspn(target, "?");
+    memcpy(path, target, path_len);
+    path[path_len] = '\0';
+    uring_url_decode(path);
+    int has_query = target[path_len] == '?';
+    
+    if (servable) {
+        RequestContext ctx;
+        memset(&ctx, 0, sizeof(ctx));
+        ctx.url = path;
+        ctx.method = method;
+        unsigned int allowed = 0;
+        const Route *route = router_match(&api_router, router_method_index("GET"), path, &ctx, &allowed);
+        
+        // Middleware needs the MHD connection, so routes that have any are left to MHD
+        if (route && route->render && route->middleware_count == 0 && !has_query) {
+            RenderedBody rendered = { NULL, 0, NULL, MHD_HTTP_OK, "application/json" };
+            if (route->render(&ctx, &rendered)) {
+                conn->owned_body = rendered.owned;
+                uring_set_header(conn, rendered.status, rendered.status == MHD_HTTP_OK ? "OK" : "Not Found",
+                                 rendered.content_type, rendered.length, "");
+                uring_respond_memory(conn, rendered.data, rendered.length);
+                return 1;
+            }
+        } else if (!route && !allowed) {
+            const UringAsset *asset = uring_find_asset(path);
+            if (asset && conn->head_only) {
+                uring_set_header(conn, 200, "OK", asset->content_type, asset->size, "");
+                uring_respond_memory(conn, "", 0);
+                return 1;
+            }
+            if (asset) {
+                conn->asset = (int)(asset - uring_server.assets);
+                conn->file_offset = 0;
+                conn->file_remaining = asset->size;
+                uring_set_header(conn, 200, "OK", asset->content_type, asset->size, "");
+                if (uring_server.free_buffer_count > 0) {
+                    uring_start_file(conn);
+                } else {
+                    // Every buffer is streaming; wait for one rather than bounce to MHD
+                    conn->state = URING_CONN_BUFFER_WAIT;
+                    conn->wait_next = NULL;
+                    if (uring_server.buffer_wait_tail) {
+                        uring_server.buffer_wait_tail->wait_next = conn;
+                    } else {
+                        uring_server.buffer_wait_head = conn;
+                    }
+                    uring_server.buffer_wait_tail = conn;
+                }
+                return 1;
+            } else {
+                uring_set_header(conn, 404, "Not Found", "text/plain", 0, "");
+                uring_respond_memory(conn, "", 0);
+                return 1;
+            }
+        }
+    }
+    
+    // Everything else is handled by the MHD handlers on the main port. 307 keeps the
+    // method and body; close since we did not read any request body. The host is
+    // configured, never the client's Host header, so this can't redirect off-site.
+    char location[URING_MAX_URL + 320];
+    snprintf(location, sizeof(location), "Location: http://%s:%u%s\r\n", public_host, PORT,
+             target[0] == '/' ? target : "/");
+    conn->keep_alive = 0;
+    uring_set_header(conn, 307, "Temporary Redirect", "text/plain", 0, location);
+    uring_respond_memory(conn, "", 0);
+    return 1;
+}
+
+// Response fully sent: keep the connection for the next request or close it
+static void uring_finish_response(UringConn *conn) {
+    uring_release_buffer(conn);
+    mem_free(conn->owned_body);
+    conn->owned_body = NULL;
+    
+    if (!conn->keep_alive) {
+        uring_close(conn);
+        return;
+    }
+    
+    // Keep pipelined bytes that followed the request
+    memmove(conn->recv, conn->recv + conn->request_len, conn->recv_len - conn->request_len);
+    conn->recv_len -= conn->request_len;
+    conn->request_len = 0;
+    if (!uring_handle_request(conn)) uring_queue_recv(conn);
+}
+
+static void uring_complete(struct io_uring_cqe *cqe) {
+    uint64_t user_data = cqe->user_data;
+    int res = cqe->res;
+    
+    if (user_data == URING_TAG_STOP) {
+        uring_server.running = 0;
+        return;
+    }
+    
+    if (user_data == URING_TAG_ACCEPT) {
+        uring_server.accept_armed = 0;
+        if (res >= 0) {
+            UringConn *conn = mem_calloc(MEM_CONNECTION, 1, sizeof(UringConn));
+            if (!conn) {
+                close(res);
+            } else {
+                conn->fd = res;
+                conn->buffer = -1;
+                conn->next = uring_server.connections;
+                if (conn->next) conn->next->prev = conn;
+                uring_server.connections = conn;
+                uring_server.connection_count++;
+                uring_queue_recv(conn);
+            }
+        }
+        if (uring_server.running) uring_queue_accept();
+        return;
+    }
+    
+    UringConn *conn = (UringConn*)(uintptr_t)(user_data & ~(uint64_t)URING_TAG_MASK);
+    
+    if (user_data & URING_TAG_FILE_READ) {
+        // A short read cancels the linked send, which then closes the connection
+        return;
+    }
+    
+    switch (conn->state) {
+    case URING_CONN_BUFFER_WAIT:
+        return; // Nothing is in flight while waiting
+        
+    case URING_CONN_RECV:
+        if (res <= 0) {
+            uring_close(conn);
+            return;
+        }
+        conn->recv_len += (size_t)res;
+        if (!uring_handle_request(conn)) {
+            if (conn->recv_len == URING_RECV_SIZE) {
+                uring_close(conn); // Request head too large
+            } else {
+                uring_queue_recv(conn);
+            }
+        }
+        return;
+        
+    case URING_CONN_SEND: {
+        if (res < 0) {
+            uring_close(conn);
+            return;
+        }
+        size_t sent = (size_t)res;
+        while (conn->iov_first < conn->iov_count && sent >= conn->iov[conn->iov_first].iov_len) {
+            sent -= conn->iov[conn->iov_first].iov_len;
+            conn->iov_first++;
+        }
+        if (conn->iov_first == conn->iov_count) {
+            uring_finish_response(conn);
+            return;
+        }
+        conn->iov[conn->iov_first].iov_base = (char*)conn->iov[conn->iov_first].iov_base + sent;
+        conn->iov[conn->iov_first].iov_len -= sent;
+        uring_queue_sendmsg(conn);
+        return;
+    }
+        
+    case URING_CONN_FILE:
+        if (res < 0 || (size_t)res != conn->chunk_len) {
+            uring_close(conn);
+            return;
+        }
+        if (conn->file_remaining == 0) {
+            uring_finish_response(conn);
+        } else {
+            uring_queue_file_chunk(conn, 0);
+        }
+        return;
+    }
+}
+
+// Event loop: drain every completion, then submit all the SQEs they produced in one call
+static void* uring_thread(void *arg) {
+    (void)arg;
+    UringQueue *queue = &uring_server.ring;
+    
+    uring_queue_accept();
+    
+    struct io_uring_sqe *sqe = uring_get_sqe(queue);
+    if (sqe) {
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = uring_server.stop_fd;
+        sqe->addr = (uintptr_t)&uring_server.stop_value;
+        sqe->len = sizeof(uring_server.stop_value);
+        sqe->user_data = URING_TAG_STOP;
+    }
+    
+    while (uring_server.running) {
+        if (!uring_server.accept_armed) uring_queue_accept();
+        if (uring_submit(queue, 1) < 0) {
+            printf("io_uring_enter failed: %s\n", strerror(errno));
+            break;
+        }
+        
+        unsigned int head = atomic_load_explicit(queue->cq_head, memory_order_relaxed);
+        unsigned int tail = atomic_load_explicit(queue->cq_tail, memory_order_acquire);
+        while (head != tail) {
+            uring_complete(&queue->cqes[head & queue->cq_mask]);
+            head++;
+            atomic_store_explicit(queue->cq_head, head, memory_order_release);
+            tail = atomic_load_explicit(queue->cq_tail, memory_order_acquire);
+        }
+    }
+    return NULL;
+}
+
+// Start the engine on port. The listening socket uses SO_REUSEPORT so every worker
+// can run its own ring on the same port. Returns 0 when io_uring is unavailable.
+static int uring_start(unsigned int port) {
+    memset(&uring_server, 0, sizeof(uring_server));
+    uring_server.listen_fd = -1;
+    uring_server.stop_fd = -1;
+    uring_server.ring.fd = -1;
+    
+    if (!uring_queue_init(&uring_server.ring, URING_ENTRIES)) {
+        printf("io_uring unavailable (%s); static files stay on the main port\n", strerror(errno));
+        return 0;
+    }
+    
+    uring_server.listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int one = 1;
+    setsockopt(uring_server.listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(uring_server.listen_fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    // Accepted sockets inherit this. Without it the last partial segment of each file
+    // chunk waits for the client's delayed ACK, about 40 ms.
+    setsockopt(uring_server.listen_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (uring_server.listen_fd < 0 ||
+        bind(uring_server.listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(uring_server.listen_fd, 1024) != 0) {
+        printf("io_uring engine: cannot listen on port %u: %s\n", port, strerror(errno));
+        goto fail;
+    }
+    
+    uring_server.stop_fd = eventfd(0, EFD_CLOEXEC);
+    uring_server.buffers = mmap(NULL, (size_t)URING_BUFFER_COUNT * URING_BUFFER_SIZE, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (uring_server.stop_fd < 0 || uring_server.buffers == MAP_FAILED) {
+        uring_server.buffers = NULL;
+        goto fail;
+    }
+    
+    uring_add_assets(FRONTEND_PATH, "");
+    uring_register_resources();
+    
+    uring_server.running = 1;
+    if (pthread_create(&uring_server.thread, NULL, uring_thread, NULL) != 0) goto fail;
+    
+    printf("io_uring engine on port %u: %d static files (%s), %s buffers\n", port, uring_server.asset_count,
+           uring_server.files_registered ? "registered" : "unregistered",
+           uring_server.buffers_registered ? "registered" : "unregistered");
+    return 1;
+
+fail:
+    uring_server.running = 0;
+    if (uring_server.buffers) munmap(uring_server.buffers, (size_t)URING_BUFFER_COUNT * URING_BUFFER_SIZE);
+    if (uring_server.stop_fd >= 0) close(uring_server.stop_fd);
+    if (uring_server.listen_fd >= 0) close(uring_server.listen_fd);
+    for (int i = 0; i < uring_server.asset_count; i++) close(uring_server.assets[i].fd);
+    uring_queue_free(&uring_server.ring);
+    return 0;
+}
+
+static void uring_stop(void) {
+    if (!uring_server.running) return;
+    
+    uint64_t one = 1;
+    if (write(uring_server.stop_fd, &one, sizeof(one)) != sizeof(one)) {
+        printf("io_uring engine: failed to signal stop\n");
+    }
+    pthread_join(uring_server.thread, NULL);
+    
+    unsigned long long requests = atomic_load(&uring_server.requests);
+    unsigned long long enters = atomic_load(&uring_server.enters);
+    printf("io_uring engine: %llu requests, %llu io_uring_enter calls (%.2f per request), %d connections open\n",
+           requests, enters, requests ? (double)enters / requests : 0.0, uring_server.connection_count);
+    
+    // Tearing down the ring cancels whatever is still in flight on open connections
+    uring_queue_free(&uring_server.ring);
+    while (uring_server.connections) {
+        uring_close(uring_server.connections);
+    }
+    close(uring_server.listen_fd);
+    close(uring_server.stop_fd);
+    for (int i = 0; i < uring_server.asset_count; i++) close(uring_server.assets[i].fd);
+    munmap(uring_server.buffers, (size_t)URING_BUFFER_COUNT * URING_BUFFER_SIZE);
+}
+
+// Start the HTTP daemon. reuse_port lets several worker processes bind PORT (SO_REUSEPORT),
+// listen_fd >= 0 serves an inherited socket, and quiescable allows MHD_quiesce_daemon later.
+static struct MHD_Daemon* start_http_daemon(int reuse_port, int listen_fd, int quiescable) {
+    struct MHD_OptionItem options[12];
+    int count = 0;
+    unsigned int flags = MHD_USE_POLL_INTERNALLY | MHD_USE_DEBUG | MHD_USE_ERROR_LOG | MHD_ALLOW_SUSPEND_RESUME;
+    
+    if (quiescable) flags |= MHD_USE_ITC;
+    
+    if (tls_config.enabled) {
+        flags |= MHD_USE_TLS;
+        options[count++] = (struct MHD_OptionItem){ MHD_OPTION_HTTPS_MEM_CERT, 0, tls_config.cert_pem };
+        options[count++] = (struct MHD_OptionItem){ MHD_OPTION_HTTPS_MEM_KEY, 0, tls_config.key_pem };
+        options[count++] = (struct MHD_OptionItem){ MHD_OPTION_HTTPS_PRIORITIES, 0, TLS_PRIORITIES };
+        options[count++] = (struct MHD_OptionItem){ MHD_OPTION_NOTIFY_CONNECTION, (intptr_t)&tls_notify_connection, NULL };
+    }
+    
+    options[count++] = (struct MHD_OptionItem){ MHD_OPTION_CONNECTION_TIMEOUT, 120, NULL };
+    options[count++] = (struct MHD_OptionItem){ MHD_OPTION_NOTIFY_COMPLETED, (intptr_t)&request_completed, NULL };
+    if (reuse_port) {
+        options[count++] = (struct MHD_OptionItem){ MHD_OPTION_LISTENING_ADDRESS_REUSE, 1, NULL };
+    }
+    if (listen_fd >= 0) {
+        options[count++] = (struct MHD_OptionItem){ MHD_OPTION_LISTEN_SOCKET, listen_fd, NULL };
+    }
+    options[count++] = (struct MHD_OptionItem){ MHD_OPTION_END, 0, NULL };
+    
+    return MHD_start_daemon(
+        flags,
+        listen_port(), NULL, NULL, 
+        &handle_request, &api_router,
+        MHD_OPTION_ARRAY, options,
+        MHD_OPTION_END
+    );
+}
+
+// Worker process: serve until SIGTERM/SIGINT
+static int run_worker(int index) {
+    worker_index = index;
+    
+    // Block the stop signals in every thread and wait for them synchronously
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGTERM);
+    sigaddset(&stop_signals, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+    
+    if (!proctor_start(&proctor_store)) {
+        printf("Worker %d: failed to start proctor event writer\n", index);
+        return 1;
+    }
+    
+    struct MHD_Daemon *daemon = start_http_daemon(1, -1, 0);
+    if (NULL == daemon) {
+        printf("Worker %d: failed to start server\n", index);
+        proctor_stop(&proctor_store);
+        return 1;
+    }
+    
+    printf("Worker %d (pid %d) serving on port %u\n", index, (int)getpid(), listen_port());
+    if (uring_port) uring_start(uring_port);
+    fflush(stdout);
+    
+    int sig;
+    sigwait(&stop_signals, &sig);
+    
+    uring_stop();
+    MHD_stop_daemon(daemon);
+    proctor_stop(&proctor_store);
+    router_free(&api_router);
+    tls_free();
+    printf("Worker %d stopped\n", index);
+    return 0;
+}
+
+static volatile sig_atomic_t supervisor_stopping = 0;
+
+static void supervisor_signal(int sig) {
+    (void)sig;
+    supervisor_stopping = 1;
+}
+
+static pid_t spawn_worker(int index) {
+    fflush(stdout); // Don't let the child inherit unflushed output
+    pid_t pid = fork();
+    if (pid == 0) {
+        exit(run_worker(index));
+    }
+    if (pid < 0) {
+        printf("Failed to fork worker %d: %s\n", index, strerror(errno));
+    }
+    return pid;
+}
+
+// Supervisor: fork the workers, restart any that die, stop them all on SIGTERM/SIGINT
+static int run_supervisor(int workers) {
+    pid_t pids[MAX_WORKERS] = {0};
+    
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = supervisor_signal; // No SA_RESTART so waitpid returns EINTR
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+    
+    for (int i = 0; i < workers; i++) {
+        pids[i] = spawn_worker(i);
+    }
+    printf("Supervisor (pid %d) started %d workers. Send SIGTERM or press Ctrl-C to stop.\n",
+           (int)getpid(), workers);
+    
+    while (!supervisor_stopping) {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        
+        for (int i = 0; i < workers; i++) {
+            if (pids[i] != pid) continue;
+            
+            pids[i] = 0;
+            if (supervisor_stopping) break;
+            
+            if (WIFSIGNALED(status)) {
+                printf("Worker %d (pid %d) killed by signal %d, restarting\n", i, (int)pid, WTERMSIG(status));
+            } else {
+                printf("Worker %d (pid %d) exited with status %d, restarting\n", i, (int)pid, WEXITSTATUS(status));
+            }
+            sleep(1); // Avoid a tight restart loop if the worker keeps failing
+            pids[i] = spawn_worker(i);
+        }
+    }
+    
+    printf("Stopping workers...\n");
+    for (int i = 0; i < workers; i++) {
+        if (pids[i] > 0) kill(pids[i], SIGTERM);
+    }
+    for (int i = 0; i < workers; i++) {
+        if (pids[i] > 0) waitpid(pids[i], NULL, 0);
+    }
+    return 0;
+}
+
+static volatile sig_atomic_t daemon_stop_requested = 0;
+static volatile sig_atomic_t daemon_upgrade_requested = 0;
+
+static void daemon_signal(int sig) {
+    if (sig == SIGUSR2) {
+        daemon_upgrade_requested = 1;
+    } else {
+        daemon_stop_requested = 1;
+    }
+}
+
+// Path to exec on SIGUSR2: --exe if given, else argv[0] made absolute the way the
+// shell found it. Symlinks are deliberately not resolved, so a deploy that switches a
+// "current" symlink (or renames a new binary over ours) is picked up.
+static void resolve_self_exe(const char *argv0, const char *exe_flag) {
+    if (exe_flag) {
+        snprintf(self_exe_path, sizeof(self_exe_path), "%s", exe_flag);
+        return;
+    }
+    
+    char cwd[PATH_MAX];
+    if (strchr(argv0, '/')) {
+        if (argv0[0] == '/' || !getcwd(cwd, sizeof(cwd)) ||
+            snprintf(self_exe_path, sizeof(self_exe_path), "%s/%s", cwd, argv0) >= (int)sizeof(self_exe_path)) {
+            snprintf(self_exe_path, sizeof(self_exe_path), "%s", argv0);
+        }
+        return;
+    }
+    
+    // Started through PATH
+    const char *path = getenv("PATH");
+    while (path && *path) {
+        const char *end = strchr(path, ':');
+        int len = end ? (int)(end - path) : (int)strlen(path);
+        snprintf(self_exe_path, sizeof(self_exe_path), "%.*s/%s", len, path, argv0);
+        if (len > 0 && access(self_exe_path, X_OK) == 0) return;
+        path = end ? end + 1 : NULL;
+    }
+    
+    ssize_t exe_len = readlink("/proc/self/exe", self_exe_path, sizeof(self_exe_path) - 1);
+    self_exe_path[exe_len > 0 ? exe_len : 0] = '\0';
+}
+
+// Fork and exec self_exe_path with the listening socket and the shared state
+// inherited. Returns 1 once the new process reports it is serving, 0 if it failed
+// (we keep serving then).
+static int handoff_listen_socket(struct MHD_Daemon *daemon, char **argv) {
+    if (access(self_exe_path, X_OK) != 0) {
+        printf("Upgrade: cannot execute %s: %s\n", self_exe_path, strerror(errno));
+        return 0;
+    }
+    
+    const union MHD_DaemonInfo *info = MHD_get_daemon_info(daemon, MHD_DAEMON_INFO_LISTEN_FD);
+    if (!info || info->listen_fd == MHD_INVALID_SOCKET) {
+        printf("Upgrade: no listening socket to hand off\n");
+        return 0;
+    }
+    int listen_fd = info->listen_fd;
+    
+    int ready[2];
+    if (pipe2(ready, O_CLOEXEC) != 0) {
+        printf("Upgrade: pipe failed: %s\n", strerror(errno));
+        return 0;
+    }
+    
+    // Build the child's environment before fork; only async-signal-safe calls after it
+    extern char **environ;
+    size_t env_count = 0;
+    while (environ[env_count]) env_count++;
+    char **envp = mem_calloc(MEM_OTHER, env_count + 4, sizeof(char*));
+    char listen_env[64], ready_env[64], state_env[512];
+    if (!envp) {
+        close(ready[0]);
+        close(ready[1]);
+        return 0;
+    }
+    snprintf(listen_env, sizeof(listen_env), "%s=%d", LISTEN_FD_ENV, listen_fd);
+    snprintf(ready_env, sizeof(ready_env), "%s=%d", READY_FD_ENV, ready[1]);
+    shared_state_env(state_env, sizeof(state_env));
+    size_t n = 0;
+    for (size_t i = 0; i < env_count; i++) {
+        if (strncmp(environ[i], LISTEN_FD_ENV "=", strlen(LISTEN_FD_ENV) + 1) == 0) continue;
+        if (strncmp(environ[i], READY_FD_ENV "=", strlen(READY_FD_ENV) + 1) == 0) continue;
+        if (strncmp(environ[i], SHARED_STATE_ENV "=", strlen(SHARED_STATE_ENV) + 1) == 0) continue;
+        envp[n++] = environ[i];
+    }
+    envp[n++] = listen_env;
+    envp[n++] = ready_env;
+    envp[n++] = state_env;
+    envp[n] = NULL;
+    
+    printf("Upgrade: starting %s\n", self_exe_path);
+    fflush(stdout);
+    
+    pid_t pid = fork();
+    if (pid == 0) {
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, NULL); // The signal mask survives exec
+        fcntl(listen_fd, F_SETFD, 0); // MHD opens its socket close-on-exec
+        fcntl(ready[1], F_SETFD, 0);
+        for (int i = 0; i < SHARED_STATE_COUNT; i++) {
+            if (shared_state[i].mapped) fcntl(shared_state[i].fd, F_SETFD, 0);
+        }
+        execve(self_exe_path, argv, envp);
+        _exit(127);
+    }
+    mem_free(envp);
+    close(ready[1]);
+    
+    if (pid < 0) {
+        printf("Upgrade: fork failed: %s\n", strerror(errno));
+        close(ready[0]);
+        return 0;
+    }
+    
+    // Wait for the new process to report that its daemon is up
+    struct pollfd pfd = { ready[0], POLLIN, 0 };
+    char byte = 0;
+    int rc;
+    do {
+        rc = poll(&pfd, 1, UPGRADE_READY_TIMEOUT_MS);
+    } while (rc < 0 && errno == EINTR);
+    if (rc > 0 && read(ready[0], &byte, 1) != 1) byte = 0;
+    close(ready[0]);
+    
+    if (byte != '1') {
+        printf("Upgrade: new process %d did not become ready, keeping the current one\n", (int)pid);
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+        return 0;
+    }
+    
+    printf("Upgrade: new process %d is serving\n", (int)pid);
+    return 1;
+}
+
+// Stop accepting, let in-flight requests finish, then stop the daemon
+static void drain_and_stop(struct MHD_Daemon *daemon) {
+    MHD_socket listen_fd = MHD_quiesce_daemon(daemon);
+    if (listen_fd != MHD_INVALID_SOCKET) {
+        close(listen_fd); // The new process keeps its own copy open
+    }
+    
+    for (int i = 0; i < DRAIN_TIMEOUT_SECONDS * 10; i++) {
+        const union MHD_DaemonInfo *info = MHD_get_daemon_info(daemon, MHD_DAEMON_INFO_CURRENT_CONNECTIONS);
+        if (!info || info->num_connections == 0) break;
+        
+        struct timespec pause = {0, 100 * 1000000}; // 100ms
+        nanosleep(&pause, NULL);
+    }
+    
+    MHD_stop_daemon(daemon);
+}
+
+// Daemon mode: run until SIGTERM/SIGINT, hand over to a new binary on SIGUSR2
+static int run_daemon(char **argv, int inherited_fd, int ready_fd) {
+    sigset_t handled, previous;
+    sigemptyset(&handled);
+    sigaddset(&handled, SIGTERM);
+    sigaddset(&handled, SIGINT);
+    sigaddset(&handled, SIGUSR2);
+    
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = daemon_signal;
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGUSR2, &action, NULL);
+    
+    // Blocked before MHD starts its thread so only sigsuspend below receives them
+    pthread_sigmask(SIG_BLOCK, &handled, &previous);
+    
+    if (!proctor_start(&proctor_store)) {
+        printf("Failed to start proctor event writer\n");
+        return 1;
+    }
+    
+    struct MHD_Daemon *daemon = start_http_daemon(0, inherited_fd, 1);
+    if (NULL == daemon) {
+        printf("Failed to start server\n");
+        proctor_stop(&proctor_store);
+        return 1; // The old process sees the ready pipe close and keeps serving
+    }
+    
+    if (ready_fd >= 0) {
+        if (write(ready_fd, "1", 1) != 1) {
+            printf("Failed to notify the previous process: %s\n", strerror(errno));
+        }
+        close(ready_fd);
+    }
+    printf("Server running in daemon mode (pid %d). SIGUSR2 to upgrade, SIGTERM to stop.\n", (int)getpid());
+    fflush(stdout);
+    
+    for (;;) {
+        while (!daemon_stop_requested && !daemon_upgrade_requested) {
+            sigsuspend(&previous);
+        }
+        if (daemon_stop_requested) break;
+        
+        daemon_upgrade_requested = 0;
+        if (handoff_listen_socket(daemon, argv)) break;
+    }
+    
+    printf("Draining connections...\n");
+    drain_and_stop(daemon);
+    proctor_stop(&proctor_store);
+    return 0;
+}
+
+#ifndef EXAM_SERVER_NO_MAIN
+// Main function
+int main(int argc, char **argv) {
+    mem_start_ms = session_now_ms();
+    int workers = 0;
+    int daemon_mode = 0;
+    long arena_mb = 0; // --arena-mb; 0 sizes the arena from the data files
+    float dedup_threshold = 0.0f; // --dedup: report near-duplicates and exit
+    const char *tls_cert = NULL;
+    const char *tls_key = NULL;
+    const char *exe_path = NULL; // --exe: binary to exec on SIGUSR2
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+            if (workers < 1 || workers > MAX_WORKERS) {
+                printf("--workers must be between 1 and %d\n", MAX_WORKERS);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--daemon") == 0) {
+            daemon_mode = 1;
+        } else if (strcmp(argv[i], "--exe") == 0 && i + 1 < argc) {
+            exe_path = argv[++i];
+        } else if (strcmp(argv[i], "--tls-cert") == 0 && i + 1 < argc) {
+            tls_cert = argv[++i];
+        } else if (strcmp(argv[i], "--tls-key") == 0 && i + 1 < argc) {
+            tls_key = argv[++i];
+        } else if (strcmp(argv[i], "--mem-debug") == 0) {
+            mem_debug.enabled = 1;
+        } else if (strcmp(argv[i], "--dedup") == 0) {
+            dedup_threshold = DEDUP_DEFAULT_THRESHOLD;
+            if (i + 1 < argc && (isdigit((unsigned char)argv[i + 1][0]) || argv[i + 1][0] == '.')) {
+                dedup_threshold = (float)atof(argv[++i]);
+            }
+            if (dedup_threshold <= 0.0f || dedup_threshold > 1.0f) {
+                printf("--dedup threshold must be in (0, 1]\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--pack-media") == 0) {
+            // Build media.pack from media/ and print each image's hash for questions.txt
+            return media_pack_build(MEDIA_DIR, MEDIA_PACK_PATH, 1) < 0;
+        } else if (strcmp(argv[i], "--arena-mb") == 0 && i + 1 < argc) {
+            arena_mb = atol(argv[++i]);
+            if (arena_mb < 1) {
+                printf("--arena-mb must be at least 1\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--public-host") == 0 && i + 1 < argc) {
+            public_host = argv[++i];
+            if (strlen(public_host) > 255 || strcspn(public_host, "/?#@\\ \t\r\n") != strlen(public_host)) {
+                printf("--public-host must be a host name or address\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--io-uring") == 0 && i + 1 < argc) {
+            int port = atoi(argv[++i]);
+            if (port < 1 || port > 65535 || port == PORT) {
+                printf("--io-uring needs a port other than %d\n", PORT);
+                return 1;
+            }
+            uring_port = (unsigned int)port;
+        } else {
+            printf("Usage: %s [--workers N [--arena-mb MB] | --daemon [--exe PATH]] [--tls-cert FILE --tls-key FILE] [--mem-debug] [--io-uring PORT [--public-host HOST]]\n"
+                   "       %s --pack-media\n"
+                   "       %s --dedup [THRESHOLD]\n", argv[0], argv[0], argv[0]);
+            return 1;
+        }
+    }
+    if ((tls_cert != NULL) != (tls_key != NULL)) {
+        printf("--tls-cert and --tls-key must be given together\n");
+        return 1;
+    }
+    if (workers > 0 && daemon_mode) {
+        printf("--daemon and --workers cannot be combined\n");
+        return 1;
+    }
+    if (arena_mb && workers == 0) {
+        printf("--arena-mb only applies with --workers\n");
+        return 1;
+    }
+    if (uring_port && (daemon_mode || tls_cert || getenv(LISTEN_FD_ENV))) {
+        printf("--io-uring serves plain HTTP and cannot be combined with --daemon or TLS\n");
+        return 1;
+    }
+    
+    if (dedup_threshold > 0.0f) {
+        load_questions();
+        int pairs = dedup_report(dedup_threshold, -1);
+        free_all_data_structures();
+        return pairs < 0;
+    }
+    
+    // Set by the previous process when we are started by a SIGUSR2 upgrade
+    int inherited_fd = -1;
+    int ready_fd = -1;
+    if (getenv(LISTEN_FD_ENV)) {
+        inherited_fd = atoi(getenv(LISTEN_FD_ENV));
+        ready_fd = getenv(READY_FD_ENV) ? atoi(getenv(READY_FD_ENV)) : -1;
+        unsetenv(LISTEN_FD_ENV);
+        unsetenv(READY_FD_ENV);
+        if (ready_fd >= 0) fcntl(ready_fd, F_SETFD, FD_CLOEXEC);
+        daemon_mode = 1;
+    }
+    
+    // Resolve our own path now, before anything can change the working directory
+    resolve_self_exe(argv[0], exe_path);
+    shared_state_adopt();
+    
+    printf("\n=== Online Exam Platform Backend Server ===\n");
+    
+    if (tls_cert && !tls_init(tls_cert, tls_key)) {
+        printf("Failed to load TLS certificate or key\n");
+        return 1;
+    }
+    printf("Starting server on port %u (%s)...\n", listen_port(), tls_config.enabled ? "https" : "http");
+    
+    // In multi-process mode the question bank and auth table are loaded into
+    // shared memory once, before forking, instead of once per worker
+    if (workers > 0 && !shared_arena_init(arena_mb ? (size_t)arena_mb << 20 : shared_arena_estimate())) {
+        return 1;
+    }
+    if (!session_table_init()) {
+        return 1;
+    }
+    
+    // Initialize our data structures
+    load_auth_data();
+    load_admin_users();
+    load_questions();
+    if (shared_arena.exhausted) {
+        printf("Not starting with a partly loaded question bank or auth table\n");
+        return 1;
+    }
+    media_pack_load();
+    dedup_report(DEDUP_DEFAULT_THRESHOLD, DEDUP_LOAD_REPORT);
+    
+    if (!build_question_index() || !item_stats_init() || !rank_init() || !trace_init() || !search_build()) {
+        printf("Failed to set up question index and shared statistics\n");
+        return 1;
+    }
+    if (!submissions_init() || !submission_log_replay()) {
+        printf("Failed to load graded submissions\n");
+        return 1;
+    }
+    
+    if (!cat_init(&cat_bank)) {
+        printf("Failed to set up adaptive testing\n");
+        return 1;
+    }
+    shared_state_release_unclaimed();
+    
+    if (!setup_routes(&api_router)) {
+        printf("Failed to set up routes\n");
+        return 1;
+    }
+    
+    profile_init();
+    
+    // Example of BST search
+    int test_id = 1;
+    Question *found = search_bst(question_bst_root, test_id);
+    if (found) {
+        printf("\nBST Search Test - Found question %d: %s\n", test_id, found->question);
+    } else {
+        printf("\nBST Search Test - Question %d not found\n", test_id);
+    }
+    
+    // Example of priority queue
+    printf("\nPriority Queue Test - Getting highest difficulty questions:\n");
+    for (int i = 0; i < 3; i++) {
+        Question *q = get_next_priority_question();
+        if (q) {
+            printf("- Q%d (Difficulty %d): %s\n", q->id, q->difficulty, q->question);
+        }
+    }
+    
+    if (workers > 0) {
+        shared_arena_seal();
+        int ret = run_supervisor(workers);
+        router_free(&api_router);
+        cat_free(&cat_bank);
+        item_stats_free();
+        rank_free();
+        submissions_free();
+        search_free();
+        media_pack_free();
+        trace_free();
+        tls_free();
+        printf("Server stopped. Goodbye!\n");
+        return ret;
+    }
+    
+    if (daemon_mode) {
+        int ret = run_daemon(argv, inherited_fd, ready_fd);
+        free_all_data_structures();
+        router_free(&api_router);
+        cat_free(&cat_bank);
+        item_stats_free();
+        rank_free();
+        submissions_free();
+        search_free();
+        media_pack_free();
+        trace_free();
+        tls_free();
+        printf("Server stopped. Goodbye!\n");
+        return ret;
+    }
+    
+    if (!proctor_start(&proctor_store)) {
+        printf("Failed to start proctor event writer\n");
+        return 1;
+    }
+    
+    struct MHD_Daemon *daemon = start_http_daemon(0, -1, 0);
+    
+    if (NULL == daemon) {
+        printf("Failed to start server\n");
+        proctor_stop(&proctor_store);
+        return 1;
+    }
+    
+    if (uring_port) uring_start(uring_port);
+    
     printf("Server running. Press ENTER to stop.\n");
     getchar();
     
     printf("Stopping server...\n");
+    uring_stop();
     MHD_stop_daemon(daemon);
+    proctor_stop(&proctor_store);
     
     // Clean up data structures
     free_all_data_structures();
+    router_free(&api_router);
+    cat_free(&cat_bank);
+    item_stats_free();
+    rank_free();
+    submissions_free();
+    search_free();
+    media_pack_free();
+    trace_free();
+    tls_free();
     
     printf("Server stopped. Goodbye!\n");
     return 0;
 }
+#endif // EXAM_SERVER_NO_MAIN
 
 // Definition of free_bst function
 static void free_bst(BSTNode *node) {
     if (node == NULL) return;
     free_bst(node->left);
     free_bst(node->right);
-    free(node); // Don't free question as it's shared with linked list
+    data_free(node); // Don't free question as it's shared with linked list
 }
 
 // Copy a question to temporary priority queue
 static void copy_to_temp_queue(Question *q, PQNode **temp_queue_head) {
-    PQNode *new_node = (PQNode*)malloc(sizeof(PQNode));
+    PQNode *new_node = (PQNode*)mem_alloc(MEM_PRIORITY_QUEUE, sizeof(PQNode));
     if (!new_node) return;
     
     new_node->question = q;
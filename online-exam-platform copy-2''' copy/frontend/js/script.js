@@ -5,6 +5,7 @@ let userAnswers = [];
 let markedQuestions = new Set();
 let timeLeft = 1800; // 30 minutes in seconds
 let timerInterval = null;
+let secondsOnQuestion = []; // Time spent on each question, sent with the answers
 
 // Debug function
 function debug(message, data) {
@@ -73,6 +74,7 @@ async function loadQuestions() {
         
         debug(`Successfully loaded ${questions.length} questions`);
         userAnswers = new Array(questions.length).fill(-1);
+        secondsOnQuestion = new Array(questions.length).fill(0);
         
         renderQuestion();
         buildQuestionPalette();
@@ -107,7 +109,9 @@ function cleanText(text) {
         .join('\n');
 }
 
-// Parse questions from text format
+// Parse questions from text format: id|question|option1|option2|option3|option4|image
+// image is a /media/ path on the server, or empty.
+// The server grades the exam, so there is no answer key here.
 function parseQuestions(text) {
     debug('Starting to parse questions');
     
@@ -119,27 +123,20 @@ function parseQuestions(text) {
         // Split by pipe
         const parts = line.split('|');
         
-        if (parts.length < 8) {
+        if (parts.length < 6) {
             console.error(`Invalid question format at line ${index + 1}:`, line);
             return null;
         }
         
         const [id, questionText, ...rest] = parts;
         const options = rest.slice(0, 4);
-        const correct = parseInt(rest[4]) - 1; // Convert from 1-based to 0-based indexing
-        const explanation = rest[5];
-        
-        if (isNaN(correct) || correct < 0 || correct >= 4) {
-            console.error(`Invalid correct answer at line ${index + 1}:`, correct);
-            return null;
-        }
+        const image = rest[4] && rest[4].startsWith('/media/') ? rest[4] : '';
         
         return {
             id: parseInt(id),
             text: questionText,
             options: options,
-            correct,
-            explanation: explanation
+            image: image
         };
     }).filter(q => q !== null);
 }
@@ -162,6 +159,7 @@ function renderQuestion() {
             <div class="question-status">${getQuestionStatus()}</div>
         </div>
         <div class="question-text">${question.text}</div>
+        ${question.image ? `<img class="question-image" src="http://localhost:8080${question.image}" alt="Diagram for question ${currentQuestion + 1}">` : ''}
         <div class="options">
             ${question.options.map((option, index) => {
                 const isSelected = userAnswers[currentQuestion] === index;
@@ -298,6 +296,7 @@ function startTimer() {
         }
         
         timeLeft--;
+        secondsOnQuestion[currentQuestion]++;
     }, 1000);
 }
 
@@ -316,20 +315,34 @@ async function submitExam() {
             }
         }
         
-        // Calculate score and prepare detailed results
-        let score = 0;
+        // The server grades against its key and returns it with the explanations
+        const answers = questions.map((question, index) =>
+            `${question.id}:${userAnswers[index] + 1}:${secondsOnQuestion[index] || 0}`).join(',');
+        const response = await fetch('http://localhost:8080/api/submit', {
+            method: 'POST',
+            headers: {
+                'Content-Type': 'application/x-www-form-urlencoded'
+            },
+            body: `answers=${encodeURIComponent(answers)}`
+        });
+        const result = await response.json();
+        if (!response.ok) {
+            throw new Error(result.error || `HTTP error! status: ${response.status}`);
+        }
+        
+        const graded = new Map(result.results.map(r => [r.id, r]));
         const questionDetails = questions.map((question, index) => {
-            const isCorrect = userAnswers[index] === question.correct;
-            if (isCorrect) score++;
+            const r = graded.get(question.id) || {};
+            const correctAnswer = (r.correct || 0) - 1;
             
             return {
                 questionNumber: index + 1,
                 questionText: question.text,
                 options: question.options,
                 userAnswer: userAnswers[index],
-                correctAnswer: question.correct,
-                isCorrect: isCorrect,
-                explanation: question.explanation || 'No explanation provided'
+                correctAnswer: correctAnswer,
+                isCorrect: userAnswers[index] !== -1 && userAnswers[index] === correctAnswer,
+                explanation: r.explanation || 'No explanation provided'
             };
         });
         
@@ -337,10 +350,10 @@ async function submitExam() {
 
         // Save exam data
         const examData = {
-            score,
-            totalQuestions: questions.length,
+            score: result.score,
+            totalQuestions: result.total,
             unattemptedCount,
-            percentage: (score / questions.length) * 100,
+            percentage: result.percent,
             timeSpent: 1800 - timeLeft,
             questionDetails: questionDetails
         };
@@ -361,7 +374,7 @@ async function submitExam() {
         
         // Ensure data is properly saved before redirecting
         const parsedData = JSON.parse(savedData);
-        if (!parsedData.score || !parsedData.totalQuestions || !parsedData.questionDetails) {
+        if (parsedData.score === undefined || !parsedData.totalQuestions || !parsedData.questionDetails) {
             throw new Error('Exam data is incomplete');
         }
         